@@ -3,12 +3,16 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/sendfile.h>
 #include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stddef.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "dfs.h"
 #include "dfs_structures.h"
@@ -20,6 +24,9 @@
 
 
 static int log_level = DFS_LOG_ERROR;
+static const char zero_data[BLOCK_DATA_SIZE]; //Source for zeroing file ranges
+static const dfs_filem_flags copy_src_flags = DFS_FILEM_READ | DFS_FILEM_SHARE_READ; //Copies keep writers off their source
+static const dfs_filem_flags copy_dst_flags = DFS_FILEM_WRITE; //Copies are not visible to handles until complete
 
 
 
@@ -39,7 +46,7 @@ dfs_err dfs_pcreate(const char *device, size_t total_size)
 	ERR_IF(total_size == 0, DFS_NVAL_ARGS, "Argument 'total_size' cannot be 0.\n");
 
 	dfs_err err;
-	size_t size;
+	size_t size = 0; //Left unset when no block count fits
 	size_t blk_count = determine_blk_count(total_size, &size);
 	ERR_IF(size == 0, DFS_NVAL_ARGS, "Invalid data size %ld.\n", total_size);
 
@@ -51,35 +58,12 @@ dfs_err dfs_pcreate(const char *device, size_t total_size)
 
 dfs_err dfs_popen(const char *device, dfs_partition **pt)
 {
-	ERR_NULL(device, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(device));
-	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
-
-	*pt = NULL;
-	dfs_err err;
-
-	dfs_partition* ptr = malloc(sizeof(dfs_partition));
-	ERR_NULL(ptr, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
-
-	ptr->device = open(device, O_RDWR | O_SYNC);
-	ERR_IF_FREE1(ptr->device == -1, DFS_FAILED_DEVICE_OPEN, ptr, "Failed to open device %s.\n", device);
-
-	ERR_NZERO_CLEANUP_FREE1((err = validate_partition_header(ptr)), err,
-		close(ptr->device), ptr, "Partition header validation failed.\n");
-
-	//Determine address of root block for fast access
-	uint32_t block_count;
-	lseek(ptr->device, 4, SEEK_SET); //TODO: Error check
-	ssize_t readc = read(ptr->device, &block_count, sizeof(uint32_t));
-	ERR_IF_CLEANUP_FREE1(readc != sizeof(uint32_t), DFS_FAILED_DEVICE_READ,
-		close(ptr->device), ptr, ERR_MSG_DEVICE_READ_FAIL);
-
-	ptr->root_blk_addr = determine_first_blk_addr(block_count);
-	ptr->blk_count = block_count;
-
-	ERR_NZERO_CLEANUP_FREE1((err = load_blk_map(ptr)), err, close(ptr->device), ptr, "Failed to load block map.\n");
+	return open_partition(device, false, pt);
+}
 
-	*pt = ptr;
-	return DFS_SUCCESS;
+dfs_err dfs_popen_readonly(const char *device, dfs_partition **pt)
+{
+	return open_partition(device, true, pt);
 }
 
 dfs_err dfs_pclose(dfs_partition *pt)
@@ -88,973 +72,3619 @@ dfs_err dfs_pclose(dfs_partition *pt)
 
 	dfs_err err;
 
-	ERR_NZERO((err = flush_full_blk_map(pt)), err, "Failed to flush block map.\n");
+	//Chains still queued are released before the map is written
+	ERR_NZERO((err = destroy_reclaimer(pt)), err, "Failed to stop block reclaimer.\n");
+
+	//Changes are flushed as they happen, a clean map needs no write
+	if (pt->usage_map->dirty)
+		ERR_NZERO((err = flush_full_blk_map(pt)), err, "Failed to flush block map.\n");
 	ERR_NZERO((err = destroy_blk_map(pt)), err, "Failed to destroy block map.\n");
+	ERR_NZERO((err = destroy_dir_filters(pt)), err, "Failed to destroy directory filters.\n");
+	ERR_NZERO((err = destroy_open_objects(pt)), err, "Failed to destroy open object table.\n");
+	handle_table_destroy(&pt->open_handles);
+	handle_table_destroy(&pt->open_dirs);
+	pthread_rwlock_destroy(&pt->meta_lock);
+	pthread_mutex_destroy(&pt->handle_lock);
 	close(pt->device);
 	free(pt);
 
 	return DFS_SUCCESS;
 }
 
-dfs_err dfs_dcreate(dfs_partition *pt, const char *path)
-{
-	return create_object(pt, path, ENTRY_FLAG_DIR | ENTRY_FLAG_READWRITE);
-}
-
-dfs_err dfs_fcreate(dfs_partition *pt, const char *path)
+dfs_err dfs_dopen(dfs_partition *pt, const char *path, int *dir_descriptor)
 {
-	return create_object(pt, path, ENTRY_FLAG_FILE | ENTRY_FLAG_READWRITE);
+	return dfs_dopen_at(pt, DFS_DIR_ROOT, path, dir_descriptor);
 }
 
-dfs_err dfs_fopen(dfs_partition *pt, const char *path, const dfs_filem_flags flags, int *descriptor)
+dfs_err dfs_dopen_at(dfs_partition *pt, const int dir_descriptor, const char *path, int *new_dir_descriptor)
 {
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
 	ERR_NULL(path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(path));
-	ERR_NULL(descriptor, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(descriptor));
-
-	ERR_IF(dfs_path_is_empty(path), DFS_NVAL_PATH, ERR_MSG_EMPTY_PATH("open"));
-	ERR_IF(flags == 0, DFS_NVAL_ARGS, ERR_MSG_NVAL_FLAGS("file opening"));
-
-	*descriptor = -1;
+	ERR_NULL(new_dir_descriptor, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(new_dir_descriptor));
 
-	int new_descriptor = get_lowest_unused_descriptor(*pt);
-	ERR_IF(new_descriptor == -1, DFS_MAX_HANDLES_REACHED, "Reached maximum number of open handles.\n");
+	*new_dir_descriptor = -1;
 
 	dfs_err err;
-	bool can_open = false;
-	ERR_IF((err = handle_can_open(pt, path, flags, &can_open)), err, "Failed to test if file '%s' can be opened.\n", path);
-	ERR_IF(!can_open, DFS_UNAUTHORIZED_ACCESS, ERR_MSG_UNAUTHORIZED_ACCESS("open", path));
+	dfs_dir *base;
+	ERR_IF((err = dir_handle_get(pt, dir_descriptor, &base)), err, ERR_MSG_HANDLE_FETCH_FAIL(dir_descriptor));
 
+	//Removals check for open handles under meta_lock, keep the entry from going away until the handle exists
 	entry_pointer entry;
 	entry_ptr_loc entry_loc;
-	ERR_NZERO((err = find_entry_ptr(pt, path, &entry, &entry_loc)), err, "Could not find entry for file '%s'.\n", path);
-	ERR_IF(!object_is_file(entry) || !object_is_writable(entry), DFS_UNAUTHORIZED_ACCESS, ERR_MSG_UNAUTHORIZED_ACCESS("open", path));
-
-	dfs_file handle = {
-		.present = true,
-		.flags = flags,
-		.head = 0,
-		.cur_blk_idx = entry.first_blk,
-		.first_blk_idx = entry.first_blk,
-		.last_blk_idx = entry.last_blk,
-		.entry_loc = entry_loc
+	pthread_rwlock_rdlock(&pt->meta_lock);
+	ERR_NZERO_CLEANUP((err = find_entry_ptr(pt, base, path, &entry, &entry_loc)), err, pthread_rwlock_unlock(&pt->meta_lock),
+		"Could not find entry for directory '%s'.\n", path);
+	ERR_IF_CLEANUP(!(entry.flags & ENTRY_FLAG_DIR), DFS_NVAL_PATH, pthread_rwlock_unlock(&pt->meta_lock),
+		"Can only open directory handles to directories (a file was provided).\n");
+
+	int new_descriptor;
+	void *slot;
+	pthread_mutex_lock(&pt->handle_lock);
+	ERR_NZERO_CLEANUP((err = handle_table_alloc(&pt->open_dirs, &new_descriptor, &slot)), err,
+		pthread_mutex_unlock(&pt->handle_lock); pthread_rwlock_unlock(&pt->meta_lock), "Failed to allocate directory handle.\n");
+
+	dfs_dir handle = {
+		.entry_loc = entry_loc,
+		.first_blk_idx = entry.first_blk
 	};
 
-	strcpy(handle.path, path);
+	*(dfs_dir*)slot = handle;
+	pthread_mutex_unlock(&pt->handle_lock);
+	pthread_rwlock_unlock(&pt->meta_lock);
 
-	pt->open_handles[new_descriptor] = handle;
-	*descriptor = new_descriptor;
+	*new_dir_descriptor = new_descriptor;
 	return DFS_SUCCESS;
 }
 
-dfs_err dfs_fclose(dfs_partition *pt, const int descriptor)
+dfs_err dfs_dclose(dfs_partition *pt, const int dir_descriptor)
 {
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_IF(dir_descriptor == DFS_DIR_ROOT, DFS_NVAL_DESCRIPTOR, ERR_MSG_NVAL_DESCRIPTOR("close", dir_descriptor));
 
 	dfs_err err;
-	dfs_file *file;
-	handle_get(pt, descriptor, &file);
-	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
-
-	file->present = false;
+	pthread_mutex_lock(&pt->handle_lock);
+	err = handle_table_release(&pt->open_dirs, dir_descriptor);
+	pthread_mutex_unlock(&pt->handle_lock);
+	ERR_NZERO(err, err, "Failed to release directory handle.\n");
 
 	return DFS_SUCCESS;
 }
 
-dfs_err dfs_fwrite(dfs_partition *pt, const int descriptor, const void *buffer, const size_t len, size_t *written)
+dfs_err dfs_dcreate(dfs_partition *pt, const char *path)
 {
-	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
-	ERR_NULL(buffer, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(buffer));
-	if (len == 0)
-	{
-		if (written)
-			*written = 0;
-		return DFS_SUCCESS;
-	}
-
-	dfs_err err;
-	dfs_file *file;
-	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
-
-	size_t buff_head = 0;
-	ssize_t readc;
-	block_header cur_blk;
-	blk_idx_t cur_blk_idx = file->cur_blk_idx;
-	size_t left = len - buff_head;
-
-	while (left > 0)
-	{
-		readc = device_read_at_blk(cur_blk_idx, &cur_blk, sizeof(block_header), pt);
-		ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
-
-		size_t cur_blk_off = file->head % BLOCK_DATA_SIZE;
-		size_t space_ahead = BLOCK_DATA_SIZE - cur_blk_off;
-		size_t to_write = MIN(left, space_ahead);
+	return dfs_dcreate_at(pt, DFS_DIR_ROOT, path);
+}
 
-		size_t addr = blk_off_to_addr(pt, cur_blk_idx, cur_blk_off);
-		readc = device_write_at(addr, &((char*)buffer)[buff_head], to_write, pt);
-		ERR_IF((size_t)readc != to_write, DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+dfs_err dfs_dcreate_at(dfs_partition *pt, const int dir_descriptor, const char *path)
+{
+	return dfs_ocreate_at(pt, dir_descriptor, path, DFS_FILEC_DIR, NULL);
+}
 
-		buff_head += to_write;
-		left -= to_write;
-		file->head += to_write;
+dfs_err dfs_fcreate(dfs_partition *pt, const char *path)
+{
+	return dfs_fcreate_at(pt, DFS_DIR_ROOT, path);
+}
 
-		size_t write_end = cur_blk_off + to_write;
-		if (write_end > cur_blk.used_space) //Update used space
-		{
-			cur_blk.used_space = write_end;
-			readc = device_write_at_blk(cur_blk_idx, &cur_blk, sizeof(block_header), pt);
-			ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
-		}
+dfs_err dfs_fcreate_at(dfs_partition *pt, const int dir_descriptor, const char *path)
+{
+	return dfs_ocreate_at(pt, dir_descriptor, path, DFS_FILEC_FILE, NULL);
+}
 
-		cur_blk_idx = cur_blk.next_blk;
+dfs_err dfs_ocreate_at(dfs_partition *pt, const int dir_descriptor, const char *path, const dfs_filec_flags flags, dfs_obj_id *id)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_IF(pt->read_only, DFS_UNAUTHORIZED_ACCESS, "Cannot create objects on a read-only partition.\n");
+	ERR_IF(flags & ~DFS_FILEC_ALL, DFS_NVAL_FLAGS, ERR_MSG_NVAL_FLAGS("object creation"));
 
-		if (write_end == BLOCK_DATA_SIZE && !cur_blk_idx) //Grow if written to end and no further blocks (even if nothing left to write, to comply with cursor convention)
-		{
-			err = append_blk_to_file(pt, file->entry_loc, &cur_blk_idx, file);
-			ERR_NZERO(err, err,  "Failed to grow file during write.\n");
-		}
+	dfs_err err;
+	dfs_dir *base;
+	entry_ptr_loc new_loc;
+	ERR_IF((err = dir_handle_get(pt, dir_descriptor, &base)), err, ERR_MSG_HANDLE_FETCH_FAIL(dir_descriptor));
+
+	//Creation flags share their values with entry flags
+	pthread_rwlock_wrlock(&pt->meta_lock);
+	err = create_object(pt, base, path, (file_flags_t)flags, &new_loc);
+	if (!err && id)
+	{
+		//Read back under the lock, the id is checked against the entry
+		entry_pointer new_entry;
+		if (device_read_at_entry_loc(new_loc, &new_entry, pt) != sizeof(entry_pointer))
+			err = DFS_FAILED_DEVICE_READ;
+		else
+			*id = entry_loc_to_id(new_loc, &new_entry);
 	}
-
-	file->cur_blk_idx = cur_blk_idx;
-	if (written)
-		*written = buff_head;
+	pthread_rwlock_unlock(&pt->meta_lock);
+	ERR_NZERO(err, err, "Failed to create object '%s'.\n", path);
 
 	return DFS_SUCCESS;
 }
 
-dfs_err dfs_fread(dfs_partition *pt, const int descriptor, void *buffer, const size_t len, size_t *read)
+dfs_err dfs_create_many(dfs_partition *pt, const char **paths, const dfs_filec_flags flags, const size_t n, dfs_err *results)
 {
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
-	ERR_NULL(buffer, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(buffer));
-	if (len == 0)
-	{
-		if (read)
-			*read = 0;
+	ERR_IF(!paths && n, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(paths));
+	ERR_IF(pt->read_only, DFS_UNAUTHORIZED_ACCESS, "Cannot create objects on a read-only partition.\n");
+	ERR_IF(flags & ~DFS_FILEC_ALL, DFS_NVAL_FLAGS, ERR_MSG_NVAL_FLAGS("object creation"));
+
+	if (n == 0)
 		return DFS_SUCCESS;
-	}
 
-	dfs_err err;
-	dfs_file *file;
-	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
+	char parent[MAX_PATH + 1];
+	char name[MAX_PATH + 1];
+	dfs_err err = DFS_SUCCESS;
+	size_t valid = 0, free_count = 0, free_used = 0;
 
-	size_t buff_head = 0;
-	ssize_t readc;
-	block_header cur_blk;
-	blk_idx_t cur_blk_idx = file->cur_blk_idx;
-	size_t left = len;
+	dfs_err *errs = results ? results : malloc(n * sizeof(dfs_err));
+	ERR_NULL(errs, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+	create_request *requests = malloc(n * sizeof(create_request));
+	blk_idx_t *free_blks = malloc(n * sizeof(blk_idx_t));
+	if (!requests || !free_blks)
+	{
+		free(requests);
+		free(free_blks);
+		if (errs != results) free(errs);
+		ERR(DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+	}
 
-	while (left > 0)
+	for (size_t i = 0; i < n; i++)
 	{
-		readc = device_read_at_blk(cur_blk_idx, &cur_blk, sizeof(block_header), pt);
-		ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+		errs[i] = DFS_SUCCESS;
 
-		size_t cur_blk_off = file->head % BLOCK_DATA_SIZE;
-		size_t data_ahead = cur_blk.used_space - cur_blk_off;
-		size_t to_read = MIN(left, data_ahead);
+		if (!paths[i])
+		{
+			errs[i] = DFS_NVAL_ARGS;
+			continue;
+		}
+		if (dfs_path_is_empty(paths[i]) || strlen(paths[i]) > MAX_PATH)
+		{
+			errs[i] = DFS_NVAL_PATH;
+			continue;
+		}
 
-		if (to_read == 0) break; //End of file
+		dfs_path_get_parent(parent, paths[i]);
+		dfs_path_get_name(name, paths[i]);
+
+		create_request *req = &requests[valid++];
+		req->idx = i;
+		req->path = paths[i];
+		req->parent_len = strlen(parent);
+		req->depth = 0;
+		for (size_t j = 0; j < req->parent_len; j++)
+			req->depth += parent[j] == DIR_SEPARATOR_CH;
+		req->depth += !dfs_path_is_empty(parent);
+		memset(req->name, 0, sizeof(req->name));
+		entry_copy_name(req->name, name);
+		req->hash = entry_name_hash(req->name);
+	}
 
-		size_t addr = blk_off_to_addr(pt, cur_blk_idx, cur_blk_off);
-		readc = device_read_at(addr, &((char*)buffer)[buff_head], to_read, pt);
-		ERR_IF((size_t)readc != to_read, DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+	qsort(requests, valid, sizeof(create_request), compare_requests_by_parent);
+	pthread_rwlock_wrlock(&pt->meta_lock);
 
-		buff_head += to_read;
-		left -= to_read;
-		file->head += to_read;
+	//Reserve first blocks for every object in one pass, unused ones are released at the end
+	err = alloc_blks(pt, 0, valid, free_blks, &free_count);
 
-		if (cur_blk_off + to_read == BLOCK_DATA_SIZE)
+	for (size_t start = 0, end; !err && start < valid; start = end)
+	{
+		for (end = start + 1; end < valid; end++)
 		{
-			if (cur_blk.next_blk)
-			{
-				cur_blk_idx = cur_blk.next_blk;
-			}
-			else //REVIEW: Shouldn't happen: //Grow if read to end and no further blocks (even if nothing left to read, to comply with cursor convention)
-			{
-				err = append_blk_to_file(pt, file->entry_loc, &cur_blk_idx, file);
-				ERR_NZERO(err, err,  "Failed to grow file during read. (Yes it is a thing)\n"); //RIP when user sees this lmao
-			}
+			if (requests[end].parent_len != requests[start].parent_len ||
+				memcmp(requests[end].path, requests[start].path, requests[start].parent_len))
+				break;
 		}
+
+		err = create_many_in_dir(pt, &requests[start], end - start, flags, free_blks, &free_used, free_count, errs);
 	}
 
-	file->cur_blk_idx = cur_blk_idx;
-	if (read)
-		*read = buff_head;
+	if (free_used < free_count)
+	{
+		dfs_err release_err = release_blks(pt, &free_blks[free_used], free_count - free_used);
+		if (!err)
+			err = release_err;
+	}
 
-	return DFS_SUCCESS;
+	pthread_rwlock_unlock(&pt->meta_lock);
+
+	for (size_t i = 0; !err && i < n; i++)
+		err = errs[i];
+
+	free(requests);
+	free(free_blks);
+	if (errs != results)
+		free(errs);
+
+	return err;
 }
 
-dfs_err dfs_fseek(dfs_partition *pt, const int descriptor, const size_t offset, const int whence)
+dfs_err dfs_frm(dfs_partition *pt, const char *path)
+{
+	return dfs_frm_at(pt, DFS_DIR_ROOT, path);
+}
+
+dfs_err dfs_frm_at(dfs_partition *pt, const int dir_descriptor, const char *path)
 {
-	//File cursor convention:
-	//cur_blk_idx should advance on block boundary (cur_blk_idx = file_blocks[head / BLOCK_DATA_SIZE])
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
-	ERR_IF(whence > DFS_SEEK_END, DFS_NVAL_ARGS, "The provided whence value '%d' is invalid.", whence);
+	ERR_NULL(path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(path));
+	ERR_IF(pt->read_only, DFS_UNAUTHORIZED_ACCESS, "Cannot remove objects on a read-only partition.\n");
 
 	dfs_err err;
-	dfs_file *file;
-	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
+	dfs_dir *base;
+	ERR_IF((err = dir_handle_get(pt, dir_descriptor, &base)), err, ERR_MSG_HANDLE_FETCH_FAIL(dir_descriptor));
+
+	pthread_rwlock_wrlock(&pt->meta_lock);
+	err = remove_object(pt, base, path, false);
+	pthread_rwlock_unlock(&pt->meta_lock);
+	ERR_NZERO(err, err, "Failed to remove file '%s'.\n", path);
 
-	if (whence == DFS_SEEK_END)
-		ERR_IF((err = rewind_stream(pt, file)), err, "Failed to rewind stream for seek.\n");
+	return DFS_SUCCESS;
+}
 
-	size_t pos = offset + (whence == DFS_SEEK_SET ? 0 : file->head);
-	return set_stream_pos(pt, pos, file);
+dfs_err dfs_drm(dfs_partition *pt, const char *path)
+{
+	return dfs_drm_at(pt, DFS_DIR_ROOT, path);
 }
 
-dfs_err dfs_fget_pos(dfs_partition *pt, const int descriptor, size_t *pos)
+dfs_err dfs_drm_at(dfs_partition *pt, const int dir_descriptor, const char *path)
 {
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
-	ERR_NULL(pos, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pos));
+	ERR_NULL(path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(path));
+	ERR_IF(pt->read_only, DFS_UNAUTHORIZED_ACCESS, "Cannot remove objects on a read-only partition.\n");
 
 	dfs_err err;
-	dfs_file *file;
-	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
+	dfs_dir *base;
+	ERR_IF((err = dir_handle_get(pt, dir_descriptor, &base)), err, ERR_MSG_HANDLE_FETCH_FAIL(dir_descriptor));
 
-	*pos = file->head;
+	pthread_rwlock_wrlock(&pt->meta_lock);
+	err = remove_object(pt, base, path, true);
+	pthread_rwlock_unlock(&pt->meta_lock);
+	ERR_NZERO(err, err, "Failed to remove directory '%s'.\n", path);
 
 	return DFS_SUCCESS;
 }
 
-dfs_err dfs_dlist_entries(dfs_partition *pt, const char *path, size_t capacity, dfs_entry *entries, size_t *count)
+dfs_err dfs_rmtree(dfs_partition *pt, const char *path)
+{
+	return dfs_rmtree_at(pt, DFS_DIR_ROOT, path);
+}
+
+dfs_err dfs_rmtree_at(dfs_partition *pt, const int dir_descriptor, const char *path)
 {
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
 	ERR_NULL(path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(path));
-	ERR_IF(!entries && capacity, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(entries));
+	ERR_IF(pt->read_only, DFS_UNAUTHORIZED_ACCESS, "Cannot remove objects on a read-only partition.\n");
 
-	ssize_t readc;
-	entry_pointer ptr;
 	dfs_err err;
-	ERR_NZERO((err = find_entry_ptr(pt, path, &ptr, NULL)), err, "Could not find entry for directory '%s'.\n", path);
-	ERR_IF(!(ptr.flags & ENTRY_FLAG_DIR), DFS_NVAL_PATH, "Can only list entries of a directory (a file was provided).\n");
+	dfs_dir *base;
+	ERR_IF((err = dir_handle_get(pt, dir_descriptor, &base)), err, ERR_MSG_HANDLE_FETCH_FAIL(dir_descriptor));
 
-	size_t entries_found = 0, head = 0;
-	block_header cur_blk;
-	blk_idx_t blk_idx = ptr.first_blk;
-	entry_pointer cur_entry;
-	do //If first is 0 then root block was used. All entries are given a non-zero blk_idx at creation time
-	{
-		readc = device_read_at_blk(blk_idx, &cur_blk, sizeof(block_header), pt);
-		ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+	pthread_rwlock_wrlock(&pt->meta_lock);
+	err = remove_tree(pt, base, path);
+	pthread_rwlock_unlock(&pt->meta_lock);
+	ERR_NZERO(err, err, "Failed to remove tree '%s'.\n", path);
 
-		size_t entries_in_blk = cur_blk.used_space / sizeof(entry_pointer);
-		
-		for (size_t i = 0; i < entries_in_blk && head < capacity; i++, head++)
-		{
-			device_read_at(
-				blk_off_to_addr(pt, blk_idx, i * sizeof(entry_pointer)),
-				&cur_entry, sizeof(entry_pointer), pt);
+	return DFS_SUCCESS;
+}
 
-			entries[head].dir = cur_entry.flags & ENTRY_FLAG_DIR;
-			err = determine_file_size(pt, cur_entry, &entries[head].length);
-			memcpy(entries[head].name, &cur_entry.name, MAX_PATH_NAME);
-		}
+dfs_err dfs_rename(dfs_partition *pt, const char *old_path, const char *new_path)
+{
+	return dfs_rename_at(pt, DFS_DIR_ROOT, old_path, new_path);
+}
 
-		entries_found += entries_in_blk;
-		blk_idx = cur_blk.next_blk;
-	} while (blk_idx);
+dfs_err dfs_rename_at(dfs_partition *pt, const int dir_descriptor, const char *old_path, const char *new_path)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(old_path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(old_path));
+	ERR_NULL(new_path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(new_path));
+	ERR_IF(pt->read_only, DFS_UNAUTHORIZED_ACCESS, "Cannot move objects on a read-only partition.\n");
 
-	if (count)
-		*count = entries_found;
+	dfs_err err;
+	dfs_dir *base;
+	ERR_IF((err = dir_handle_get(pt, dir_descriptor, &base)), err, ERR_MSG_HANDLE_FETCH_FAIL(dir_descriptor));
+
+	pthread_rwlock_wrlock(&pt->meta_lock);
+	err = rename_object(pt, base, old_path, new_path);
+	pthread_rwlock_unlock(&pt->meta_lock);
+	ERR_NZERO(err, err, "Failed to move '%s' to '%s'.\n", old_path, new_path);
 
 	return DFS_SUCCESS;
 }
-#pragma endregion
 
+dfs_err dfs_fcopy(dfs_partition *pt, const char *src_path, const char *dst_path)
+{
+	return dfs_fcopy_at(pt, DFS_DIR_ROOT, src_path, dst_path);
+}
 
-//========================================
-//= _structures function implementations =
-//========================================
-#pragma region _structures function implementations
-int get_lowest_unused_descriptor(const dfs_partition pt)
+dfs_err dfs_fcopy_at(dfs_partition *pt, const int dir_descriptor, const char *src_path, const char *dst_path)
 {
-	for (int i = 0; i < DFS_MAX_HANDLES; i++)
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(src_path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(src_path));
+	ERR_NULL(dst_path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(dst_path));
+	ERR_IF(pt->read_only, DFS_UNAUTHORIZED_ACCESS, "Cannot copy files on a read-only partition.\n");
+
+	dfs_err err;
+	dfs_dir *base;
+	open_object *src, *dst;
+	ERR_IF((err = dir_handle_get(pt, dir_descriptor, &base)), err, ERR_MSG_HANDLE_FETCH_FAIL(dir_descriptor));
+
+	pthread_rwlock_wrlock(&pt->meta_lock);
+	err = open_copy_objects(pt, base, src_path, dst_path, &src, &dst);
+	pthread_rwlock_unlock(&pt->meta_lock);
+	ERR_NZERO(err, err, "Failed to prepare copy of '%s' to '%s'.\n", src_path, dst_path);
+
+	//Both objects stay attached, so data is moved without holding meta_lock
+	//The source's size and chain are read lock-free, registered as a reader no shrink can release blocks under the copy
+	unsigned epoch = open_object_read_begin(src);
+	err = copy_object_data(pt, src, dst);
+	open_object_read_end(src, epoch);
+
+	//Do not leave a partial copy behind, it is removed by location while still attached and denied to other handles
+	//Renames move dst->entry_loc along, the path it was created at may name another file by now
+	dfs_err cleanup_err = DFS_SUCCESS;
+	blk_idx_t dst_first_blk = dst->chain[0];
+	if (err)
+		pthread_rwlock_wrlock(&pt->meta_lock);
+
+	pthread_mutex_lock(&pt->handle_lock);
+	if (err)
+		cleanup_err = remove_entry(pt, dst->entry_loc);
+	open_object_release(pt, src, copy_src_flags);
+	open_object_release(pt, dst, copy_dst_flags);
+	pthread_mutex_unlock(&pt->handle_lock);
+
+	if (err)
 	{
-		if (!pt.open_handles[i].present)
-			return i;
+		if (!cleanup_err)
+			cleanup_err = reclaimer_queue(pt, dst_first_blk);
+		pthread_rwlock_unlock(&pt->meta_lock);
+		if (cleanup_err)
+			ERR_MSG("Failed to remove partial copy '%s'.\n", dst_path);
 	}
+	ERR_NZERO(err, err, "Failed to copy '%s' to '%s'.\n", src_path, dst_path);
 
-	return -1;
+	return DFS_SUCCESS;
 }
 
-static dfs_err load_blk_map(dfs_partition* host)
+dfs_err dfs_fopen(dfs_partition *pt, const char *path, const dfs_filem_flags flags, int *descriptor)
 {
-	ERR_NULL(host, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(host));
-
-	blk_map *map = malloc(sizeof(blk_map));
-
-	ERR_NULL(map, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
-
-	map->length = host->blk_count >> 3;
-	map->map = malloc(map->length);
+	return dfs_fopen_at(pt, DFS_DIR_ROOT, path, flags, descriptor);
+}
 
-	ERR_NULL_FREE1(map->map, DFS_FAILED_ALLOC, map, ERR_MSG_ALLOC_FAIL);
+dfs_err dfs_fopen_at(dfs_partition *pt, const int dir_descriptor, const char *path, const dfs_filem_flags flags, int *descriptor)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(path));
+	ERR_NULL(descriptor, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(descriptor));
 
-	ssize_t readc = device_read_at(sizeof(partition_header) + sizeof(entry_pointer), map->map, map->length, host);
+	ERR_IF(dfs_path_is_empty(path), DFS_NVAL_PATH, ERR_MSG_EMPTY_PATH("open"));
+	ERR_IF(flags == 0, DFS_NVAL_ARGS, ERR_MSG_NVAL_FLAGS("file opening"));
 
-	ERR_IF_FREE2(readc != (ssize_t)map->length, DFS_FAILED_DEVICE_READ, map->map, map, ERR_MSG_DEVICE_READ_FAIL);
+	*descriptor = -1;
 
-	host->usage_map = map;
+	dfs_err err;
+	dfs_dir *base;
+	ERR_IF((err = dir_handle_get(pt, dir_descriptor, &base)), err, ERR_MSG_HANDLE_FETCH_FAIL(dir_descriptor));
 
-	return DFS_SUCCESS;
+	entry_pointer entry;
+	entry_ptr_loc entry_loc;
+	pthread_rwlock_rdlock(&pt->meta_lock);
+	ERR_NZERO_CLEANUP((err = find_entry_ptr(pt, base, path, &entry, &entry_loc)), err, pthread_rwlock_unlock(&pt->meta_lock),
+		"Could not find entry for file '%s'.\n", path);
+	ERR_IF_CLEANUP(!object_is_file(entry) || !object_is_writable(entry), DFS_UNAUTHORIZED_ACCESS, pthread_rwlock_unlock(&pt->meta_lock),
+		ERR_MSG_UNAUTHORIZED_ACCESS("open", path));
+
+	err = handle_open(pt, entry, entry_loc, flags, descriptor);
+	pthread_rwlock_unlock(&pt->meta_lock);
+	return err;
 }
 
-static dfs_err get_blk_used(const dfs_partition *pt, blk_idx_t blk_idx, bool *used)
+dfs_err dfs_fopen_by_id(dfs_partition *pt, const dfs_obj_id id, const dfs_filem_flags flags, int *descriptor)
 {
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
-	ERR_NULL(used, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(used));
-	ERR_IF(blk_idx >= pt->blk_count, DFS_NVAL_ARGS, "Argument 'blk_idx' must be smaller than total block count.\n");
-
-	blk_idx_t offset = blk_idx & 0x7; 
-	blk_idx_t index = blk_idx & ~0x7;
+	ERR_NULL(descriptor, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(descriptor));
+	ERR_IF(flags == 0, DFS_NVAL_ARGS, ERR_MSG_NVAL_FLAGS("file opening"));
 
-	*used = pt->usage_map->map[index] & (1 << offset);
+	*descriptor = -1;
 
-	return DFS_SUCCESS;
+	dfs_err err;
+	entry_pointer entry;
+	entry_ptr_loc entry_loc;
+	pthread_rwlock_rdlock(&pt->meta_lock);
+	ERR_NZERO_CLEANUP((err = read_entry_by_id(pt, id, &entry, &entry_loc)), err, pthread_rwlock_unlock(&pt->meta_lock),
+		"Could not find entry for id '%lx'.\n", (unsigned long)id);
+	ERR_IF_CLEANUP(!object_is_file(entry) || !object_is_writable(entry), DFS_UNAUTHORIZED_ACCESS, pthread_rwlock_unlock(&pt->meta_lock),
+		"Could not open object of id '%lx' due to access restrictions.\n", (unsigned long)id);
+
+	err = handle_open(pt, entry, entry_loc, flags, descriptor);
+	pthread_rwlock_unlock(&pt->meta_lock);
+	return err;
 }
 
-static dfs_err set_blk_used(const dfs_partition *pt, blk_idx_t blk_idx, bool used)
+dfs_err dfs_fclose(dfs_partition *pt, const int descriptor)
 {
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
-	ERR_IF(blk_idx >= pt->blk_count, DFS_NVAL_ARGS, "Argument 'blk_idx' must be smaller than total block count.\n");
 
-	blk_idx_t offset = blk_idx & 0x7; 
-	blk_idx_t index = blk_idx & ~0x7;
+	dfs_err err;
+	dfs_file *file;
+	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
 
-	if (used)
-		pt->usage_map->map[index] |= (1 << offset);
-	else
-		pt->usage_map->map[index] &= ~(1 << offset);
+	//The handle is released even if flushing fails
+	dfs_err flush_err = handle_flush(pt, file);
+	char *wbuf = file->wbuf;
+
+	pthread_mutex_lock(&pt->handle_lock);
+	open_object_release(pt, file->obj, file->flags);
+	err = handle_table_release(&pt->open_handles, descriptor);
+	pthread_mutex_unlock(&pt->handle_lock);
+	free(wbuf);
+	ERR_NZERO(err, err, "Failed to release file handle.\n");
+	ERR_NZERO(flush_err, flush_err, "Failed to flush file before closing.\n");
 
 	return DFS_SUCCESS;
 }
 
-static dfs_err flush_full_blk_map(const dfs_partition *pt)
+dfs_err dfs_fflush(dfs_partition *pt, const int descriptor)
 {
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
 
-	device_seek(SEEK_SET, sizeof(partition_header) + sizeof(entry_pointer), pt);
-	size_t written = device_write(pt->usage_map->map, pt->usage_map->length, pt);
-
-	ERR_IF(written != pt->usage_map->length, DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+	dfs_err err;
+	dfs_file *file;
+	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
 
-	return DFS_SUCCESS;
+	return handle_flush(pt, file);
 }
 
-static dfs_err destroy_blk_map(dfs_partition *pt)
+dfs_err dfs_fwrite(dfs_partition *pt, const int descriptor, const void *buffer, const size_t len, size_t *written)
 {
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(buffer, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(buffer));
+	if (len == 0)
+	{
+		if (written)
+			*written = 0;
+		return DFS_SUCCESS;
+	}
+
+	dfs_err err;
+	dfs_file *file;
+	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
+	ERR_IF(!(file->flags & DFS_FILEM_WRITE), DFS_UNAUTHORIZED_ACCESS, "Descriptor '%d' was not opened for writing.\n", descriptor);
+
+	//Writes that fit are kept in the handle buffer, blocks are reserved for all of it once it is flushed
+	if (file->wbuf && len < HANDLE_WBUF_SIZE - file->wbuf_len)
+	{
+		if (!file->wbuf_len && (file->flags & DFS_FILEM_APPEND))
+			file->head = file->obj->size;
+
+		memcpy(&file->wbuf[file->wbuf_len], buffer, len);
+		file->wbuf_len += len;
+		file->head += len;
+
+		if (written)
+			*written = len;
+		return DFS_SUCCESS;
+	}
+
+	//Buffered bytes go out in the same device call as the new data
+	struct iovec iov[2] = {
+		{ .iov_base = file->wbuf, .iov_len = file->wbuf_len },
+		{ .iov_base = (void*)buffer, .iov_len = len }
+	};
+	open_object *obj = file->obj;
+	size_t writec;
+	pthread_mutex_lock(&obj->lock);
+
+	size_t start = handle_write_pos(file);
+	err = object_writev_at(pt, obj, start, iov, 2, &writec);
+
+	//Buffered bytes that did not land stay in the buffer for the next flush, head still counts them
+	size_t buffered = file->wbuf_len;
+	size_t flushed = MIN(writec, buffered);
+	file->head = start + MAX(writec, buffered);
+	handle_drop_buffered(file, flushed);
+
+	pthread_mutex_unlock(&obj->lock);
+	if (written)
+		*written = writec - flushed;
+	ERR_NZERO(err, err, "Failed to write to file.\n");
+
+	return DFS_SUCCESS;
+}
+
+dfs_err dfs_fread(dfs_partition *pt, const int descriptor, void *buffer, const size_t len, size_t *read)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(buffer, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(buffer));
+	if (len == 0)
+	{
+		if (read)
+			*read = 0;
+		return DFS_SUCCESS;
+	}
+
+	dfs_err err;
+	dfs_file *file;
+	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
+	ERR_NZERO((err = handle_flush(pt, file)), err, "Failed to flush buffered writes.\n");
+
+	size_t readc;
+	if (file->rbuf && len < BLOCK_DATA_SIZE)
+	{
+		ERR_NZERO((err = handle_read_buffered(pt, file, buffer, len, &readc)), err, "Failed to read from file.\n");
+	}
+	else
+	{
+		err = object_read_at(pt, file->obj, file->head, buffer, len, &readc);
+		file->head += readc;
+		ERR_NZERO(err, err, "Failed to read from file.\n");
+	}
+
+	if (read)
+		*read = readc;
+
+	return DFS_SUCCESS;
+}
+
+dfs_err dfs_pwrite(dfs_partition *pt, const int descriptor, const size_t offset, const void *buffer, const size_t len, size_t *written)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(buffer, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(buffer));
+	if (len == 0)
+	{
+		if (written)
+			*written = 0;
+		return DFS_SUCCESS;
+	}
+
+	dfs_err err;
+	dfs_file *file;
+	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
+	ERR_IF(!(file->flags & DFS_FILEM_WRITE), DFS_UNAUTHORIZED_ACCESS, "Descriptor '%d' was not opened for writing.\n", descriptor);
+	ERR_NZERO((err = handle_flush(pt, file)), err, "Failed to flush buffered writes.\n");
+
+	open_object *obj = file->obj;
+	size_t writec;
+	pthread_mutex_lock(&obj->lock);
+	err = object_write_at(pt, obj, offset, buffer, len, &writec);
+	pthread_mutex_unlock(&obj->lock);
+	ERR_NZERO(err, err, "Failed to write to file at offset %zu.\n", offset);
+
+	if (written)
+		*written = writec;
+
+	return DFS_SUCCESS;
+}
+
+dfs_err dfs_pread(dfs_partition *pt, const int descriptor, const size_t offset, void *buffer, const size_t len, size_t *read)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(buffer, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(buffer));
+	if (len == 0)
+	{
+		if (read)
+			*read = 0;
+		return DFS_SUCCESS;
+	}
+
+	dfs_err err;
+	dfs_file *file;
+	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
+	ERR_NZERO((err = handle_flush(pt, file)), err, "Failed to flush buffered writes.\n");
+
+	size_t readc;
+	ERR_NZERO((err = object_read_at(pt, file->obj, offset, buffer, len, &readc)), err, "Failed to read from file at offset %zu.\n", offset);
+
+	if (read)
+		*read = readc;
+
+	return DFS_SUCCESS;
+}
+
+dfs_err dfs_fsendfile(dfs_partition *pt, const int descriptor, const int out_fd, const size_t offset, const size_t len, size_t *sent)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_IF(out_fd < 0, DFS_NVAL_ARGS, "Argument 'out_fd' must be a valid file descriptor.\n");
+	if (sent)
+		*sent = 0;
+	if (len == 0)
+		return DFS_SUCCESS;
+
+	dfs_err err;
+	dfs_file *file;
+	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
+	ERR_NZERO((err = handle_flush(pt, file)), err, "Failed to flush buffered writes.\n");
+
+	//Callers writing to sockets need to know how far a failed send got
+	size_t sentc = 0;
+	err = object_send_at(pt, file->obj, offset, out_fd, len, &sentc);
+	if (sent)
+		*sent = sentc;
+	ERR_NZERO(err, err, "Failed to send file at offset %zu to descriptor %d.\n", offset, out_fd);
+
+	return DFS_SUCCESS;
+}
+
+dfs_err dfs_fwritev(dfs_partition *pt, const int descriptor, const struct iovec *iov, const int iovcnt, size_t *written)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_IF(iovcnt < 0, DFS_NVAL_ARGS, "The provided buffer count '%d' is invalid.\n", iovcnt);
+	ERR_IF(iovcnt && !iov, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(iov));
+
+	dfs_err err;
+	dfs_file *file;
+	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
+	ERR_IF(!(file->flags & DFS_FILEM_WRITE), DFS_UNAUTHORIZED_ACCESS, "Descriptor '%d' was not opened for writing.\n", descriptor);
+	ERR_NZERO((err = handle_flush(pt, file)), err, "Failed to flush buffered writes.\n");
+
+	open_object *obj = file->obj;
+	size_t writec;
+	pthread_mutex_lock(&obj->lock);
+
+	size_t start = handle_write_pos(file);
+	err = object_writev_at(pt, obj, start, iov, iovcnt, &writec);
+	file->head = start + writec;
+
+	pthread_mutex_unlock(&obj->lock);
+	ERR_NZERO(err, err, "Failed to write buffers to file.\n");
+
+	if (written)
+		*written = writec;
+
+	return DFS_SUCCESS;
+}
+
+dfs_err dfs_freadv(dfs_partition *pt, const int descriptor, const struct iovec *iov, const int iovcnt, size_t *read)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_IF(iovcnt < 0, DFS_NVAL_ARGS, "The provided buffer count '%d' is invalid.\n", iovcnt);
+	ERR_IF(iovcnt && !iov, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(iov));
+
+	dfs_err err;
+	dfs_file *file;
+	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
+	ERR_NZERO((err = handle_flush(pt, file)), err, "Failed to flush buffered writes.\n");
+
+	size_t readc;
+	err = object_readv_at(pt, file->obj, file->head, iov, iovcnt, &readc);
+	file->head += readc;
+	ERR_NZERO(err, err, "Failed to read file into buffers.\n");
+
+	if (read)
+		*read = readc;
+
+	return DFS_SUCCESS;
+}
+
+dfs_err dfs_fseek(dfs_partition *pt, const int descriptor, const size_t offset, const int whence)
+{
+	//File cursor convention:
+	//Blocks exist (or are holes) only below the file size, head may point past the last block
+	//Seeking never changes the file, writes past the end fill the gap
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_IF(whence > DFS_SEEK_END, DFS_NVAL_ARGS, "The provided whence value '%d' is invalid.", whence);
+
+	dfs_err err;
+	dfs_file *file;
+	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
+	ERR_NZERO((err = handle_flush(pt, file)), err, "Failed to flush buffered writes.\n");
+
+	size_t pos = offset;
+	if (whence == DFS_SEEK_CUR)
+		pos += file->head;
+	else if (whence == DFS_SEEK_END)
+		pos += file->obj->size;
+
+	file->head = pos;
+	return DFS_SUCCESS;
+}
+
+dfs_err dfs_ftruncate(dfs_partition *pt, const int descriptor, const size_t size)
+{
+	//Stream positions are kept, even past the new end
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	dfs_err err;
+	dfs_file *file;
+	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
+	ERR_IF(!(file->flags & DFS_FILEM_WRITE), DFS_UNAUTHORIZED_ACCESS, "Descriptor '%d' was not opened for writing.\n", descriptor);
+	ERR_IF(!file_size_fits(pt, size), DFS_NVAL_ARGS, "File size %zu exceeds what the partition can address.\n", size);
+	ERR_NZERO((err = handle_flush(pt, file)), err, "Failed to flush buffered writes.\n");
+
+	open_object *obj = file->obj;
+	pthread_mutex_lock(&obj->lock);
+	if (size > obj->size)
+		err = open_object_extend(pt, obj, size, true);
+	else
+		err = open_object_shrink(pt, obj, size);
+	pthread_mutex_unlock(&obj->lock);
+	ERR_NZERO(err, err, "Failed to truncate file to %zu bytes.\n", size);
+
+	return DFS_SUCCESS;
+}
+
+dfs_err dfs_fget_pos(dfs_partition *pt, const int descriptor, size_t *pos)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(pos, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pos));
+
+	dfs_err err;
+	dfs_file *file;
+	ERR_IF((err = handle_get(pt, descriptor, &file)), err, ERR_MSG_HANDLE_FETCH_FAIL(descriptor));
+
+	*pos = file->head;
+
+	return DFS_SUCCESS;
+}
+
+dfs_err dfs_dlist_entries(dfs_partition *pt, const char *path, size_t capacity, dfs_entry *entries, size_t *count)
+{
+	return dfs_dlist_entries_at(pt, DFS_DIR_ROOT, path, capacity, entries, count);
+}
+
+dfs_err dfs_dlist_entries_at(dfs_partition *pt, const int dir_descriptor, const char *path, size_t capacity, dfs_entry *entries, size_t *count)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(path));
+	ERR_IF(!entries && capacity, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(entries));
+
+	ssize_t readc;
+	entry_pointer ptr;
+	dfs_err err;
+	dfs_dir *base;
+	ERR_IF((err = dir_handle_get(pt, dir_descriptor, &base)), err, ERR_MSG_HANDLE_FETCH_FAIL(dir_descriptor));
+
+	pthread_rwlock_rdlock(&pt->meta_lock);
+	ERR_NZERO_CLEANUP((err = find_entry_ptr(pt, base, path, &ptr, NULL)), err, pthread_rwlock_unlock(&pt->meta_lock),
+		"Could not find entry for directory '%s'.\n", path);
+	ERR_IF_CLEANUP(!(ptr.flags & ENTRY_FLAG_DIR), DFS_NVAL_PATH, pthread_rwlock_unlock(&pt->meta_lock),
+		"Can only list entries of a directory (a file was provided).\n");
+
+	size_t entries_found = 0, head = 0;
+	block_header cur_blk;
+	blk_idx_t blk_idx = ptr.first_blk;
+	entry_pointer cur_entry;
+	do //If first is 0 then root block was used. All entries are given a non-zero blk_idx at creation time
+	{
+		readc = device_read_at_blk(blk_idx, &cur_blk, sizeof(block_header), pt);
+		ERR_IF_CLEANUP(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, pthread_rwlock_unlock(&pt->meta_lock), ERR_MSG_DEVICE_READ_FAIL);
+
+		size_t entries_in_blk = cur_blk.used_space / sizeof(entry_pointer);
+		
+		for (size_t i = 0; i < entries_in_blk && head < capacity; i++)
+		{
+			device_read_at(
+				blk_off_to_addr(pt, blk_idx, i * sizeof(entry_pointer)),
+				&cur_entry, sizeof(entry_pointer), pt);
+
+			if (entry_is_removed(cur_entry))
+				continue;
+
+			entry_ptr_loc cur_loc = { .blk_idx = blk_idx, .entry_idx = i };
+			err = fill_entry_info(pt, cur_entry, cur_loc, &entries[head]);
+			ERR_NZERO_CLEANUP(err, err, pthread_rwlock_unlock(&pt->meta_lock), "Failed to get information for entry '%.20s'.\n", cur_entry.name);
+			head++;
+		}
+
+		entries_found += entries_in_blk - cur_blk.holes;
+		blk_idx = cur_blk.next_blk;
+	} while (blk_idx);
+
+	pthread_rwlock_unlock(&pt->meta_lock);
+
+	if (count)
+		*count = entries_found;
+
+	return DFS_SUCCESS;
+}
+
+dfs_err dfs_stat_by_id(dfs_partition *pt, const dfs_obj_id id, dfs_entry *entry)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(entry, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(entry));
+
+	dfs_err err;
+	entry_pointer ptr;
+	entry_ptr_loc entry_loc;
+	pthread_rwlock_rdlock(&pt->meta_lock);
+	ERR_NZERO_CLEANUP((err = read_entry_by_id(pt, id, &ptr, &entry_loc)), err, pthread_rwlock_unlock(&pt->meta_lock),
+		"Could not find entry for id '%lx'.\n", (unsigned long)id);
+
+	err = fill_entry_info(pt, ptr, entry_loc, entry);
+	pthread_rwlock_unlock(&pt->meta_lock);
+	return err;
+}
+#pragma endregion
+
+
+//========================================
+//= _structures function implementations =
+//========================================
+#pragma region _structures function implementations
+static void handle_table_init(handle_table *table, size_t elem_size)
+{
+	table->elem_size = elem_size;
+	table->page_count = 0;
+	table->dir = NULL;
+	table->free_next = NULL;
+	table->free_head = -1;
+}
+
+static dfs_err handle_table_alloc(handle_table *table, int *descriptor, void **slot)
+{
+	ERR_NULL(table, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(table));
+	ERR_NULL(descriptor, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(descriptor));
+	ERR_NULL(slot, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(slot));
+
+	if (table->free_head == -1)
+	{
+		//Grow by one page, existing pages stay in place
+		size_t capacity = table->page_count * HANDLE_PAGE_SLOTS;
+		ERR_IF(capacity + HANDLE_PAGE_SLOTS > INT_MAX, DFS_MAX_HANDLES_REACHED, "Reached maximum number of open handles.\n");
+
+		int *free_next = realloc(table->free_next, (capacity + HANDLE_PAGE_SLOTS) * sizeof(int));
+		ERR_NULL(free_next, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+		table->free_next = free_next;
+
+		handle_dir *dir = table->dir;
+		if (!dir || table->page_count == dir->page_cap)
+		{
+			//Lookups may still be reading the old directory, retire it instead of freeing
+			size_t new_cap = dir ? dir->page_cap * 2 : HANDLE_DIR_MIN_PAGES;
+			handle_dir *new_dir = calloc(1, sizeof(handle_dir) + new_cap * sizeof(handle_page*));
+			ERR_NULL(new_dir, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+
+			new_dir->retired = dir;
+			new_dir->page_cap = new_cap;
+			for (size_t i = 0; i < table->page_count; i++)
+				new_dir->pages[i] = dir->pages[i];
+
+			table->dir = new_dir;
+			dir = new_dir;
+		}
+
+		handle_page *page = calloc(1, sizeof(handle_page) + HANDLE_PAGE_SLOTS * table->elem_size);
+		ERR_NULL(page, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+		dir->pages[table->page_count++] = page;
+
+		//Chain new slots in ascending order
+		for (size_t i = 0; i < HANDLE_PAGE_SLOTS; i++)
+			table->free_next[capacity + i] = i + 1 < HANDLE_PAGE_SLOTS ? (int)(capacity + i + 1) : -1;
+		table->free_head = (int)capacity;
+	}
+
+	int new_descriptor = table->free_head;
+	table->free_head = table->free_next[new_descriptor];
+
+	handle_page *page = table->dir->pages[new_descriptor / HANDLE_PAGE_SLOTS];
+	page->used[new_descriptor % HANDLE_PAGE_SLOTS] = true;
+
+	*descriptor = new_descriptor;
+	*slot = handle_table_get(table, new_descriptor);
+	return DFS_SUCCESS;
+}
+
+static void *handle_table_get(const handle_table *table, int descriptor)
+{
+	handle_dir *dir = table->dir;
+
+	if (!dir || descriptor < 0 || (size_t)descriptor / HANDLE_PAGE_SLOTS >= dir->page_cap)
+		return NULL;
+
+	handle_page *page = dir->pages[descriptor / HANDLE_PAGE_SLOTS];
+	if (!page || !page->used[descriptor % HANDLE_PAGE_SLOTS])
+		return NULL;
+
+	return page->slots + (descriptor % HANDLE_PAGE_SLOTS) * table->elem_size;
+}
+
+static dfs_err handle_table_release(handle_table *table, int descriptor)
+{
+	ERR_NULL(table, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(table));
+	ERR_IF(!handle_table_get(table, descriptor), DFS_NVAL_DESCRIPTOR, ERR_MSG_NVAL_DESCRIPTOR("release", descriptor));
+
+	handle_page *page = table->dir->pages[descriptor / HANDLE_PAGE_SLOTS];
+	page->used[descriptor % HANDLE_PAGE_SLOTS] = false;
+
+	table->free_next[descriptor] = table->free_head;
+	table->free_head = descriptor;
+	return DFS_SUCCESS;
+}
+
+static void handle_table_destroy(handle_table *table)
+{
+	handle_dir *dir = table->dir;
+
+	for (size_t i = 0; i < table->page_count; i++)
+		free(dir->pages[i]);
+
+	while (dir)
+	{
+		handle_dir *retired = dir->retired;
+		free(dir);
+		dir = retired;
+	}
+
+	free(table->free_next);
+	handle_table_init(table, table->elem_size);
+}
+
+static dfs_err load_blk_map(dfs_partition* host)
+{
+	ERR_NULL(host, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(host));
+
+	blk_map *map = malloc(sizeof(blk_map));
+
+	ERR_NULL(map, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+
+	map->length = DIV_ROUND_UP(host->blk_count, 8);
+	map->dirty = false;
+	map->map = malloc(map->length);
+
+	ERR_NULL_FREE1(map->map, DFS_FAILED_ALLOC, map, ERR_MSG_ALLOC_FAIL);
+
+	ssize_t readc = device_read_at(sizeof(partition_header) + sizeof(entry_pointer), map->map, map->length, host);
+
+	ERR_IF_FREE2(readc != (ssize_t)map->length, DFS_FAILED_DEVICE_READ, map->map, map, ERR_MSG_DEVICE_READ_FAIL);
+
+	pthread_mutex_init(&map->lock, NULL);
+	host->usage_map = map;
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err get_blk_used(const dfs_partition *pt, blk_idx_t blk_idx, bool *used)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(used, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(used));
+	ERR_IF(blk_idx >= pt->blk_count, DFS_NVAL_ARGS, "Argument 'blk_idx' must be smaller than total block count.\n");
+
+	blk_idx_t offset = blk_idx & 0x7; 
+	blk_idx_t index = blk_idx >> 3;
+
+	*used = pt->usage_map->map[index] & (1 << offset);
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err set_blk_used(const dfs_partition *pt, blk_idx_t blk_idx, bool used)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_IF(blk_idx >= pt->blk_count, DFS_NVAL_ARGS, "Argument 'blk_idx' must be smaller than total block count.\n");
+
+	blk_idx_t offset = blk_idx & 0x7; 
+	blk_idx_t index = blk_idx >> 3;
+
+	if (used)
+		pt->usage_map->map[index] |= (1 << offset);
+	else
+		pt->usage_map->map[index] &= ~(1 << offset);
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err flush_full_blk_map(const dfs_partition *pt)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	size_t written = device_write_at(sizeof(partition_header) + sizeof(entry_pointer), pt->usage_map->map, pt->usage_map->length, pt);
+
+	ERR_IF(written != pt->usage_map->length, DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err flush_blk_map_range(const dfs_partition *pt, blk_idx_t first_blk_idx, blk_idx_t last_blk_idx)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_IF(last_blk_idx >= pt->blk_count, DFS_NVAL_ARGS, "Argument 'last_blk_idx' must be smaller than total block count.\n");
+	ERR_IF(first_blk_idx > last_blk_idx, DFS_NVAL_ARGS, "Argument 'first_blk_idx' must not be larger than 'last_blk_idx'.\n");
+
+	blk_idx_t first_byte = first_blk_idx >> 3;
+	size_t len = (last_blk_idx >> 3) - first_byte + 1;
+	size_t addr = sizeof(partition_header) + sizeof(entry_pointer) + first_byte;
+	ssize_t written = device_write_at(addr, &pt->usage_map->map[first_byte], len, pt);
+
+	ERR_IF((size_t)written != len, DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err destroy_blk_map(dfs_partition *pt)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	pthread_mutex_destroy(&pt->usage_map->lock);
+	free(pt->usage_map->map);
+	free(pt->usage_map);
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err load_reclaimer(dfs_partition *pt)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	reclaimer *rec = calloc(1, sizeof(reclaimer));
+	ERR_NULL(rec, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+
+	pthread_mutex_init(&rec->lock, NULL);
+	pthread_cond_init(&rec->cond, NULL);
+	pt->reclaimer = rec;
+
+	if (pthread_create(&rec->thread, NULL, reclaimer_run, pt))
+	{
+		pthread_cond_destroy(&rec->cond);
+		pthread_mutex_destroy(&rec->lock);
+		free(rec);
+		pt->reclaimer = NULL;
+		ERR(DFS_FAIL, "Failed to start reclaimer thread.\n");
+	}
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err reclaimer_queue(const dfs_partition *pt, blk_idx_t first_blk)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	reclaim_item *item = malloc(sizeof(reclaim_item));
+	ERR_NULL(item, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+
+	item->first_blk = first_blk;
+	item->next = NULL;
+
+	reclaimer *rec = pt->reclaimer;
+	pthread_mutex_lock(&rec->lock);
+	if (rec->tail)
+		rec->tail->next = item;
+	else
+		rec->head = item;
+	rec->tail = item;
+	pthread_cond_signal(&rec->cond);
+	pthread_mutex_unlock(&rec->lock);
+
+	return DFS_SUCCESS;
+}
+
+static void *reclaimer_run(void *arg)
+{
+	//Releases queued chains in order, until the partition closes and the queue is empty
+	dfs_partition *pt = arg;
+	reclaimer *rec = pt->reclaimer;
+
+	pthread_mutex_lock(&rec->lock);
+	while (true)
+	{
+		while (!rec->head && !rec->stopping)
+			pthread_cond_wait(&rec->cond, &rec->lock);
+
+		reclaim_item *item = rec->head;
+		if (!item)
+			break;
+
+		rec->head = item->next;
+		if (!rec->head)
+			rec->tail = NULL;
+		pthread_mutex_unlock(&rec->lock);
+
+		//Blocks of a chain that fails to release stay flagged as used
+		if (reclaim_chain(pt, item->first_blk))
+			ERR_MSG("Failed to release chain starting at block %u.\n", item->first_blk);
+		free(item);
+
+		pthread_mutex_lock(&rec->lock);
+	}
+	pthread_mutex_unlock(&rec->lock);
+
+	return NULL;
+}
+
+static dfs_err reclaim_chain(const dfs_partition *pt, blk_idx_t first_blk)
+{
+	//Walks the chain once, each header is read before its block can be handed out again
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	dfs_err err;
+	ssize_t readc;
+	block_header header;
+	blk_idx_t batch[RECLAIM_BATCH];
+	size_t count = 0;
+
+	for (blk_idx_t blk_idx = first_blk; blk_idx; blk_idx = header.next_blk)
+	{
+		readc = device_read_at_blk(blk_idx, &header, sizeof(block_header), pt);
+		ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+
+		batch[count++] = blk_idx;
+		if (count == RECLAIM_BATCH)
+		{
+			ERR_NZERO((err = release_blks(pt, batch, count)), err, "Failed to release chain blocks.\n");
+			count = 0;
+		}
+	}
+
+	ERR_NZERO((err = release_blks(pt, batch, count)), err, "Failed to release chain blocks.\n");
+	return DFS_SUCCESS;
+}
+
+static dfs_err destroy_reclaimer(dfs_partition *pt)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	reclaimer *rec = pt->reclaimer;
+	if (!rec)
+		return DFS_SUCCESS;
+
+	pthread_mutex_lock(&rec->lock);
+	rec->stopping = true;
+	pthread_cond_signal(&rec->cond);
+	pthread_mutex_unlock(&rec->lock);
+	pthread_join(rec->thread, NULL);
+
+	pthread_cond_destroy(&rec->cond);
+	pthread_mutex_destroy(&rec->lock);
+	free(rec);
+	pt->reclaimer = NULL;
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err load_dir_filters(dfs_partition *pt)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	//Filters are built lazily, as directory blocks get scanned
+	dir_filter_table *table = calloc(1, sizeof(dir_filter_table));
+	ERR_NULL(table, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+
+	pthread_mutex_init(&table->lock, NULL);
+	pt->dir_filters = table;
+
+	return DFS_SUCCESS;
+}
+
+static dir_filter *get_dir_filter(const dfs_partition *pt, blk_idx_t blk_idx)
+{
+	dir_filter *cur = pt->dir_filters->buckets[blk_idx % DIR_FILTER_BUCKETS];
+
+	while (cur && cur->blk_idx != blk_idx)
+		cur = cur->next;
+
+	return cur;
+}
+
+static dfs_err build_dir_filter(const dfs_partition *pt, blk_idx_t blk_idx, const entry_pointer *entries, size_t count, dir_filter **filter)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_IF(!entries && count, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(entries));
+
+	dir_filter *new_filter = get_dir_filter(pt, blk_idx);
+
+	if (!new_filter)
+	{
+		//Filters are only a shortcut, once at capacity blocks are simply scanned
+		if (pt->dir_filters->count >= DIR_FILTER_MAX_COUNT)
+		{
+			if (filter)
+				*filter = NULL;
+			return DFS_SUCCESS;
+		}
+
+		new_filter = malloc(sizeof(dir_filter));
+		ERR_NULL(new_filter, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+
+		new_filter->blk_idx = blk_idx;
+		new_filter->next = pt->dir_filters->buckets[blk_idx % DIR_FILTER_BUCKETS];
+		pt->dir_filters->buckets[blk_idx % DIR_FILTER_BUCKETS] = new_filter;
+		pt->dir_filters->count++;
+	}
+
+	memset(new_filter->bits, 0, sizeof(new_filter->bits));
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (entry_is_removed(entries[i]))
+			continue;
+
+		uint16_t hash = entries[i].name_hash ? entries[i].name_hash : entry_name_hash(entries[i].name);
+		dir_filter_add(new_filter, hash);
+	}
+
+	if (filter)
+		*filter = new_filter;
+
+	return DFS_SUCCESS;
+}
+
+static void dir_filter_add(dir_filter *filter, uint16_t name_hash)
+{
+	uint32_t mixed = name_hash * 2654435761u;
+	uint32_t step = (mixed >> 16) | 1;
+
+	for (int i = 0; i < DIR_FILTER_HASHES; i++, mixed += step)
+	{
+		uint32_t bit = mixed % DIR_FILTER_BITS;
+		filter->bits[bit >> 3] |= 1 << (bit & 0x7);
+	}
+}
+
+static bool dir_filter_may_contain(const dir_filter *filter, uint16_t name_hash)
+{
+	uint32_t mixed = name_hash * 2654435761u;
+	uint32_t step = (mixed >> 16) | 1;
+
+	for (int i = 0; i < DIR_FILTER_HASHES; i++, mixed += step)
+	{
+		uint32_t bit = mixed % DIR_FILTER_BITS;
+		if (!(filter->bits[bit >> 3] & (1 << (bit & 0x7))))
+			return false;
+	}
+
+	return true;
+}
+
+static dfs_err destroy_dir_filters(dfs_partition *pt)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	for (size_t i = 0; i < DIR_FILTER_BUCKETS; i++)
+	{
+		dir_filter *cur = pt->dir_filters->buckets[i];
+
+		while (cur)
+		{
+			dir_filter *next = cur->next;
+			free(cur);
+			cur = next;
+		}
+	}
+
+	pthread_mutex_destroy(&pt->dir_filters->lock);
+	free(pt->dir_filters);
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err load_open_objects(dfs_partition *pt)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	open_object_table *table = calloc(1, sizeof(open_object_table));
+	ERR_NULL(table, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+
+	pt->open_objects = table;
+
+	return DFS_SUCCESS;
+}
+
+static size_t open_object_bucket(const entry_ptr_loc entry_loc)
+{
+	return (entry_loc.blk_idx * 31 + entry_loc.entry_idx) % OPEN_OBJECT_BUCKETS;
+}
+
+static open_object *get_open_object(const dfs_partition *pt, const entry_ptr_loc entry_loc)
+{
+	open_object *cur = pt->open_objects->buckets[open_object_bucket(entry_loc)];
+
+	while (cur && (cur->entry_loc.blk_idx != entry_loc.blk_idx || cur->entry_loc.entry_idx != entry_loc.entry_idx))
+		cur = cur->next;
+
+	return cur;
+}
+
+static dfs_err open_object_create(dfs_partition *pt, const entry_pointer entry, const entry_ptr_loc entry_loc, open_object **obj)
+{
+	//Only reads the device, the new object is not in the table yet so no lock is needed
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(obj, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(obj));
+
+	dfs_err err;
+	ssize_t readc;
+	open_object *new_obj = calloc(1, sizeof(open_object));
+	ERR_NULL(new_obj, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+
+	pthread_mutex_init(&new_obj->lock, NULL);
+	new_obj->entry_loc = entry_loc;
+
+	//Index the whole chain once, handles then map offsets to blocks directly
+	blk_idx_t blk_idx = entry.first_blk;
+	while (blk_idx)
+	{
+		readc = device_read_at_blk(blk_idx, &new_obj->last_blk, sizeof(block_header), pt);
+		ERR_IF_CLEANUP(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, open_object_free(new_obj), ERR_MSG_DEVICE_READ_FAIL);
+
+		for (uint32_t i = 0; i < new_obj->last_blk.holes; i++)
+			ERR_NZERO_CLEANUP((err = open_object_chain_push(new_obj, BLK_IDX_HOLE)), err, open_object_free(new_obj), "Failed to index file hole.\n");
+		ERR_NZERO_CLEANUP((err = open_object_chain_push(new_obj, blk_idx)), err, open_object_free(new_obj), "Failed to index file block.\n");
+
+		new_obj->size += (size_t)new_obj->last_blk.holes * BLOCK_DATA_SIZE + new_obj->last_blk.used_space;
+		blk_idx = new_obj->last_blk.next_blk;
+	}
+
+	*obj = new_obj;
+	return DFS_SUCCESS;
+}
+
+static void open_object_insert(dfs_partition *pt, open_object *obj)
+{
+	//Expects handle_lock to be held
+	size_t bucket = open_object_bucket(obj->entry_loc);
+	obj->next = pt->open_objects->buckets[bucket];
+	pt->open_objects->buckets[bucket] = obj;
+	pt->open_objects->count++;
+}
+
+static void open_object_attach(open_object *obj, const dfs_filem_flags flags)
+{
+	obj->refcount++;
+
+	if (flags & DFS_FILEM_WRITE)
+		obj->writers++;
+
+	if (!(flags & DFS_FILEM_SHARE_READ))
+		obj->deny_read++;
+	if (!(flags & DFS_FILEM_SHARE_WRITE))
+		obj->deny_write++;
+}
+
+static void open_object_release(dfs_partition *pt, open_object *obj, const dfs_filem_flags flags)
+{
+	obj->refcount--;
+
+	if (flags & DFS_FILEM_WRITE)
+		obj->writers--;
+	if (!(flags & DFS_FILEM_SHARE_READ))
+		obj->deny_read--;
+	if (!(flags & DFS_FILEM_SHARE_WRITE))
+		obj->deny_write--;
+
+	if (obj->refcount)
+		return;
+
+	open_object **cur = &pt->open_objects->buckets[open_object_bucket(obj->entry_loc)];
+	while (*cur != obj)
+		cur = &(*cur)->next;
+	*cur = obj->next;
+	pt->open_objects->count--;
+	pt->open_objects->freed++;
+
+	open_object_free(obj);
+}
+
+static void open_object_relocate(dfs_partition *pt, open_object *obj, const entry_ptr_loc entry_loc)
+{
+	//Follows the entry to a new location, expects handle_lock and obj->lock to be held
+	open_object **cur = &pt->open_objects->buckets[open_object_bucket(obj->entry_loc)];
+	while (*cur != obj)
+		cur = &(*cur)->next;
+	*cur = obj->next;
+
+	size_t bucket = open_object_bucket(entry_loc);
+	obj->entry_loc = entry_loc;
+	obj->next = pt->open_objects->buckets[bucket];
+	pt->open_objects->buckets[bucket] = obj;
+}
+
+static dfs_err open_object_chain_push(open_object *obj, const blk_idx_t blk_idx)
+{
+	ERR_NULL(obj, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(obj));
+
+	if (obj->chain_len == obj->chain_cap)
+	{
+		//Readers may still index the old chain, publish a copy and retire the old one
+		ERR_IF(obj->retired_count == OPEN_OBJECT_MAX_RETIRED, DFS_FAIL, "File chain index grew too many times.\n");
+
+		size_t new_cap = obj->chain_cap ? obj->chain_cap * 2 : OPEN_OBJECT_CHAIN_MIN;
+		_Atomic blk_idx_t *new_chain = malloc(new_cap * sizeof(blk_idx_t));
+		ERR_NULL(new_chain, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+
+		_Atomic blk_idx_t *old_chain = obj->chain;
+		if (old_chain)
+		{
+			for (size_t i = 0; i < obj->chain_len; i++)
+				new_chain[i] = old_chain[i];
+			obj->retired_chains[obj->retired_count++] = old_chain;
+		}
+
+		obj->chain = new_chain;
+		obj->chain_cap = new_cap;
+	}
+
+	obj->chain[obj->chain_len++] = blk_idx;
+	return DFS_SUCCESS;
+}
+
+static void open_object_free(open_object *obj)
+{
+	if (!obj)
+		return;
+
+	pthread_mutex_destroy(&obj->lock);
+
+	for (size_t i = 0; i < obj->retired_count; i++)
+		free((void*)obj->retired_chains[i]);
+
+	free((void*)obj->chain);
+	free(obj);
+}
+
+static dfs_err destroy_open_objects(dfs_partition *pt)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	for (size_t i = 0; i < OPEN_OBJECT_BUCKETS; i++)
+	{
+		open_object *cur = pt->open_objects->buckets[i];
+
+		while (cur)
+		{
+			open_object *next = cur->next;
+			open_object_free(cur);
+			cur = next;
+		}
+	}
+
+	free(pt->open_objects);
+
+	return DFS_SUCCESS;
+}
+#pragma endregion
+
+
+//=====================================
+//= Internal function implementations =
+//=====================================
+#pragma region Device helpers
+//Positional I/O only, the device offset is shared between threads
+inline ssize_t device_write_at(const size_t addr, const void *buffer, const size_t len, const dfs_partition *partition)
+{
+	return pwrite(partition->device, buffer, len, (off_t)addr);
+}
+inline ssize_t device_write_at_blk(const blk_idx_t index, const void *buffer, const size_t len, const dfs_partition *partition)
+{
+	return device_write_at(blk_idx_to_addr(partition, index), buffer, len, partition);
+}
+inline ssize_t device_write_at_entry_loc(const entry_ptr_loc entry_loc, const entry_pointer *buffer, const dfs_partition *partition)
+{
+	return device_write_at(entry_loc_to_addr(partition, entry_loc), buffer, sizeof(entry_pointer), partition);
+}
+
+inline ssize_t device_read_at(const size_t addr, void *buffer, const size_t len, const dfs_partition *partition)
+{
+	return pread(partition->device, buffer, len, (off_t)addr);
+}
+inline ssize_t device_writev_at(const size_t addr, const struct iovec *iov, const int iovcnt, const dfs_partition *partition)
+{
+	return pwritev(partition->device, iov, iovcnt, (off_t)addr);
+}
+inline ssize_t device_readv_at(const size_t addr, const struct iovec *iov, const int iovcnt, const dfs_partition *partition)
+{
+	return preadv(partition->device, iov, iovcnt, (off_t)addr);
+}
+inline ssize_t device_read_at_blk(const blk_idx_t index, void *buffer, const size_t len, const dfs_partition *partition)
+{
+	return device_read_at(blk_idx_to_addr(partition, index), buffer, len, partition);
+}
+inline ssize_t device_read_at_entry_loc(const entry_ptr_loc entry_loc, void *buffer, const dfs_partition *partition)
+{
+	return device_read_at(entry_loc_to_addr(partition, entry_loc), buffer, sizeof(entry_pointer), partition);
+}
+
+static dfs_err force_allocate_space(const char *device, size_t size)
+{
+	ERR_NULL(device, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(device));
+	ERR_IF(size == 0, DFS_NVAL_ARGS, "Argument 'size' must not be 0.\n");
+	
+	char zero = 0;
+	int file = open(device, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+	ERR_IF(file == -1, DFS_FAILED_DEVICE_OPEN, ERR_MSG_DEVICE_OPEN_FAIL);
+	
+	lseek(file, size - 1, SEEK_SET);
+	ssize_t writtec = write(file, &zero, 1);
+	ERR_IF(writtec != 1, DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+	close(file);
+
+	return DFS_SUCCESS;
+}
+#pragma endregion
+#pragma region Block-Address abstraction
+static size_t blk_idx_to_addr(const dfs_partition *partition, const blk_idx_t index)
+{
+	return partition->root_blk_addr + (size_t)index * BLOCK_SIZE;
+}
+
+static size_t blk_off_to_addr(const dfs_partition *partition, const blk_idx_t index, const size_t offset)
+{
+	return blk_idx_to_addr(partition, index) + sizeof(block_header) + offset;
+}
+
+static size_t entry_loc_to_addr(const dfs_partition *partition, const entry_ptr_loc entry_loc)
+{
+	if (entry_loc.blk_idx == ~0u && entry_loc.entry_idx == ~0u)
+		return sizeof(partition_header);
+
+	size_t base_address = blk_idx_to_addr(partition, entry_loc.blk_idx);
+	size_t offset = sizeof(block_header) + sizeof(entry_pointer) * entry_loc.entry_idx;
+
+	return base_address + offset;
+}
+
+static entry_ptr_loc get_root_loc()
+{
+	entry_ptr_loc loc = { .blk_idx = ~0u, .entry_idx = ~0u };
+	return loc;
+}
+
+static dfs_obj_id entry_loc_to_id(const entry_ptr_loc entry_loc, const entry_pointer *entry)
+{
+	if (entry_loc.blk_idx == get_root_loc().blk_idx)
+		return DFS_OBJ_ID_ROOT;
+
+	return ((dfs_obj_id)entry_loc.blk_idx << 32) | ((dfs_obj_id)entry_id_check(entry) << OBJ_ID_ENTRY_BITS) | entry_loc.entry_idx;
+}
+
+static entry_ptr_loc id_to_entry_loc(const dfs_obj_id id)
+{
+	if (id == DFS_OBJ_ID_ROOT)
+		return get_root_loc();
+
+	entry_ptr_loc loc = { .blk_idx = (blk_idx_t)(id >> 32), .entry_idx = (uint32_t)id & ((1u << OBJ_ID_ENTRY_BITS) - 1) };
+	return loc;
+}
+
+static uint32_t entry_id_check(const entry_pointer *entry)
+{
+	//An entry's first block never changes, the slot's generation changes whenever another entry takes it
+	uint32_t mix = (entry->first_blk * 0x9E3779B1u) ^ ((uint32_t)entry->name_hash << 7);
+	return (((mix ^ (mix >> 16)) << ENTRY_GEN_SHIFT) | (entry->flags >> ENTRY_GEN_SHIFT)) & OBJ_ID_CHECK_MASK;
+}
+#pragma endregion
+#pragma region Code naming
+static size_t determine_first_blk_addr(uint32_t blk_count)
+{
+	size_t without_pad = (size_t)(blk_count >> 3) + sizeof(partition_header) + sizeof(entry_pointer);
+	size_t rem = without_pad & (SECTOR_SIZE - 1);
+	return without_pad + (rem ? SECTOR_SIZE - rem : 0);
+}
+
+static size_t determine_size_from_blk_count(size_t blk_count)
+{
+	size_t dts = determine_first_blk_addr(blk_count);
+	return dts + blk_count * BLOCK_SIZE;
+}
+
+static size_t determine_blk_count(size_t maxSize, size_t *partition_size)
+{
+	size_t max = MAX_BLKS, min = 0;
+	size_t current = 0, total_size = 0;
+	int iter_count = 0; //Iteration limiter, should not be needed
+	
+	while (iter_count < 64)
+	{
+		iter_count++;
+
+		current = (min + max) >> 1;
+		total_size = determine_size_from_blk_count(current);
+
+		if (total_size < maxSize)
+			min = current;
+		else if (total_size > maxSize)
+			max = current;
+		else
+			goto return_value;
+
+		if (max - min <= 1)
+		{
+			current = min;
+			goto return_value;
+		}
+	}
+
+	return 0;
+
+return_value:
+	if (partition_size)
+		*partition_size = determine_size_from_blk_count(current);
+
+	return current;
+}
+
+static dfs_err init_empty_partition(const char *device, size_t blk_count)
+{
+	ERR_NULL(device, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(device));
+	ERR_IF(blk_count == 0, DFS_NVAL_ARGS, "Argument 'blk_count' must not be 0.\n");
+
+	int file = open(device, O_RDWR | O_SYNC);
+
+	ERR_IF(file == -1, DFS_NVAL_ARGS, ERR_MSG_DEVICE_OPEN_FAIL);
+
+	//Write header
+	partition_header header = { .magic_number = MAGIC_NUMBER,
+		.block_count = blk_count, .resvd = 0 };
+	size_t written = write(file, &header, sizeof(partition_header));
+	ERR_IF_CLEANUP(written != sizeof(partition_header),
+		DFS_FAILED_DEVICE_WRITE, close(file), ERR_MSG_DEVICE_WRITE_FAIL);
+
+	//Set and write root entry_pointer
+	entry_pointer root_pointer = { .first_blk = 0, .last_blk = 0, .flags = ENTRY_FLAG_DIR, .name_hash = 0, .name = {0} };
+	memcpy(root_pointer.name, "FSRoot!PlsNoTouchy:)", MAX_PATH_NAME); //HACK: Length may differ if string changes
+	written = write(file, &root_pointer, sizeof(entry_pointer));
+	ERR_IF_CLEANUP(written != sizeof(entry_pointer),
+		DFS_FAILED_DEVICE_WRITE, close(file), ERR_MSG_DEVICE_WRITE_FAIL);
+
+	//Clear block map
+	char zeros[SECTOR_SIZE] = { 0 };
+	size_t blocks_left = blk_count;
+	size_t first_sector_bytes = SECTOR_SIZE - sizeof(partition_header) - sizeof(entry_pointer);
+	written = write(file, zeros, first_sector_bytes);
+	ERR_IF_CLEANUP(written != first_sector_bytes,
+		DFS_FAILED_DEVICE_WRITE, close(file), ERR_MSG_DEVICE_WRITE_FAIL);
+	blocks_left -= MIN(first_sector_bytes << 3, blocks_left);
+
+	while (blocks_left > 0)
+	{
+		written = write(file, zeros, SECTOR_SIZE);
+		ERR_IF_CLEANUP(written != SECTOR_SIZE,
+			DFS_FAILED_DEVICE_WRITE, close(file), ERR_MSG_DEVICE_WRITE_FAIL);
+			
+		blocks_left -= MIN(SECTOR_SIZE * 8, blocks_left); //Bits per sector
+	}
+
+	//Set root to used
+	char root_used = 1;
+	lseek(file, sizeof(partition_header) + sizeof(entry_pointer), SEEK_SET);
+	written = write(file, &root_used, 1);
+	ERR_IF_CLEANUP(written != 1,
+		DFS_FAILED_DEVICE_WRITE, close(file), ERR_MSG_DEVICE_WRITE_FAIL);
+
+	//Init root block header
+	block_header root_header = { 0 };
+	lseek(file, determine_first_blk_addr(blk_count), SEEK_SET);
+	written = write(file, &root_header, sizeof(block_header));
+	ERR_IF_CLEANUP(written != sizeof(block_header),
+		DFS_FAILED_DEVICE_WRITE, close(file), ERR_MSG_DEVICE_WRITE_FAIL);
+
+	close(file);
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err validate_partition_header(const dfs_partition* pt)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	partition_header buff;
+	ssize_t readc;
+
+	readc = read(pt->device, &buff, sizeof(partition_header));
+	ERR_IF(readc != sizeof(partition_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+
+	//Check magic number
+	ERR_IF(buff.magic_number != MAGIC_NUMBER, DFS_CORRUPTED_PARTITION, "Partition has incorrect magic number.\n");
+
+	//Check reserved
+	ERR_IF(buff.resvd != 0, DFS_CORRUPTED_PARTITION, "Partition has reserved flags set.\n");
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err open_partition(const char *device, const bool read_only, dfs_partition **pt)
+{
+	ERR_NULL(device, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(device));
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	*pt = NULL;
+	dfs_err err;
+
+	dfs_partition* ptr = calloc(1, sizeof(dfs_partition));
+	ERR_NULL(ptr, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+
+	ptr->read_only = read_only;
+	ptr->device = open(device, read_only ? O_RDONLY : O_RDWR | O_SYNC);
+	ERR_IF_FREE1(ptr->device == -1, DFS_FAILED_DEVICE_OPEN, ptr, "Failed to open device %s.\n", device);
+
+	ERR_NZERO_CLEANUP_FREE1((err = validate_partition_header(ptr)), err,
+		close(ptr->device), ptr, "Partition header validation failed.\n");
+
+	//Determine address of root block for fast access
+	uint32_t block_count;
+	lseek(ptr->device, 4, SEEK_SET); //TODO: Error check
+	ssize_t readc = read(ptr->device, &block_count, sizeof(uint32_t));
+	ERR_IF_CLEANUP_FREE1(readc != sizeof(uint32_t), DFS_FAILED_DEVICE_READ,
+		close(ptr->device), ptr, ERR_MSG_DEVICE_READ_FAIL);
+
+	ptr->root_blk_addr = determine_first_blk_addr(block_count);
+	ptr->blk_count = block_count;
+	ptr->root_dir.entry_loc = get_root_loc();
+	ptr->root_dir.first_blk_idx = 0;
+
+	ERR_NZERO_CLEANUP_FREE1((err = load_blk_map(ptr)), err, close(ptr->device), ptr, "Failed to load block map.\n");
+	ERR_NZERO_CLEANUP_FREE1((err = load_dir_filters(ptr)), err, destroy_blk_map(ptr); close(ptr->device), ptr,
+		"Failed to initialize directory filters.\n");
+	ERR_NZERO_CLEANUP_FREE1((err = load_open_objects(ptr)), err, destroy_dir_filters(ptr); destroy_blk_map(ptr); close(ptr->device), ptr,
+		"Failed to initialize open object table.\n");
+	if (!read_only)
+		ERR_NZERO_CLEANUP_FREE1((err = load_reclaimer(ptr)), err, destroy_open_objects(ptr); destroy_dir_filters(ptr); destroy_blk_map(ptr); close(ptr->device), ptr,
+			"Failed to start block reclaimer.\n");
+	handle_table_init(&ptr->open_handles, sizeof(dfs_file));
+	handle_table_init(&ptr->open_dirs, sizeof(dfs_dir));
+	pthread_rwlock_init(&ptr->meta_lock, NULL);
+	pthread_mutex_init(&ptr->handle_lock, NULL);
+
+	*pt = ptr;
+	return DFS_SUCCESS;
+}
+#pragma endregion
+#pragma region Block navigation
+static dfs_err find_entry_ptr(const dfs_partition *pt, const dfs_dir *base, const char *path, entry_pointer *entry, entry_ptr_loc *entry_loc)
+{
+	//Paths are resolved relative to base, the root directory for absolute paths
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(base, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(base));
+	ERR_NULL(path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(path));
+
+	if (dfs_path_is_empty(path))
+	{
+		entry_ptr_loc loc = base->entry_loc;
+
+		if (entry)
+		{
+			entry_pointer e;
+			ssize_t readc = device_read_at_entry_loc(loc, &e, pt);
+			ERR_IF(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+			*entry = e;
+		}
+
+		if (entry_loc)
+			*entry_loc = loc;
+
+		return DFS_SUCCESS;
+	}
+
+	char root[MAX_PATH + 1];
+	char tail[MAX_PATH + 1];
+	char rest[MAX_PATH + 1];
+	entry_pointer found_entry;
+	entry_ptr_loc location;
+	blk_idx_t dir_blk = base->first_blk_idx;
+	dfs_err err;
+
+	strncpy(rest, path, MAX_PATH);
+	rest[MAX_PATH] = '\0';
+
+	while (true)
+	{
+		dfs_path_get_root(root, rest);
+		dfs_path_get_tail(tail, rest);
+
+		bool is_final = dfs_path_is_empty(root);
+		err = find_entry_in_dir(pt, dir_blk, is_final ? tail : root, &found_entry, &location, NULL, NULL, NULL);
+		if (err) return err;
+
+		if (is_final)
+			break;
+
+		//Only directories can hold further path components
+		if (!(found_entry.flags & ENTRY_FLAG_DIR)) return DFS_PATH_NOT_FOUND;
+
+		dir_blk = found_entry.first_blk;
+		strcpy(rest, tail);
+	}
+
+	if (entry)
+		*entry = found_entry;
+	if (entry_loc)
+		*entry_loc = location;
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err find_entry_in_dir(const dfs_partition *pt, const blk_idx_t first_blk, const char *name, entry_pointer *entry, entry_ptr_loc *entry_loc, blk_idx_t *last_blk_idx, block_header *last_blk, blk_idx_t *removed_blk)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(name, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(name));
+
+	if (removed_blk)
+		*removed_blk = 0;
+
+	entry_pointer *entries = NULL;
+	block_header cur_header = { 0 };
+	blk_idx_t cur_blk = first_blk;
+	uint16_t search_hash = entry_name_hash(name);
+	dfs_err err;
+	ssize_t readc;
+
+	while (true)
+	{
+		readc = device_read_at_blk(cur_blk, &cur_header, sizeof(block_header), pt);
+		ERR_IF_FREE1(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, entries, ERR_MSG_DEVICE_READ_FAIL);
+
+		//REVIEW: Possibly validate header used_space is multiple of sizeof(entry_pointer)
+		size_t valid_entry_count = cur_header.used_space / sizeof(entry_pointer);
+
+		//Callers inserting a new entry prefer the first free slot over growing the directory
+		if (removed_blk && !*removed_blk && cur_header.holes)
+			*removed_blk = cur_blk;
+
+		//Skip blocks whose filter proves the name is not there
+		//Concurrent lookups build filters lazily, only test them under the table lock
+		pthread_mutex_lock(&pt->dir_filters->lock);
+		dir_filter *filter = get_dir_filter(pt, cur_blk);
+		bool may_contain = !filter || dir_filter_may_contain(filter, search_hash);
+		pthread_mutex_unlock(&pt->dir_filters->lock);
+
+		if (valid_entry_count && may_contain)
+		{
+			if (!entries)
+			{
+				entries = malloc(ENTRIES_PER_BLK * sizeof(entry_pointer));
+				ERR_NULL(entries, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+			}
+
+			//Only read the part of the block in use
+			size_t entries_len = valid_entry_count * sizeof(entry_pointer);
+			readc = device_read_at(blk_off_to_addr(pt, cur_blk, 0), entries, entries_len, pt);
+			ERR_IF_FREE1((size_t)readc != entries_len, DFS_FAILED_DEVICE_READ, entries, ERR_MSG_DEVICE_READ_FAIL);
+
+			if (!filter)
+			{
+				pthread_mutex_lock(&pt->dir_filters->lock);
+				err = get_dir_filter(pt, cur_blk) ? DFS_SUCCESS : build_dir_filter(pt, cur_blk, entries, valid_entry_count, NULL);
+				pthread_mutex_unlock(&pt->dir_filters->lock);
+				ERR_NZERO_FREE1(err, err, entries, "Failed to build directory filter.\n");
+			}
+
+			for (size_t i = 0; i < valid_entry_count; i++)
+			{
+				//Filter out by hash first, entries without one (0) always go through full compare
+				if (entries[i].name_hash && entries[i].name_hash != search_hash)
+					continue;
+
+				if (entry_is_removed(entries[i]))
+					continue;
+
+				//Filter out not matching names (at most one should match)
+				if (strncmp(name, entries[i].name, MAX_PATH_NAME))
+					continue;
+
+				if (entry)
+					*entry = entries[i];
+				if (entry_loc)
+				{
+					entry_loc->blk_idx = cur_blk;
+					entry_loc->entry_idx = i;
+				}
+
+				free(entries);
+				return DFS_SUCCESS;
+			}
+		}
+
+		if (!cur_header.next_blk)
+			break;
+
+		cur_blk = cur_header.next_blk;
+	}
+
+	free(entries);
+
+	//Not found, hand back the tail so callers can insert without rereading it
+	if (last_blk_idx)
+		*last_blk_idx = cur_blk;
+	if (last_blk)
+		*last_blk = cur_header;
+
+	return DFS_PATH_NOT_FOUND;
+}
+
+static dfs_err find_free_blks(const dfs_partition *pt, const size_t count, blk_idx_t *indices, size_t *found)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(indices, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(indices));
+	ERR_NULL(found, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(found));
+
+	dfs_err err;
+	size_t found_count = 0;
+
+	//Search a byte at a time, full bytes are skipped without checking bits
+	for (size_t i = 0; i < pt->usage_map->length && found_count < count; i++)
+	{
+		uint8_t bits = pt->usage_map->map[i];
+
+		if (bits == 0xFF)
+			continue;
+
+		for (blk_idx_t bit = 0; bit < 8 && found_count < count; bit++)
+		{
+			blk_idx_t blk_idx = (blk_idx_t)(i << 3) + bit;
+
+			if (blk_idx >= pt->blk_count)
+				break;
+
+			bool used;
+			ERR_NZERO((err = get_blk_used(pt, blk_idx, &used)), err, "Failed to retrieve block usage state.\n");
+
+			if (!used)
+				indices[found_count++] = blk_idx;
+		}
+	}
+
+	*found = found_count;
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err find_free_run(const dfs_partition *pt, const blk_idx_t goal, const size_t count, blk_idx_t *indices, size_t *found)
+{
+	//First run of count free blocks starting at or after goal, then from the partition start
+	//Falls back to scattered blocks when free space is too fragmented for a run
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(indices, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(indices));
+	ERR_NULL(found, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(found));
+
+	dfs_err err;
+	size_t from = goal < pt->blk_count ? goal : 0;
+
+	for (int pass = 0; pass < 2 && count; pass++, from = 0)
+	{
+		size_t run = 0;
+
+		for (size_t blk_idx = from; blk_idx < pt->blk_count; blk_idx++)
+		{
+			//Full bytes break any run, skip them without checking bits
+			if (!(blk_idx & 7) && pt->usage_map->map[blk_idx >> 3] == 0xFF)
+			{
+				run = 0;
+				blk_idx += 7;
+				continue;
+			}
+
+			bool used;
+			ERR_NZERO((err = get_blk_used(pt, (blk_idx_t)blk_idx, &used)), err, "Failed to retrieve block usage state.\n");
+
+			run = used ? 0 : run + 1;
+			if (run == count)
+			{
+				for (size_t i = 0; i < count; i++)
+					indices[i] = (blk_idx_t)(blk_idx + 1 - count + i);
+
+				*found = count;
+				return DFS_SUCCESS;
+			}
+		}
+	}
+
+	return find_free_blks(pt, count, indices, found);
+}
+
+static uint16_t entry_name_hash(const char *name)
+{
+	//FNV-1a over the stored part of the name, folded to 16 bits
+	uint32_t hash = 2166136261u;
+
+	for (size_t i = 0; i < MAX_PATH_NAME && name[i]; i++)
+	{
+		hash ^= (uint8_t)name[i];
+		hash *= 16777619u;
+	}
+
+	hash = (hash >> 16) ^ (hash & 0xFFFF);
+
+	return hash ? (uint16_t)hash : 1; //0 is reserved for entries without hash
+}
+
+static void entry_copy_name(char *dst, const char *name)
+{
+	//Fills all MAX_PATH_NAME bytes, longer names are cut and shorter ones zero padded without a terminator requirement
+	size_t len = strnlen(name, MAX_PATH_NAME);
+	memset(dst, 0, MAX_PATH_NAME);
+	memcpy(dst, name, len);
+}
+#pragma endregion
+#pragma region Block manipulation
+static dfs_err alloc_blk(const dfs_partition *pt, blk_idx_t *index)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(index, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(index));
+
+	dfs_err err;
+	size_t found;
+
+	ERR_NZERO((err = alloc_blks(pt, 0, 1, index, &found)), err, "Failed to reserve block.\n");
+	ERR_IF(!found, DFS_NO_SPACE, "Failed to allocate space for new block.\n");
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err alloc_blks(const dfs_partition *pt, const blk_idx_t goal, const size_t count, blk_idx_t *indices, size_t *found)
+{
+	//Search and flag under the map lock, so no two threads get the same block
+	//Consecutive blocks from goal onwards are preferred, see find_free_run
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(found, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(found));
+
+	dfs_err err;
+	size_t found_count = 0;
+	pthread_mutex_lock(&pt->usage_map->lock);
+
+	err = find_free_run(pt, goal, count, indices, &found_count);
+	for (size_t i = 0; !err && i < found_count; i++)
+		err = set_blk_used(pt, indices[i], true);
+	if (!err && found_count)
+		err = flush_blk_map_range(pt, indices[0], indices[found_count - 1]);
+	if (err)
+	{
+		//Nothing is handed out on failure, the map is written whole later once dirty
+		for (size_t i = 0; i < found_count; i++)
+			set_blk_used(pt, indices[i], false);
+		pt->usage_map->dirty = true;
+	}
+
+	pthread_mutex_unlock(&pt->usage_map->lock);
+	ERR_NZERO(err, err, "Failed to reserve blocks.\n");
+
+	*found = found_count;
+	return DFS_SUCCESS;
+}
+
+static dfs_err release_blks(const dfs_partition *pt, const blk_idx_t *indices, const size_t count)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_IF(!indices && count, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(indices));
+
+	if (count == 0)
+		return DFS_SUCCESS;
+
+	dfs_err err = DFS_SUCCESS;
+	blk_idx_t lowest = indices[0], highest = indices[0];
+	pthread_mutex_lock(&pt->usage_map->lock);
+
+	for (size_t i = 0; !err && i < count; i++)
+	{
+		err = set_blk_used(pt, indices[i], false);
+		lowest = MIN(lowest, indices[i]);
+		highest = MAX(highest, indices[i]);
+	}
+	if (!err)
+		err = flush_blk_map_range(pt, lowest, highest);
+	if (err)
+		pt->usage_map->dirty = true;
+
+	pthread_mutex_unlock(&pt->usage_map->lock);
+	ERR_NZERO(err, err, "Failed to release blocks.\n");
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err append_blk_to_file(const dfs_partition *pt, const entry_ptr_loc entry_loc, blk_idx_t *new_idx, const size_t holes, open_object *obj)
+{ //REVIEW: Maybe break down into smaller functions
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_IF(holes >= pt->blk_count, DFS_NVAL_ARGS, "Hole of %zu blocks exceeds the partition's block count.\n", holes);
+
+	dfs_err err;
+	ssize_t readc;
+	uint32_t new_blk_idx, old_block_idx;
+	entry_pointer entry, old_entry;
+	block_header new_blk, old_block;
+
+	//Find block and reserve, it is given back and the entry restored if linking it fails
+	ERR_NZERO((err = alloc_blk(pt, &new_blk_idx)), err, "Could not reserve a free block.\n");
+
+	//Read entry pointer
+	readc = device_read_at_entry_loc(entry_loc, &entry, pt);
+	ERR_IF_CLEANUP(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_READ, release_blks(pt, &new_blk_idx, 1), ERR_MSG_DEVICE_READ_FAIL);
+
+	//Update last block index in entry
+	old_entry = entry;
+	old_block_idx = entry.last_blk;
+	entry.last_blk = new_blk_idx;
+
+	//Flush changes
+	readc = device_write_at_entry_loc(entry_loc, &entry, pt);
+	ERR_IF_CLEANUP(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_WRITE,
+		device_write_at_entry_loc(entry_loc, &old_entry, pt); release_blks(pt, &new_blk_idx, 1), ERR_MSG_DEVICE_WRITE_FAIL);
+
+	//Create new block header
+	new_blk.next_blk = 0;
+	new_blk.prev_blk = old_block_idx;
+	new_blk.used_space = 0;
+	new_blk.holes = (uint32_t)holes;
+
+	//Store new block
+	readc = device_write_at_blk(new_blk_idx, &new_blk, sizeof(block_header), pt);
+	ERR_IF_CLEANUP(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE,
+		device_write_at_entry_loc(entry_loc, &old_entry, pt); release_blks(pt, &new_blk_idx, 1), ERR_MSG_DEVICE_WRITE_FAIL);
+
+	//Read old block, open objects cache it
+	if (obj)
+		old_block = obj->last_blk;
+	else
+	{
+		readc = device_read_at_blk(old_block_idx, &old_block, sizeof(block_header), pt);
+		ERR_IF_CLEANUP(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ,
+			device_write_at_entry_loc(entry_loc, &old_entry, pt); release_blks(pt, &new_blk_idx, 1), ERR_MSG_DEVICE_READ_FAIL);
+	}
+
+	//Update index and used space
+	old_block.next_blk = new_blk_idx;
+	old_block.used_space = BLOCK_DATA_SIZE;
+
+	//Flush changes
+	readc = device_write_at_blk(old_block_idx, &old_block, sizeof(block_header), pt);
+	ERR_IF_CLEANUP(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE,
+		device_write_at_entry_loc(entry_loc, &old_entry, pt); release_blks(pt, &new_blk_idx, 1), ERR_MSG_DEVICE_WRITE_FAIL);
+
+	if (new_idx)
+		*new_idx = new_blk_idx;
+
+	if (obj)
+	{
+		for (size_t i = 0; i < holes; i++)
+			ERR_NZERO((err = open_object_chain_push(obj, BLK_IDX_HOLE)), err, "Failed to index file hole.\n");
+		ERR_NZERO((err = open_object_chain_push(obj, new_blk_idx)), err, "Failed to index new file block.\n");
+		obj->last_blk = new_blk;
+	}
+
+	return DFS_SUCCESS;
+}
+
+static bool file_size_fits(const dfs_partition *pt, const size_t size)
+{
+	//Files never index more blocks than the partition has, holes included
+	//This bounds both the holes field of block headers and the chain held in memory
+	return size <= (size_t)pt->blk_count * BLOCK_DATA_SIZE;
+}
+
+static dfs_err open_object_append_blks(dfs_partition *pt, open_object *obj, const size_t count, const size_t holes)
+{
+	//Reserves blocks for data about to be written in one go, right after the file's last block when free
+	//The first one is preceded by holes unallocated blocks
+	//Headers are linked with no used space, open_object_extend only counts each block once its data landed
+	//On failure the file is left as it was and the blocks are given back
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(obj, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(obj));
+	ERR_IF(holes >= pt->blk_count, DFS_NVAL_ARGS, "Hole of %zu blocks exceeds the partition's block count.\n", holes);
+
+	dfs_err err;
+	ssize_t readc;
+	size_t found, old_chain_len = obj->chain_len;
+	entry_pointer entry, old_entry;
+	block_header new_blk, old_last = obj->last_blk;
+	blk_idx_t old_last_idx = obj->chain[obj->chain_len - 1];
+
+	blk_idx_t *indices = malloc(count * sizeof(blk_idx_t));
+	ERR_NULL(indices, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+
+	ERR_NZERO_FREE1((err = alloc_blks(pt, old_last_idx + 1, count, indices, &found)), err, indices, "Could not reserve free blocks.\n");
+	ERR_IF_FREE1(!found, DFS_NO_SPACE, indices, "Failed to allocate space for new blocks.\n");
+
+	//Indexed first, readers never look past the size so the chain can simply be cut again
+	err = DFS_SUCCESS;
+	for (size_t i = 0; i < holes && !err; i++)
+		err = open_object_chain_push(obj, BLK_IDX_HOLE);
+	for (size_t i = 0; i < found && !err; i++)
+		err = open_object_chain_push(obj, indices[i]);
+	ERR_NZERO_CLEANUP_FREE1(err, err, open_object_drop_reserved(pt, obj, old_chain_len, indices, found), indices, "Failed to index new file blocks.\n");
+
+	for (size_t i = 0; i < found; i++)
+	{
+		new_blk.prev_blk = i ? indices[i - 1] : old_last_idx;
+		new_blk.next_blk = i + 1 < found ? indices[i + 1] : 0;
+		new_blk.used_space = 0;
+		new_blk.holes = i ? 0 : (uint32_t)holes;
+
+		readc = device_write_at_blk(indices[i], &new_blk, sizeof(block_header), pt);
+		ERR_IF_CLEANUP_FREE1(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, open_object_drop_reserved(pt, obj, old_chain_len, indices, found), indices,
+			ERR_MSG_DEVICE_WRITE_FAIL);
+	}
+
+	//Entry and old last block are only updated once per run
+	readc = device_read_at_entry_loc(obj->entry_loc, &old_entry, pt);
+	ERR_IF_CLEANUP_FREE1(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_READ, open_object_drop_reserved(pt, obj, old_chain_len, indices, found), indices,
+		ERR_MSG_DEVICE_READ_FAIL);
+	entry = old_entry;
+	entry.last_blk = indices[found - 1];
+	readc = device_write_at_entry_loc(obj->entry_loc, &entry, pt);
+	ERR_IF_CLEANUP_FREE1(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_WRITE,
+		device_write_at_entry_loc(obj->entry_loc, &old_entry, pt); open_object_drop_reserved(pt, obj, old_chain_len, indices, found), indices,
+		ERR_MSG_DEVICE_WRITE_FAIL);
+
+	obj->last_blk.next_blk = indices[0];
+	readc = device_write_at_blk(old_last_idx, &obj->last_blk, sizeof(block_header), pt);
+	ERR_IF_CLEANUP_FREE1(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE,
+		obj->last_blk = old_last; device_write_at_blk(old_last_idx, &old_last, sizeof(block_header), pt);
+		device_write_at_entry_loc(obj->entry_loc, &old_entry, pt); open_object_drop_reserved(pt, obj, old_chain_len, indices, found), indices,
+		ERR_MSG_DEVICE_WRITE_FAIL);
+	obj->last_blk = new_blk;
+
+	free(indices);
+	return DFS_SUCCESS;
+}
+
+static void open_object_drop_reserved(dfs_partition *pt, open_object *obj, const size_t chain_len, const blk_idx_t *indices, const size_t count)
+{
+	//Undoes the indexing of blocks reserved by open_object_append_blks, nothing on the device points to them anymore
+	obj->chain_len = chain_len;
+	if (release_blks(pt, indices, count))
+		ERR_MSG("Failed to give back %zu reserved blocks.\n", count);
+}
+
+static void open_object_trim_reserved(dfs_partition *pt, open_object *obj)
+{
+	//Gives back blocks a failed write reserved past the size, they never held any of the file's data
+	size_t needed = obj->size ? (obj->size - 1) / BLOCK_DATA_SIZE + 1 : 1;
+	if (obj->chain_len > needed && open_object_shrink(pt, obj, obj->size))
+		ERR_MSG("Failed to give back blocks reserved by a failed write.\n");
+}
+
+static dfs_err open_object_extend(dfs_partition *pt, open_object *obj, const size_t new_size, const bool zero_fill)
+{
+	//Allocates the block holding the last byte below new_size, blocks skipped on the way are left as holes
+	//Expects the data below new_size to be on the device, headers only count it from here on
+	//zero_fill clears stale data in the grown part of allocated blocks
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(obj, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(obj));
+
+	if (new_size <= obj->size)
+		return DFS_SUCCESS;
+
+	dfs_err err;
+	size_t last_idx = (new_size - 1) / BLOCK_DATA_SIZE;
+	size_t cur_idx = obj->size ? (obj->size - 1) / BLOCK_DATA_SIZE : 0;
+	size_t cur_used = obj->size - cur_idx * BLOCK_DATA_SIZE;
+
+	//Blocks reserved ahead by a write are counted one by one as its data lands
+	for (size_t i = cur_idx; i <= last_idx && i < obj->chain_len; i++)
+	{
+		size_t used = i < last_idx ? BLOCK_DATA_SIZE : new_size - i * BLOCK_DATA_SIZE;
+		size_t old_used = i == cur_idx ? cur_used : 0;
+		if (obj->chain[i] != BLK_IDX_HOLE && used > old_used)
+			ERR_NZERO((err = open_object_grow_blk(pt, obj, i, old_used, used, zero_fill)), err, "Failed to grow file block.\n");
+	}
+
+	if (obj->chain_len <= last_idx)
+	{
+		ERR_NZERO((err = append_blk_to_file(pt, obj->entry_loc, NULL, last_idx - obj->chain_len, obj)), err, "Failed to append block to file.\n");
+		ERR_NZERO((err = open_object_grow_blk(pt, obj, last_idx, 0, new_size - last_idx * BLOCK_DATA_SIZE, zero_fill)), err,
+			"Failed to grow file block.\n");
+	}
+
+	//Blocks reserved ahead by a write may reach past new_size
+	obj->size = new_size;
+	obj->generation++;
+	return DFS_SUCCESS;
+}
+
+static dfs_err open_object_grow_blk(dfs_partition *pt, open_object *obj, const size_t chain_idx, const size_t old_used, const size_t used, const bool zero_fill)
+{
+	//Raises the used space of one allocated block, only the last block's header is cached
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(obj, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(obj));
+
+	dfs_err err;
+	ssize_t readc;
+	blk_idx_t blk_idx = obj->chain[chain_idx];
+
+	if (zero_fill)
+		ERR_NZERO((err = zero_blk_range(pt, blk_idx, old_used, used)), err, "Failed to clear grown file range.\n");
+
+	if (chain_idx == obj->chain_len - 1)
+	{
+		obj->last_blk.used_space = used;
+		readc = device_write_at_blk(blk_idx, &obj->last_blk, sizeof(block_header), pt);
+		ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+	}
+	else
+	{
+		uint32_t used_space = used;
+		readc = device_write_at(blk_idx_to_addr(pt, blk_idx) + offsetof(block_header, used_space), &used_space, sizeof(used_space), pt);
+		ERR_IF(readc != sizeof(used_space), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+	}
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err open_object_shrink(dfs_partition *pt, open_object *obj, const size_t new_size)
+{
+	//Drops the blocks past the one holding the last byte below new_size, the first block is always kept
+	//Only the new last block's header and the entry are rewritten, the dropped tail is released once readers that saw the old size are done
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(obj, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(obj));
 
-	free(pt->usage_map->map);
-	free(pt->usage_map);
-
+	dfs_err err;
+	ssize_t readc;
+	size_t last_idx = new_size ? (new_size - 1) / BLOCK_DATA_SIZE : 0;
+	size_t dropped = obj->chain_len - 1 - last_idx;
+	entry_pointer entry;
+	block_header last_blk;
+
+	if (new_size == obj->size && !dropped)
+		return DFS_SUCCESS;
+
+	//The last block of a file is never a hole
+	if (obj->chain[last_idx] == BLK_IDX_HOLE)
+		ERR_NZERO((err = open_object_fill_hole(pt, obj, last_idx)), err, "Failed to allocate new last block.\n");
+
+	if (!dropped)
+		last_blk = obj->last_blk;
+	else
+	{
+		readc = device_read_at_blk(obj->chain[last_idx], &last_blk, sizeof(block_header), pt);
+		ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+	}
+
+	last_blk.next_blk = 0;
+	last_blk.used_space = new_size - last_idx * BLOCK_DATA_SIZE;
+	readc = device_write_at_blk(obj->chain[last_idx], &last_blk, sizeof(block_header), pt);
+	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+
+	if (dropped)
+	{
+		readc = device_read_at_entry_loc(obj->entry_loc, &entry, pt);
+		ERR_IF(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+		entry.last_blk = obj->chain[last_idx];
+		readc = device_write_at_entry_loc(obj->entry_loc, &entry, pt);
+		ERR_IF(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+	}
+
+	//Readers stop at the new size before dropped blocks can be handed out again
+	obj->size = new_size;
+	obj->last_blk = last_blk;
+	obj->generation++;
+	if (!dropped)
+		return DFS_SUCCESS;
+
+	blk_idx_t *freed = malloc(dropped * sizeof(blk_idx_t));
+	ERR_NULL(freed, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+
+	size_t freed_count = 0;
+	for (size_t i = last_idx + 1; i < obj->chain_len; i++)
+	{
+		if (obj->chain[i] != BLK_IDX_HOLE)
+			freed[freed_count++] = obj->chain[i];
+	}
+	obj->chain_len = last_idx + 1;
+
+	open_object_wait_readers(obj);
+	ERR_NZERO_FREE1((err = release_blks(pt, freed, freed_count)), err, freed, "Failed to release truncated blocks.\n");
+
+	free(freed);
 	return DFS_SUCCESS;
 }
-#pragma endregion
 
+static unsigned open_object_read_begin(open_object *obj)
+{
+	//Readers register before loading size, a shrink that flipped the epoch first is then guaranteed to be visible
+	unsigned epoch = atomic_load(&obj->reader_epoch) & 1;
+	atomic_fetch_add(&obj->readers[epoch], 1);
+	return epoch;
+}
 
-//=====================================
-//= Internal function implementations =
-//=====================================
-#pragma region Device helpers
-inline off_t device_seek(const int whence, const size_t offset, const dfs_partition *partition)
+static void open_object_read_end(open_object *obj, const unsigned epoch)
 {
-	return lseek(partition->device, offset, whence);
+	atomic_fetch_sub(&obj->readers[epoch], 1);
 }
 
-inline ssize_t device_write(void *buffer, const size_t len, const dfs_partition *partition)
+static void open_object_wait_readers(open_object *obj)
 {
-	return write(partition->device, buffer, len);
+	//Called with the lock held after publishing a smaller size, readers of the new epoch already see it and are not waited for
+	unsigned old_epoch = atomic_fetch_add(&obj->reader_epoch, 1) & 1;
+	while (atomic_load(&obj->readers[old_epoch]))
+		sched_yield();
 }
-inline ssize_t device_write_at(const size_t addr, void *buffer, const size_t len, const dfs_partition *partition)
+
+static dfs_err open_object_fill_hole(dfs_partition *pt, open_object *obj, const size_t chain_idx)
 {
-	device_seek(SEEK_SET, addr, partition);
-	return device_write(buffer, len, partition);
+	//Splices a zeroed block between the allocated blocks around a hole, expects obj->lock to be held
+	//The first and last blocks of a file are never holes
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(obj, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(obj));
+
+	dfs_err err;
+	ssize_t readc;
+	blk_idx_t new_blk_idx;
+	block_header new_blk, prev_blk, next_blk;
+	size_t prev_idx = chain_idx - 1, next_idx = chain_idx + 1;
+
+	while (obj->chain[prev_idx] == BLK_IDX_HOLE)
+		prev_idx--;
+	while (obj->chain[next_idx] == BLK_IDX_HOLE)
+		next_idx++;
+
+	ERR_NZERO((err = alloc_blk(pt, &new_blk_idx)), err, "Could not reserve a free block.\n");
+	ERR_NZERO((err = zero_blk_range(pt, new_blk_idx, 0, BLOCK_DATA_SIZE)), err, "Failed to clear filled hole.\n");
+
+	new_blk.prev_blk = obj->chain[prev_idx];
+	new_blk.next_blk = obj->chain[next_idx];
+	new_blk.used_space = BLOCK_DATA_SIZE;
+	new_blk.holes = chain_idx - prev_idx - 1;
+	readc = device_write_at_blk(new_blk_idx, &new_blk, sizeof(block_header), pt);
+	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+
+	//Next block keeps the holes after the new one, open objects cache the last block
+	if (next_idx == obj->chain_len - 1)
+		next_blk = obj->last_blk;
+	else
+	{
+		readc = device_read_at_blk(new_blk.next_blk, &next_blk, sizeof(block_header), pt);
+		ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+	}
+
+	next_blk.prev_blk = new_blk_idx;
+	next_blk.holes = next_idx - chain_idx - 1;
+	readc = device_write_at_blk(new_blk.next_blk, &next_blk, sizeof(block_header), pt);
+	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+	if (next_idx == obj->chain_len - 1)
+		obj->last_blk = next_blk;
+
+	readc = device_read_at_blk(new_blk.prev_blk, &prev_blk, sizeof(block_header), pt);
+	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+	prev_blk.next_blk = new_blk_idx;
+	readc = device_write_at_blk(new_blk.prev_blk, &prev_blk, sizeof(block_header), pt);
+	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+
+	//Lock-free readers see either the hole or the zeroed block
+	obj->chain[chain_idx] = new_blk_idx;
+	return DFS_SUCCESS;
 }
-inline ssize_t device_write_at_blk(const blk_idx_t index, void *buffer, const size_t len, const dfs_partition *partition)
+
+static dfs_err zero_blk_range(const dfs_partition *pt, const blk_idx_t blk_idx, const size_t from, const size_t to)
 {
-	size_t addr = blk_idx_to_addr(partition, index);
-	device_seek(SEEK_SET, addr, partition);
-	return device_write(buffer, len, partition);
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	if (from >= to)
+		return DFS_SUCCESS;
+
+	ssize_t readc = device_write_at(blk_off_to_addr(pt, blk_idx, from), zero_data, to - from, pt);
+	ERR_IF(readc < 0 || (size_t)readc != to - from, DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+
+	return DFS_SUCCESS;
 }
-inline ssize_t device_write_at_entry_loc(const entry_ptr_loc entry_loc, entry_pointer *buffer, const dfs_partition *partition)
+
+static dfs_err object_write_at(dfs_partition *pt, open_object *obj, const size_t offset, const void *buffer, const size_t len, size_t *written)
 {
-	size_t addr = entry_loc_to_addr(partition, entry_loc);
-	device_seek(SEEK_SET, addr, partition);
-	return device_write(buffer, sizeof(entry_pointer), partition);
+	struct iovec iov = { .iov_base = (void*)buffer, .iov_len = len };
+	return object_writev_at(pt, obj, offset, &iov, 1, written);
 }
 
-inline ssize_t device_read(void *buffer, const size_t len, const dfs_partition *partition)
+static dfs_err object_read_at(dfs_partition *pt, open_object *obj, const size_t offset, void *buffer, const size_t len, size_t *read)
 {
-	return read(partition->device, buffer, len);
+	struct iovec iov = { .iov_base = buffer, .iov_len = len };
+	return object_readv_at(pt, obj, offset, &iov, 1, read);
 }
-inline ssize_t device_read_at(const size_t addr, void *buffer, const size_t len, const dfs_partition *partition)
+
+static dfs_err object_writev_at(dfs_partition *pt, open_object *obj, const size_t offset, const struct iovec *iov, const int iovcnt, size_t *written)
+{
+	//Expects obj->lock to be held, writing past the end grows the file
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(obj, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(obj));
+
+	dfs_err err;
+	ssize_t readc;
+	struct iovec segs[DEVICE_IOV_MAX];
+	size_t pos = offset, seg_len, iov_off = 0;
+	int seg_count, iov_idx = 0;
+	*written = 0;
+
+	size_t end = pos;
+	bool overflow = false;
+	for (int i = 0; i < iovcnt; i++)
+	{
+		overflow |= iov[i].iov_len > SIZE_MAX - end;
+		end += iov[i].iov_len;
+	}
+	ERR_IF(overflow || !file_size_fits(pt, end), DFS_NVAL_ARGS, "Write at offset %zu reaches past what the partition can address.\n", offset);
+
+	if (pos > obj->size)
+		ERR_NZERO((err = open_object_extend(pt, obj, pos, true)), err, "Failed to grow file up to write offset.\n");
+
+	//Blocks appended by the write are reserved together so they can be placed side by side
+	if (end > obj->chain_len * BLOCK_DATA_SIZE)
+		ERR_NZERO((err = open_object_append_blks(pt, obj, (end - 1) / BLOCK_DATA_SIZE + 1 - obj->chain_len, 0)), err, "Failed to reserve blocks for write.\n");
+
+	//One device call per block, however many buffers it spans
+	//Reserved blocks the data never reached are given back on failure
+	while ((seg_count = iov_gather(iov, iovcnt, &iov_idx, &iov_off, BLOCK_DATA_SIZE - pos % BLOCK_DATA_SIZE, segs, &seg_len)))
+	{
+		//Only reached past the reserved blocks when the partition ran short of them
+		size_t chain_idx = pos / BLOCK_DATA_SIZE;
+		if (chain_idx >= obj->chain_len)
+			ERR_NZERO_CLEANUP((err = append_blk_to_file(pt, obj->entry_loc, NULL, chain_idx - obj->chain_len, obj)), err, open_object_trim_reserved(pt, obj),
+				"Failed to append block to file.\n");
+		else if (obj->chain[chain_idx] == BLK_IDX_HOLE)
+			ERR_NZERO_CLEANUP((err = open_object_fill_hole(pt, obj, chain_idx)), err, open_object_trim_reserved(pt, obj),
+				"Failed to allocate block for file hole.\n");
+
+		size_t addr = blk_off_to_addr(pt, obj->chain[pos / BLOCK_DATA_SIZE], pos % BLOCK_DATA_SIZE);
+		readc = device_writev_at(addr, segs, seg_count, pt);
+		obj->generation++;
+		ERR_IF_CLEANUP(readc < 0 || (size_t)readc != seg_len, DFS_FAILED_DEVICE_WRITE, open_object_trim_reserved(pt, obj), ERR_MSG_DEVICE_WRITE_FAIL);
+
+		pos += seg_len;
+		*written += seg_len;
+
+		//Data is on the device before the new size is published to readers
+		if (pos > obj->size)
+			ERR_NZERO_CLEANUP((err = open_object_extend(pt, obj, pos, false)), err, open_object_trim_reserved(pt, obj),
+				"Failed to grow file during write.\n");
+	}
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err object_readv_at(dfs_partition *pt, open_object *obj, const size_t offset, const struct iovec *iov, const int iovcnt, size_t *read)
 {
-	device_seek(SEEK_SET, addr, partition);
-	return device_read(buffer, len, partition);
+	//No lock, size is published after the blocks below it are indexed and written
+	//Shrinks keep the blocks past the new size until the read is done
+	ERR_NULL(obj, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(obj));
+
+	unsigned epoch = open_object_read_begin(obj);
+	dfs_err err = object_readv_blks(pt, obj, offset, iov, iovcnt, read);
+	open_object_read_end(obj, epoch);
+	return err;
 }
-inline ssize_t device_read_at_blk(const blk_idx_t index, void *buffer, const size_t len, const dfs_partition *partition)
+
+static dfs_err object_readv_blks(dfs_partition *pt, open_object *obj, const size_t offset, const struct iovec *iov, const int iovcnt, size_t *read)
 {
-	size_t addr = blk_idx_to_addr(partition, index);
-	device_seek(SEEK_SET, addr, partition);
-	return device_read(buffer, len, partition);
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(obj, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(obj));
+
+	size_t size = obj->size;
+	ssize_t readc;
+	struct iovec segs[DEVICE_IOV_MAX];
+	size_t pos = offset, seg_len, iov_off = 0;
+	int seg_count, iov_idx = 0;
+	*read = 0;
+
+	while (pos < size)
+	{
+		size_t blk_left = MIN(BLOCK_DATA_SIZE - pos % BLOCK_DATA_SIZE, size - pos);
+		if (!(seg_count = iov_gather(iov, iovcnt, &iov_idx, &iov_off, blk_left, segs, &seg_len)))
+			break;
+
+		blk_idx_t blk_idx = obj->chain[pos / BLOCK_DATA_SIZE];
+		if (blk_idx == BLK_IDX_HOLE)
+		{
+			for (int i = 0; i < seg_count; i++)
+				memset(segs[i].iov_base, 0, segs[i].iov_len);
+		}
+		else
+		{
+			size_t addr = blk_off_to_addr(pt, blk_idx, pos % BLOCK_DATA_SIZE);
+			readc = device_readv_at(addr, segs, seg_count, pt);
+			ERR_IF(readc < 0 || (size_t)readc != seg_len, DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+		}
+
+		pos += seg_len;
+		*read += seg_len;
+	}
+
+	return DFS_SUCCESS;
 }
-inline ssize_t device_read_at_entry_loc(const entry_ptr_loc entry_loc, void *buffer, const dfs_partition *partition)
+
+static dfs_err object_send_at(dfs_partition *pt, open_object *obj, const size_t offset, const int out_fd, const size_t len, size_t *sent)
+{
+	//No lock, registered as a reader like object_readv_at
+	ERR_NULL(obj, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(obj));
+
+	unsigned epoch = open_object_read_begin(obj);
+	dfs_err err = object_send_blks(pt, obj, offset, out_fd, len, sent);
+	open_object_read_end(obj, epoch);
+	return err;
+}
+
+static dfs_err object_send_blks(dfs_partition *pt, open_object *obj, const size_t offset, const int out_fd, const size_t len, size_t *sent)
+{
+	//One sendfile call per block since headers split the data of adjacent blocks
+	//The bounce buffer is only allocated for holes or once sendfile turned out not to support out_fd
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(obj, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(obj));
+	ERR_NULL(sent, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(sent));
+
+	dfs_err err = DFS_SUCCESS;
+	ssize_t readc;
+	char *bounce = NULL;
+	bool use_sendfile = true;
+	size_t size = obj->size;
+	size_t pos = offset;
+	size_t end = offset < size ? offset + MIN(len, size - offset) : offset;
+	*sent = 0;
+
+	while (pos < end)
+	{
+		size_t seg_len = MIN(BLOCK_DATA_SIZE - pos % BLOCK_DATA_SIZE, end - pos);
+		blk_idx_t blk_idx = obj->chain[pos / BLOCK_DATA_SIZE];
+		size_t addr = blk_off_to_addr(pt, blk_idx, pos % BLOCK_DATA_SIZE);
+		size_t seg_sent = 0;
+		bool sent_direct = false;
+
+		//Bytes a failing descriptor took before the error still count as sent
+		if (blk_idx != BLK_IDX_HOLE && use_sendfile)
+		{
+			err = fd_send_device(pt, addr, out_fd, seg_len, &use_sendfile, &seg_sent);
+			*sent += seg_sent;
+			ERR_NZERO_FREE1(err, err, bounce, "Failed to send block %u.\n", blk_idx);
+			sent_direct = use_sendfile;
+		}
+
+		if (!sent_direct)
+		{
+			if (!bounce)
+			{
+				bounce = malloc(BLOCK_DATA_SIZE);
+				ERR_NULL(bounce, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+			}
+
+			if (blk_idx == BLK_IDX_HOLE)
+				memset(bounce, 0, seg_len);
+			else
+			{
+				readc = device_read_at(addr, bounce, seg_len, pt);
+				ERR_IF_FREE1(readc < 0 || (size_t)readc != seg_len, DFS_FAILED_DEVICE_READ, bounce, ERR_MSG_DEVICE_READ_FAIL);
+			}
+
+			err = fd_write_all(out_fd, bounce, seg_len, &seg_sent);
+			*sent += seg_sent;
+			ERR_NZERO_FREE1(err, err, bounce, "Failed to write file data to descriptor %d.\n", out_fd);
+		}
+
+		pos += seg_len;
+	}
+
+	free(bounce);
+	return DFS_SUCCESS;
+}
+
+static dfs_err fd_send_device(const dfs_partition *pt, const size_t addr, const int out_fd, const size_t len, bool *supported, size_t *sent)
+{
+	//Moves device data to out_fd inside the kernel, supported is cleared when sendfile refuses out_fd before sending anything
+	//sent counts what out_fd took, also when a later call fails
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(supported, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(supported));
+	ERR_NULL(sent, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(sent));
+
+	off_t device_off = (off_t)addr;
+	size_t left = len;
+	*sent = 0;
+
+	while (left)
+	{
+		ssize_t sentc = sendfile(out_fd, pt->device, &device_off, left);
+		if (sentc < 0 && errno == EINTR)
+			continue;
+
+		if (sentc < 0 && (errno == EINVAL || errno == ENOSYS) && left == len)
+		{
+			*supported = false;
+			return DFS_SUCCESS;
+		}
+
+		ERR_IF(sentc <= 0, DFS_FAILED_FD_WRITE, "Could not send data to descriptor %d.\n", out_fd);
+		left -= (size_t)sentc;
+		*sent += (size_t)sentc;
+	}
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err fd_write_all(const int out_fd, char *buffer, const size_t len, size_t *written)
+{
+	//Pipes and sockets may take less than asked for, written counts what was taken also when a later call fails
+	ERR_NULL(written, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(written));
+
+	size_t left = len;
+	*written = 0;
+
+	while (left)
+	{
+		ssize_t writec = write(out_fd, &buffer[len - left], left);
+		if (writec < 0 && errno == EINTR)
+			continue;
+
+		ERR_IF(writec <= 0, DFS_FAILED_FD_WRITE, "Could not write data to descriptor %d.\n", out_fd);
+		left -= (size_t)writec;
+		*written += (size_t)writec;
+	}
+
+	return DFS_SUCCESS;
+}
+
+static int iov_gather(const struct iovec *iov, const int iovcnt, int *iov_idx, size_t *iov_off, const size_t max_len, struct iovec *segs, size_t *seg_len)
+{
+	//Takes up to max_len bytes from iov starting at the cursor (iov_idx, iov_off) and advances it
+	int seg_count = 0;
+	*seg_len = 0;
+
+	while (*iov_idx < iovcnt && seg_count < DEVICE_IOV_MAX && *seg_len < max_len)
+	{
+		size_t avail = iov[*iov_idx].iov_len - *iov_off;
+		if (avail == 0)
+		{
+			(*iov_idx)++;
+			*iov_off = 0;
+			continue;
+		}
+
+		size_t take = MIN(avail, max_len - *seg_len);
+		segs[seg_count].iov_base = (char*)iov[*iov_idx].iov_base + *iov_off;
+		segs[seg_count].iov_len = take;
+		seg_count++;
+
+		*seg_len += take;
+		*iov_off += take;
+	}
+
+	return seg_count;
+}
+
+static dfs_err append_entries_to_dir(const dfs_partition *pt, const entry_ptr_loc dir_entryLoc, blk_idx_t last_blk_idx, block_header last_blk, const entry_pointer *new_entries, size_t count, entry_ptr_loc *new_locs, size_t *appended)
 {
-	size_t addr = entry_loc_to_addr(partition, entry_loc);
-	device_seek(SEEK_SET, addr, partition);
-	return device_read(buffer, sizeof(entry_pointer), partition);
+	//Expects last_blk_idx and last_blk to be the directory's current last block, as found by find_entry_in_dir
+	//appended counts the entries made visible in the directory, also when a later write fails
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_IF(!new_entries && count, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(new_entries));
+
+	blk_idx_t blk_idx = last_blk_idx;
+	block_header dir_blk = last_blk;
+	size_t done = 0;
+	dfs_err err;
+	ssize_t readc;
+
+	if (appended)
+		*appended = 0;
+
+	while (done < count)
+	{
+		size_t free_entries = ENTRIES_PER_BLK - dir_blk.used_space / sizeof(entry_pointer);
+
+		if (!free_entries) //No free space
+		{
+			blk_idx_t prev_blk_idx = blk_idx;
+
+			//Append block and update block index
+			ERR_NZERO((err = append_blk_to_file(pt, dir_entryLoc, &blk_idx, 0, NULL)), err, "Failed to append block to file.\n");
+
+			//New block starts empty
+			dir_blk.prev_blk = prev_blk_idx;
+			dir_blk.next_blk = 0;
+			dir_blk.used_space = 0;
+			dir_blk.holes = 0;
+			continue;
+		}
+
+		//Write as many entries as fit in the block at once
+		size_t to_write = MIN(free_entries, count - done);
+		size_t write_len = to_write * sizeof(entry_pointer);
+		size_t addr = blk_off_to_addr(pt, blk_idx, dir_blk.used_space);
+		readc = device_write_at(addr, (void*)&new_entries[done], write_len, pt);
+		ERR_IF((size_t)readc != write_len, DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+
+		if (new_locs)
+		{
+			for (size_t i = 0; i < to_write; i++)
+			{
+				new_locs[done + i].blk_idx = blk_idx;
+				new_locs[done + i].entry_idx = dir_blk.used_space / sizeof(entry_pointer) + i;
+			}
+		}
+
+		//Update block header
+		bool was_empty = dir_blk.used_space == 0;
+		dir_blk.used_space += (uint32_t)write_len;
+
+		//Flush header changes
+		readc = device_write_at_blk(blk_idx, &dir_blk, sizeof(block_header), pt);
+		ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+
+		done += to_write;
+		if (appended)
+			*appended = done;
+
+		//Keep filter in sync (new blocks start with one holding just these entries)
+		dir_filter *filter = get_dir_filter(pt, blk_idx);
+		if (filter)
+		{
+			for (size_t i = done - to_write; i < done; i++)
+				dir_filter_add(filter, new_entries[i].name_hash ? new_entries[i].name_hash : entry_name_hash(new_entries[i].name));
+		}
+		else if (was_empty)
+			ERR_NZERO((err = build_dir_filter(pt, blk_idx, &new_entries[done - to_write], to_write, NULL)), err, "Failed to build directory filter.\n");
+	}
+
+	return DFS_SUCCESS;
 }
+#pragma endregion
+#pragma region File manipulation
+static dfs_err create_object(dfs_partition *pt, const dfs_dir *base, const char *path, const uint16_t flags, entry_ptr_loc *new_loc)
+{ //REVIEW: Maybe break down into smaller functions
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(base, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(base));
+	ERR_NULL(path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(path));
+	
+	char parent_dir[MAX_PATH + 1];
+	char name[MAX_PATH + 1];
+
+	dfs_err err;
+	entry_pointer new_entry = { 0 }, parent;
+	entry_ptr_loc parent_loc;
+	block_header new_blk, dir_last_blk;
+	blk_idx_t new_blk_idx, dir_last_blk_idx, removed_blk;
+	ssize_t readc;
+
+	ERR_IF(dfs_path_is_empty(path), DFS_NVAL_PATH, "Cannot create root object. (The provided path was empty)\n");
+
+	dfs_path_get_parent(parent_dir, path);
+	dfs_path_get_name(name, path);
+
+	//Find parent dir, only path resolution needed
+	ERR_NZERO((err = find_entry_ptr(pt, base, parent_dir, &parent, &parent_loc)), err, "Could not find parent directory.\n");
+	ERR_IF(!(parent.flags & ENTRY_FLAG_DIR), DFS_NVAL_PATH, "Cannot create object inside a file.\n");
+
+	//Check for the name and find the parent's last block in the same scan
+	err = find_entry_in_dir(pt, parent.first_blk, name, NULL, NULL, &dir_last_blk_idx, &dir_last_blk, &removed_blk);
+	ERR_IF(err == DFS_SUCCESS, DFS_ALREADY_EXISTS, ERR_MSG_ALREADY_EXISTS(path));
+	ERR_IF(err != DFS_PATH_NOT_FOUND, err, "Could not search parent directory.\n");
+
+	//Find and reserve free block
+	ERR_NZERO((err = alloc_blk(pt, &new_blk_idx)), err, "Could not reserve a free block.\n");
+
+	//Set new block header
+	new_blk.next_blk = 0;
+	new_blk.prev_blk = 0;
+	new_blk.used_space = 0;
+	new_blk.holes = 0;
+
+	//Flush header before the entry points to it
+	readc = device_write_at_blk(new_blk_idx, &new_blk, sizeof(block_header), pt);
+	ERR_IF_CLEANUP(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, release_blks(pt, &new_blk_idx, 1), ERR_MSG_DEVICE_WRITE_FAIL);
+
+	//Create new entry
+	entry_copy_name(new_entry.name, name);
+	new_entry.first_blk = new_blk_idx;
+	new_entry.last_blk = new_blk_idx;
+	new_entry.name_hash = entry_name_hash(name);
+	new_entry.flags = flags;
+
+	//Fill a removed entry's slot or append to parent, the block is only kept once an entry points to it
+	size_t appended;
+	if (removed_blk)
+	{
+		err = reuse_removed_entry(pt, removed_blk, &new_entry, new_loc);
+		appended = !err;
+	}
+	else
+		err = append_entries_to_dir(pt, parent_loc, dir_last_blk_idx, dir_last_blk, &new_entry, 1, new_loc, &appended);
+	if (err && !appended)
+		release_blks(pt, &new_blk_idx, 1);
+	ERR_NZERO(err, err, "Could not add entry to directory.\n");
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err create_many_in_dir(dfs_partition *pt, create_request *requests, size_t count, const uint16_t flags, blk_idx_t *free_blks, size_t *free_used, size_t free_count, dfs_err *results)
+{
+	//Expects all requests to share the same parent directory
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(requests, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(requests));
+
+	char parent_dir[MAX_PATH + 1];
+	entry_pointer parent;
+	entry_ptr_loc parent_loc;
+	block_header new_blk = { 0 }, dir_last_blk;
+	blk_idx_t dir_last_blk_idx;
+	dfs_err err;
+	ssize_t readc;
+
+	memcpy(parent_dir, requests[0].path, requests[0].parent_len);
+	parent_dir[requests[0].parent_len] = '\0';
+
+	//Missing parents only fail their own objects
+	err = find_entry_ptr(pt, &pt->root_dir, parent_dir, &parent, &parent_loc);
+	if (!err && !(parent.flags & ENTRY_FLAG_DIR))
+		err = DFS_NVAL_PATH;
+
+	if (err)
+	{
+		for (size_t i = 0; i < count; i++)
+			results[requests[i].idx] = err;
+		return DFS_SUCCESS;
+	}
+
+	//Sort by name so duplicates are adjacent and existing entries can be matched by hash
+	qsort(requests, count, sizeof(create_request), compare_requests_by_name);
+
+	for (size_t i = 1; i < count; i++)
+	{
+		if (requests[i].hash == requests[i - 1].hash && !strncmp(requests[i].name, requests[i - 1].name, MAX_PATH_NAME))
+			results[requests[i].idx] = DFS_ALREADY_EXISTS;
+	}
+
+	err = mark_existing_names(pt, parent.first_blk, requests, count, results, &dir_last_blk_idx, &dir_last_blk);
+	ERR_NZERO(err, err, "Could not search parent directory.\n");
+
+	entry_pointer *new_entries = malloc(count * sizeof(entry_pointer));
+	ERR_NULL(new_entries, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+	size_t new_count = 0, appended = 0;
+
+	//Blocks are taken from free_blks in order, giving back the ones no entry points to lets the caller release them
+	size_t first_used = *free_used;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (results[requests[i].idx] != DFS_SUCCESS)
+			continue;
 
-static dfs_err force_allocate_space(const char *device, size_t size)
-{
-	ERR_NULL(device, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(device));
-	ERR_IF(size == 0, DFS_NVAL_ARGS, "Argument 'size' must not be 0.\n");
-	
-	char zero = 0;
-	int file = open(device, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
-	ERR_IF(file == -1, DFS_FAILED_DEVICE_OPEN, ERR_MSG_DEVICE_OPEN_FAIL);
-	
-	lseek(file, size - 1, SEEK_SET);
-	ssize_t writtec = write(file, &zero, 1);
-	ERR_IF(writtec != 1, DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
-	close(file);
+		if (*free_used >= free_count)
+		{
+			results[requests[i].idx] = DFS_NO_SPACE;
+			continue;
+		}
 
-	return DFS_SUCCESS;
-}
-#pragma endregion
-#pragma region Block-Address abstraction
-static size_t blk_idx_to_addr(const dfs_partition *partition, const blk_idx_t index)
-{
-	return partition->root_blk_addr + (size_t)index * BLOCK_SIZE;
-}
+		blk_idx_t new_blk_idx = free_blks[(*free_used)++];
 
-static size_t blk_off_to_addr(const dfs_partition *partition, const blk_idx_t index, const size_t offset)
-{
-	return blk_idx_to_addr(partition, index) + sizeof(block_header) + offset;
-}
+		//Flush header before the entry points to it
+		readc = device_write_at_blk(new_blk_idx, &new_blk, sizeof(block_header), pt);
+		ERR_IF_CLEANUP_FREE1(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, *free_used = first_used, new_entries, ERR_MSG_DEVICE_WRITE_FAIL);
 
-static size_t entry_loc_to_addr(const dfs_partition *partition, const entry_ptr_loc entry_loc)
-{
-	if (entry_loc.blk_idx == ~0u && entry_loc.entry_idx == ~0u)
-		return sizeof(partition_header);
+		entry_pointer *new_entry = &new_entries[new_count++];
+		memset(new_entry, 0, sizeof(entry_pointer));
+		memcpy(new_entry->name, requests[i].name, MAX_PATH_NAME);
+		new_entry->first_blk = new_blk_idx;
+		new_entry->last_blk = new_blk_idx;
+		new_entry->name_hash = requests[i].hash;
+		new_entry->flags = flags;
+	}
 
-	size_t base_address = blk_idx_to_addr(partition, entry_loc.blk_idx);
-	size_t offset = sizeof(block_header) + sizeof(entry_pointer) * entry_loc.entry_idx;
+	err = append_entries_to_dir(pt, parent_loc, dir_last_blk_idx, dir_last_blk, new_entries, new_count, NULL, &appended);
+	free(new_entries);
+	ERR_NZERO_CLEANUP(err, err, *free_used = first_used + appended, "Could not append entries to directory.\n");
 
-	return base_address + offset;
+	return DFS_SUCCESS;
 }
 
-static entry_ptr_loc get_root_loc()
+static dfs_err mark_existing_names(const dfs_partition *pt, const blk_idx_t first_blk, create_request *requests, size_t count, dfs_err *results, blk_idx_t *last_blk_idx, block_header *last_blk)
 {
-	entry_ptr_loc loc = { .blk_idx = ~0u, .entry_idx = ~0u };
-	return loc;
-}
-#pragma endregion
-#pragma region Code naming
-static size_t determine_first_blk_addr(uint32_t blk_count)
-{
-	size_t without_pad = (size_t)(blk_count >> 3) + sizeof(partition_header) + sizeof(entry_pointer);
-	size_t rem = without_pad & (SECTOR_SIZE - 1);
-	return without_pad + (rem ? SECTOR_SIZE - rem : 0);
-}
+	//Expects requests to be sorted with compare_requests_by_name
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
 
-static size_t determine_size_from_blk_count(size_t blk_count)
-{
-	size_t dts = determine_first_blk_addr(blk_count);
-	return dts + blk_count * BLOCK_SIZE;
-}
+	block_header cur_header;
+	blk_idx_t cur_blk = first_blk;
+	dfs_err err;
+	ssize_t readc;
 
-static size_t determine_blk_count(size_t maxSize, size_t *partition_size)
-{
-	size_t max = MAX_BLKS, min = 0;
-	size_t current = 0, total_size = 0;
-	int iter_count = 0; //Iteration limiter, should not be needed
-	
-	while (iter_count < 64)
+	entry_pointer *entries = malloc(ENTRIES_PER_BLK * sizeof(entry_pointer));
+	ERR_NULL(entries, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+
+	while (true)
 	{
-		iter_count++;
+		readc = device_read_at_blk(cur_blk, &cur_header, sizeof(block_header), pt);
+		ERR_IF_FREE1(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, entries, ERR_MSG_DEVICE_READ_FAIL);
 
-		current = (min + max) >> 1;
-		total_size = determine_size_from_blk_count(current);
+		size_t valid_entry_count = cur_header.used_space / sizeof(entry_pointer);
+		size_t entries_len = valid_entry_count * sizeof(entry_pointer);
+		readc = device_read_at(blk_off_to_addr(pt, cur_blk, 0), entries, entries_len, pt);
+		ERR_IF_FREE1((size_t)readc != entries_len, DFS_FAILED_DEVICE_READ, entries, ERR_MSG_DEVICE_READ_FAIL);
 
-		if (total_size < maxSize)
-			min = current;
-		else if (total_size > maxSize)
-			max = current;
-		else
-			goto return_value;
+		if (valid_entry_count && !get_dir_filter(pt, cur_blk))
+		{
+			err = build_dir_filter(pt, cur_blk, entries, valid_entry_count, NULL);
+			ERR_NZERO_FREE1(err, err, entries, "Failed to build directory filter.\n");
+		}
 
-		if (max - min <= 1)
+		for (size_t i = 0; i < valid_entry_count; i++)
 		{
-			current = min;
-			goto return_value;
+			if (entry_is_removed(entries[i]))
+				continue;
+
+			uint16_t hash = entries[i].name_hash ? entries[i].name_hash : entry_name_hash(entries[i].name);
+
+			//Binary search the first request with this hash
+			size_t low = 0, high = count;
+			while (low < high)
+			{
+				size_t mid = (low + high) >> 1;
+				if (requests[mid].hash < hash) low = mid + 1;
+				else high = mid;
+			}
+
+			for (size_t j = low; j < count && requests[j].hash == hash; j++)
+			{
+				if (!strncmp(requests[j].name, entries[i].name, MAX_PATH_NAME))
+					results[requests[j].idx] = DFS_ALREADY_EXISTS;
+			}
 		}
+
+		if (!cur_header.next_blk)
+			break;
+
+		cur_blk = cur_header.next_blk;
 	}
 
-	return 0;
+	free(entries);
 
-return_value:
-	if (partition_size)
-		*partition_size = determine_size_from_blk_count(current);
+	*last_blk_idx = cur_blk;
+	*last_blk = cur_header;
 
-	return current;
+	return DFS_SUCCESS;
 }
 
-static dfs_err init_empty_partition(const char *device, size_t blk_count)
+static dfs_err remove_object(dfs_partition *pt, const dfs_dir *base, const char *path, const bool dir)
 {
-	ERR_NULL(device, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(device));
-	ERR_IF(blk_count == 0, DFS_NVAL_ARGS, "Argument 'blk_count' must not be 0.\n");
+	//Expects meta_lock to be held for writing, only the entry is removed before returning
+	//The object's blocks are handed to the reclaimer
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(base, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(base));
+	ERR_NULL(path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(path));
+	ERR_IF(dfs_path_is_empty(path), DFS_NVAL_PATH, ERR_MSG_EMPTY_PATH("remove"));
 
-	int file = open(device, O_RDWR | O_SYNC);
+	dfs_err err;
+	entry_pointer entry;
+	entry_ptr_loc entry_loc;
+	ERR_NZERO((err = find_entry_ptr(pt, base, path, &entry, &entry_loc)), err, "Could not find entry for '%s'.\n", path);
+	ERR_IF(dir && !(entry.flags & ENTRY_FLAG_DIR), DFS_NVAL_PATH, "Can only remove directories (a file was provided).\n");
+	ERR_IF(!dir && (entry.flags & ENTRY_FLAG_DIR), DFS_NVAL_PATH, "Can only remove files (a directory was provided).\n");
+	ERR_IF(!object_is_writable(entry), DFS_UNAUTHORIZED_ACCESS, ERR_MSG_UNAUTHORIZED_ACCESS("remove", path));
 
-	ERR_IF(file == -1, DFS_NVAL_ARGS, ERR_MSG_DEVICE_OPEN_FAIL);
+	if (dir)
+	{
+		bool empty;
+		ERR_NZERO((err = dir_is_empty(pt, entry.first_blk, &empty)), err, "Failed to check contents of directory '%s'.\n", path);
+		ERR_IF(!empty, DFS_DIR_NOT_EMPTY, "Cannot remove non-empty directory '%s'.\n", path);
+	}
 
-	//Write header
-	partition_header header = { .magic_number = MAGIC_NUMBER,
-		.block_count = blk_count, .resvd = 0 };
-	size_t written = write(file, &header, sizeof(partition_header));
-	ERR_IF_CLEANUP(written != sizeof(partition_header),
-		DFS_FAILED_DEVICE_WRITE, close(file), ERR_MSG_DEVICE_WRITE_FAIL);
+	//Open handles still use the chain, refuse instead of pulling it from under them
+	pthread_mutex_lock(&pt->handle_lock);
+	bool open = dir ? dir_handle_open(pt, entry_loc) : get_open_object(pt, entry_loc) != NULL;
+	ERR_IF_CLEANUP(open, DFS_UNAUTHORIZED_ACCESS, pthread_mutex_unlock(&pt->handle_lock), "Cannot remove '%s' while it is open.\n", path);
 
-	//Set and write root entry_pointer
-	entry_pointer root_pointer = { .first_blk = 0, .last_blk = 0, .flags = ENTRY_FLAG_DIR, .resvd = 0, .name = {0} };
-	memcpy(root_pointer.name, "FSRoot!PlsNoTouchy:)", MAX_PATH_NAME); //HACK: Length may differ if string changes
-	written = write(file, &root_pointer, sizeof(entry_pointer));
-	ERR_IF_CLEANUP(written != sizeof(entry_pointer),
-		DFS_FAILED_DEVICE_WRITE, close(file), ERR_MSG_DEVICE_WRITE_FAIL);
+	err = remove_entry(pt, entry_loc);
+	pthread_mutex_unlock(&pt->handle_lock);
+	ERR_NZERO(err, err, "Failed to remove entry of '%s'.\n", path);
 
-	//Clear block map
-	char zeros[SECTOR_SIZE] = { 0 };
-	size_t blocks_left = blk_count;
-	size_t first_sector_bytes = SECTOR_SIZE - sizeof(partition_header) - sizeof(entry_pointer);
-	written = write(file, zeros, first_sector_bytes);
-	ERR_IF_CLEANUP(written != first_sector_bytes,
-		DFS_FAILED_DEVICE_WRITE, close(file), ERR_MSG_DEVICE_WRITE_FAIL);
-	blocks_left -= MIN(first_sector_bytes << 3, blocks_left);
+	ERR_NZERO((err = reclaimer_queue(pt, entry.first_blk)), err, "Failed to queue blocks of '%s' for release.\n", path);
+	return DFS_SUCCESS;
+}
 
-	while (blocks_left > 0)
-	{
-		written = write(file, zeros, SECTOR_SIZE);
-		ERR_IF_CLEANUP(written != SECTOR_SIZE,
-			DFS_FAILED_DEVICE_WRITE, close(file), ERR_MSG_DEVICE_WRITE_FAIL);
-			
-		blocks_left -= MIN(SECTOR_SIZE * 8, blocks_left); //Bits per sector
-	}
+static dfs_err remove_entry(dfs_partition *pt, const entry_ptr_loc entry_loc)
+{
+	//Marks the slot removed instead of moving entries, ids of the other entries stay valid
+	//The slot's generation is bumped so ids of the removed object never match whatever takes the slot next
+	//Expects meta_lock to be held for writing
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
 
-	//Set root to used
-	char root_used = 1;
-	lseek(file, sizeof(partition_header) + sizeof(entry_pointer), SEEK_SET);
-	written = write(file, &root_used, 1);
-	ERR_IF_CLEANUP(written != 1,
-		DFS_FAILED_DEVICE_WRITE, close(file), ERR_MSG_DEVICE_WRITE_FAIL);
+	ssize_t readc;
+	block_header header;
+	entry_pointer entry;
+	readc = device_read_at_blk(entry_loc.blk_idx, &header, sizeof(block_header), pt);
+	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+	readc = device_read_at_entry_loc(entry_loc, &entry, pt);
+	ERR_IF(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
 
-	//Init root block header
-	block_header root_header = { 0 };
-	lseek(file, determine_first_blk_addr(blk_count), SEEK_SET);
-	written = write(file, &root_header, sizeof(block_header));
-	ERR_IF_CLEANUP(written != sizeof(block_header),
-		DFS_FAILED_DEVICE_WRITE, close(file), ERR_MSG_DEVICE_WRITE_FAIL);
+	entry_pointer removed = { 0 };
+	removed.flags = ENTRY_FLAG_REMOVED | ((entry.flags + (1 << ENTRY_GEN_SHIFT)) & ENTRY_GEN_MASK);
+	readc = device_write_at_entry_loc(entry_loc, &removed, pt);
+	ERR_IF(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
 
-	close(file);
+	//Counted after the slot is marked, a missed count only keeps the slot from being reused
+	header.holes++;
+	readc = device_write_at_blk(entry_loc.blk_idx, &header, sizeof(block_header), pt);
+	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
 
 	return DFS_SUCCESS;
 }
 
-static dfs_err validate_partition_header(const dfs_partition* pt)
+static dfs_err reuse_removed_entry(const dfs_partition *pt, const blk_idx_t blk_idx, entry_pointer *entry, entry_ptr_loc *new_loc)
 {
+	//Writes entry into the first removed slot of a directory block, it takes over the slot's generation
+	//Expects meta_lock to be held for writing
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(entry, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(entry));
+	ERR_NULL(new_loc, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(new_loc));
 
-	partition_header buff;
 	ssize_t readc;
+	block_header header;
+	readc = device_read_at_blk(blk_idx, &header, sizeof(block_header), pt);
+	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+	ERR_IF(!header.holes, DFS_NVAL_ARGS, "Directory block %u holds no removed entries.\n", blk_idx);
 
-	readc = read(pt->device, &buff, sizeof(partition_header));
-	ERR_IF(readc != sizeof(partition_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+	entry_pointer *entries = malloc(ENTRIES_PER_BLK * sizeof(entry_pointer));
+	ERR_NULL(entries, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
 
-	//Check magic number
-	ERR_IF(buff.magic_number != MAGIC_NUMBER, DFS_CORRUPTED_PARTITION, "Partition has incorrect magic number.\n");
+	size_t entry_count = header.used_space / sizeof(entry_pointer);
+	size_t entries_len = entry_count * sizeof(entry_pointer);
+	readc = device_read_at(blk_off_to_addr(pt, blk_idx, 0), entries, entries_len, pt);
+	ERR_IF_FREE1((size_t)readc != entries_len, DFS_FAILED_DEVICE_READ, entries, ERR_MSG_DEVICE_READ_FAIL);
 
-	//Check reserved
-	ERR_IF(buff.resvd != 0, DFS_CORRUPTED_PARTITION, "Partition has reserved flags set.\n");
+	size_t slot = 0;
+	while (slot < entry_count && !entry_is_removed(entries[slot]))
+		slot++;
+	ERR_IF_FREE1(slot == entry_count, DFS_CORRUPTED_PARTITION, entries, "Directory block %u counts removed entries it does not hold.\n", blk_idx);
+
+	entry->flags = (entry->flags & ~ENTRY_GEN_MASK) | (entries[slot].flags & ENTRY_GEN_MASK);
+	free(entries);
+
+	//Uncounted before the slot is filled, a missed count only keeps the slot from being reused
+	header.holes--;
+	readc = device_write_at_blk(blk_idx, &header, sizeof(block_header), pt);
+	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+
+	new_loc->blk_idx = blk_idx;
+	new_loc->entry_idx = slot;
+	readc = device_write_at_entry_loc(*new_loc, entry, pt);
+	ERR_IF(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+
+	//The slot now holds a different name, its block filter has to know it
+	pthread_mutex_lock(&pt->dir_filters->lock);
+	dir_filter *filter = get_dir_filter(pt, blk_idx);
+	if (filter)
+		dir_filter_add(filter, entry->name_hash);
+	pthread_mutex_unlock(&pt->dir_filters->lock);
 
 	return DFS_SUCCESS;
 }
 
-static dfs_err set_stream_pos(dfs_partition *pt, const size_t position, dfs_file *file)
+static dfs_err dir_is_empty(const dfs_partition *pt, const blk_idx_t first_blk, bool *empty)
 {
-	//Align file cursor to block start (easier later)
-	file->head = file->head % BLOCK_DATA_SIZE;
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(empty, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(empty));
 
-	if (file->head == position)
-		return DFS_SUCCESS;
+	ssize_t readc;
+	block_header header;
+	*empty = true;
 
-	if (file->head > position) //Reset file to beggining
+	//Blocks emptied by removals stay linked, every one has to be checked
+	for (blk_idx_t blk_idx = first_blk; blk_idx; blk_idx = header.next_blk)
 	{
-		file->head = 0;
-		file->cur_blk_idx = file->first_blk_idx;
+		readc = device_read_at_blk(blk_idx, &header, sizeof(block_header), pt);
+		ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+
+		if (header.used_space / sizeof(entry_pointer) > header.holes)
+		{
+			*empty = false;
+			break;
+		}
 	}
 
-	return advance_stream(pt, position - file->head, file);
+	return DFS_SUCCESS;
 }
 
-static dfs_err advance_stream(dfs_partition *pt, size_t offset, dfs_file *file)
+static dfs_err remove_tree(dfs_partition *pt, const dfs_dir *base, const char *path)
 {
-	//Expects file cursor to be aligned on block start
+	//Expects meta_lock to be held for writing
+	//Nothing changes until the whole tree was read, then the entry is dropped and its blocks released at once
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
-	ERR_NULL(file, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(file));
+	ERR_NULL(base, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(base));
+	ERR_NULL(path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(path));
+	ERR_IF(dfs_path_is_empty(path), DFS_NVAL_PATH, ERR_MSG_EMPTY_PATH("remove"));
 
-	size_t left = offset;
 	dfs_err err;
-	size_t readc;
-	blk_idx_t cur_blk_idx = file->cur_blk_idx;
-	block_header cur_blk = { 0 };
+	entry_pointer entry;
+	entry_ptr_loc entry_loc;
+	ERR_NZERO((err = find_entry_ptr(pt, base, path, &entry, &entry_loc)), err, "Could not find entry for '%s'.\n", path);
+	ERR_IF(!(entry.flags & ENTRY_FLAG_DIR), DFS_NVAL_PATH, "Can only remove trees of directories (a file was provided).\n");
+	ERR_IF(!object_is_writable(entry), DFS_UNAUTHORIZED_ACCESS, ERR_MSG_UNAUTHORIZED_ACCESS("remove", path));
+
+	blk_idx_t *blks = NULL;
+	size_t blk_count = 0, blk_cap = 0;
+	ERR_NZERO_FREE1((err = collect_tree_blks(pt, entry.first_blk, &blks, &blk_count, &blk_cap)), err, blks,
+		"Failed to collect blocks of tree '%s'.\n", path);
+
+	pthread_mutex_lock(&pt->handle_lock);
+	ERR_IF_CLEANUP_FREE1(dir_handle_open(pt, entry_loc), DFS_UNAUTHORIZED_ACCESS, pthread_mutex_unlock(&pt->handle_lock), blks,
+		"Cannot remove '%s' while it is open.\n", path);
+
+	//Blocks are only released once no entry points to them anymore
+	err = remove_entry(pt, entry_loc);
+	pthread_mutex_unlock(&pt->handle_lock);
+	ERR_NZERO_FREE1(err, err, blks, "Failed to remove entry of '%s'.\n", path);
+
+	//Blocks are cleared in memory even if the map flush fails
+	err = release_blks(pt, blks, blk_count);
+	free(blks);
+	ERR_NZERO(err, err, "Failed to release blocks of tree '%s'.\n", path);
+	return DFS_SUCCESS;
+}
 
-	while (left > 0)
-	{
-		readc = device_read_at_blk(cur_blk_idx, &cur_blk, sizeof(block_header), pt);
-		ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+static dfs_err collect_tree_blks(dfs_partition *pt, const blk_idx_t first_blk, blk_idx_t **blks, size_t *count, size_t *cap)
+{
+	//Gathers the blocks of a directory and of everything below it, each header is read once
+	//Fails without side effects if any object of the tree is open or read-only
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+
+	dfs_err err;
+	ssize_t readc;
+	block_header header;
+	blk_idx_t *dirs = NULL;
+	size_t dir_count = 0, dir_cap = 0;
+
+	entry_pointer *entries = malloc(ENTRIES_PER_BLK * sizeof(entry_pointer));
+	ERR_NULL(entries, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+	ERR_NZERO_FREE1((err = blk_array_push(&dirs, &dir_count, &dir_cap, first_blk)), err, entries, "Failed to queue directory.\n");
 
-		if (left >= BLOCK_DATA_SIZE)
+	while (dir_count)
+	{
+		for (blk_idx_t blk_idx = dirs[--dir_count]; blk_idx; blk_idx = header.next_blk)
 		{
-			if (!cur_blk.next_blk) //Grow file
+			readc = device_read_at_blk(blk_idx, &header, sizeof(block_header), pt);
+			ERR_IF_FREE2(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, entries, dirs, ERR_MSG_DEVICE_READ_FAIL);
+			ERR_NZERO_FREE2((err = blk_array_push(blks, count, cap, blk_idx)), err, entries, dirs, "Failed to collect directory block.\n");
+
+			size_t entry_count = header.used_space / sizeof(entry_pointer);
+			size_t entries_len = entry_count * sizeof(entry_pointer);
+			readc = device_read_at(blk_off_to_addr(pt, blk_idx, 0), entries, entries_len, pt);
+			ERR_IF_FREE2((size_t)readc != entries_len, DFS_FAILED_DEVICE_READ, entries, dirs, ERR_MSG_DEVICE_READ_FAIL);
+
+			//Handles are only opened under meta_lock, none can appear once checked
+			bool open = false;
+			pthread_mutex_lock(&pt->handle_lock);
+			for (size_t i = 0; i < entry_count && !open; i++)
 			{
-				err = append_blk_to_file(pt, file->entry_loc, &cur_blk_idx, file);
-				ERR_NZERO(err, err, "Failed to grow file during seek.\n");
+				if (entry_is_removed(entries[i]))
+					continue;
+
+				entry_ptr_loc loc = { .blk_idx = blk_idx, .entry_idx = i };
+				open = entries[i].flags & ENTRY_FLAG_DIR ? dir_handle_open(pt, loc) : get_open_object(pt, loc) != NULL;
 			}
-			else
-				cur_blk_idx = cur_blk.next_blk;
+			pthread_mutex_unlock(&pt->handle_lock);
+			ERR_IF_FREE2(open, DFS_UNAUTHORIZED_ACCESS, entries, dirs, "Cannot remove a tree holding open objects.\n");
 
-			file->head += BLOCK_DATA_SIZE;
-			left -= BLOCK_DATA_SIZE;
-		}
-		else
-		{
-			if (left > cur_blk.used_space) //Grow used space
+			for (size_t i = 0; i < entry_count; i++)
 			{
-				cur_blk.used_space = left;
-				readc = device_write_at_blk(cur_blk_idx, &cur_blk, sizeof(block_header), pt);
-				ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
-			}
+				if (entry_is_removed(entries[i]))
+					continue;
+
+				ERR_IF_FREE2(!object_is_writable(entries[i]), DFS_UNAUTHORIZED_ACCESS, entries, dirs,
+					"Cannot remove read-only object '%.20s'.\n", entries[i].name);
 
-			file->head += left;
-			left = 0;
+				if (entries[i].flags & ENTRY_FLAG_DIR)
+					err = blk_array_push(&dirs, &dir_count, &dir_cap, entries[i].first_blk);
+				else
+					err = collect_chain_blks(pt, entries[i].first_blk, blks, count, cap);
+				ERR_NZERO_FREE2(err, err, entries, dirs, "Failed to collect blocks of '%.20s'.\n", entries[i].name);
+			}
 		}
 	}
 
-	file->cur_blk_idx = cur_blk_idx;
+	free(entries);
+	free(dirs);
 	return DFS_SUCCESS;
 }
 
-static dfs_err rewind_stream(dfs_partition *pt, dfs_file *file)
+static dfs_err collect_chain_blks(const dfs_partition *pt, const blk_idx_t first_blk, blk_idx_t **blks, size_t *count, size_t *cap)
 {
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
-	ERR_NULL(file, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(file));
-
-	//Align cursor on block start
-	file->head = file->head % BLOCK_DATA_SIZE;
 
-	size_t readc;
-	blk_idx_t cur_blk_idx = file->cur_blk_idx;
-	block_header cur_blk = { 0 };
+	dfs_err err;
+	ssize_t readc;
+	block_header header;
 
-	while (cur_blk_idx)
+	for (blk_idx_t blk_idx = first_blk; blk_idx; blk_idx = header.next_blk)
 	{
-		readc = device_read_at_blk(cur_blk_idx, &cur_blk, sizeof(block_header), pt);
+		readc = device_read_at_blk(blk_idx, &header, sizeof(block_header), pt);
 		ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
-
-		file->head += cur_blk.used_space;
-		file->cur_blk_idx = cur_blk_idx;
-
-		cur_blk_idx = cur_blk.next_blk;
+		ERR_NZERO((err = blk_array_push(blks, count, cap, blk_idx)), err, "Failed to collect file block.\n");
 	}
 
 	return DFS_SUCCESS;
 }
-#pragma endregion
-#pragma region Block navigation
-static dfs_err find_entry_ptr(const dfs_partition *pt, const char *path, entry_pointer *entry, entry_ptr_loc *entry_loc)
+
+static dfs_err rename_object(dfs_partition *pt, const dfs_dir *base, const char *old_path, const char *new_path)
 {
+	//Expects meta_lock to be held for writing, the data chain is never touched
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
-	ERR_NULL(path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(path));
+	ERR_NULL(base, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(base));
+	ERR_IF(dfs_path_is_empty(old_path) || dfs_path_is_empty(new_path), DFS_NVAL_PATH, ERR_MSG_EMPTY_PATH("move"));
 
-	if (dfs_path_is_empty(path))
-	{
-		entry_ptr_loc loc = get_root_loc();
+	char parent_dir[MAX_PATH + 1];
+	char name[MAX_PATH + 1];
 
-		if (entry)
-		{
-			entry_pointer e;
-			ssize_t readc = device_read_at_entry_loc(loc, &e, pt);
-			ERR_IF(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
-			*entry = e;
-		}
+	dfs_err err;
+	entry_pointer entry, parent, target;
+	entry_ptr_loc entry_loc, parent_loc, target_loc, new_loc;
+	block_header dir_last_blk;
+	blk_idx_t dir_last_blk_idx, removed_blk;
 
-		if (entry_loc)
-			*entry_loc = loc;
+	ERR_NZERO((err = find_entry_ptr(pt, base, old_path, &entry, &entry_loc)), err, "Could not find entry for '%s'.\n", old_path);
+	ERR_IF(!object_is_writable(entry), DFS_UNAUTHORIZED_ACCESS, ERR_MSG_UNAUTHORIZED_ACCESS("move", old_path));
 
-		return DFS_SUCCESS;
-	}
+	dfs_path_get_parent(parent_dir, new_path);
+	dfs_path_get_name(name, new_path);
 
-	return find_entry_ptr_recursion(pt, 0, path, entry, entry_loc);
-}
+	ERR_NZERO((err = find_entry_ptr(pt, base, parent_dir, &parent, &parent_loc)), err, "Could not find parent directory.\n");
+	ERR_IF(!(parent.flags & ENTRY_FLAG_DIR), DFS_NVAL_PATH, "Cannot move object inside a file.\n");
 
-static dfs_err find_entry_ptr_recursion(const dfs_partition* pt, const blk_idx_t cur_blk, const char *path, entry_pointer *entry, entry_ptr_loc *entry_loc)
-{ //REVIEW: Maybe break down into smaller functions
-	char root[MAX_PATH_NAME + 1];
-	char tail[MAX_PATH + 1];
-	char *search_name;
-	entry_pointer *entries = NULL, found_entry = { 0 };
-	entry_ptr_loc location = { 0 };
-	block_header cur_header = { 0 };
-	uint32_t next_idx = 0;
-	ssize_t readc;
+	if (entry.flags & ENTRY_FLAG_DIR)
+	{
+		bool crosses;
+		ERR_NZERO((err = path_crosses_entry(pt, base, parent_dir, entry_loc, &crosses)), err, "Failed to resolve parent directory.\n");
+		ERR_IF(crosses, DFS_NVAL_PATH, "Cannot move directory '%s' below itself.\n", old_path);
+	}
 
-	memset(root, 0, MAX_PATH_NAME + 1);
-	memset(tail, 0, MAX_PATH + 1);
+	//Check for the name and find the parent's last block in the same scan
+	err = find_entry_in_dir(pt, parent.first_blk, name, &target, &target_loc, &dir_last_blk_idx, &dir_last_blk, &removed_blk);
+	ERR_IF(err && err != DFS_PATH_NOT_FOUND, err, "Could not search parent directory.\n");
 
-	dfs_path_get_root(root, path);
-	dfs_path_get_tail(tail, path);
+	bool replace = !err;
+	if (replace)
+	{
+		if (target_loc.blk_idx == entry_loc.blk_idx && target_loc.entry_idx == entry_loc.entry_idx)
+			return DFS_SUCCESS;
 
-	search_name = dfs_path_is_empty(root) ? tail : root;
+		ERR_IF((entry.flags & ENTRY_FLAG_DIR) || (target.flags & ENTRY_FLAG_DIR), DFS_ALREADY_EXISTS, ERR_MSG_ALREADY_EXISTS(new_path));
+		ERR_IF(!object_is_writable(target), DFS_UNAUTHORIZED_ACCESS, ERR_MSG_UNAUTHORIZED_ACCESS("replace", new_path));
+	}
 
-	//Read current block entries
-	device_seek(SEEK_SET, blk_idx_to_addr(pt, cur_blk), pt);
-	readc = device_read(&cur_header, sizeof(block_header), pt);
-	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+	pthread_mutex_lock(&pt->handle_lock);
+	ERR_IF_CLEANUP(replace && get_open_object(pt, target_loc), DFS_UNAUTHORIZED_ACCESS, pthread_mutex_unlock(&pt->handle_lock),
+		"Cannot replace '%s' while it is open.\n", new_path);
 
-	entries = malloc(ENTRIES_PER_BLK * sizeof(entry_pointer));
-	ERR_NULL(entries, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+	err = relink_entry(pt, entry_loc, name, replace ? &target_loc : NULL, parent_loc, removed_blk, dir_last_blk_idx, dir_last_blk, &new_loc);
+	if (!err)
+		err = remove_entry(pt, entry_loc);
+	pthread_mutex_unlock(&pt->handle_lock);
+	ERR_NZERO(err, err, "Failed to relink entry of '%s'.\n", old_path);
 
-	readc = device_read(entries, ENTRIES_PER_BLK * sizeof(entry_pointer), pt);
-	ERR_IF(readc != ENTRIES_PER_BLK * sizeof(entry_pointer), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+	//The replaced file's entry slot was reused, only its blocks are left
+	if (replace)
+		ERR_NZERO((err = reclaimer_queue(pt, target.first_blk)), err, "Failed to queue blocks of '%s' for release.\n", new_path);
 
-	//REVIEW: Possibly validate header used_space is multiple of sizeof(entry_pointer)
-	int valid_entry_count = cur_header.used_space / sizeof(entry_pointer);
+	return DFS_SUCCESS;
+}
 
-	//Search entries for dir/file
-	for (int i = 0; i < valid_entry_count; i++)
-	{
-		//Filter out not matching names (at most one should match)
-		if (strncmp(search_name, entries[i].name, MAX_PATH_NAME))
-			continue;
+static dfs_err relink_entry(dfs_partition *pt, const entry_ptr_loc src_loc, const char *name, const entry_ptr_loc *target, const entry_ptr_loc parent_loc,
+	const blk_idx_t removed_blk, const blk_idx_t dir_last_blk_idx, const block_header dir_last_blk, entry_ptr_loc *new_loc)
+{
+	//Copies the entry at src_loc under a new name over target, into a removed slot of removed_blk or appends it to the directory at parent_loc
+	//Open handles follow the copy, the source slot is left for the caller to remove
+	//Expects meta_lock to be held for writing and handle_lock
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(name, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(name));
+	ERR_NULL(new_loc, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(new_loc));
 
-		next_idx = entries[i].first_blk;
-		found_entry = entries[i];
-		location.blk_idx = cur_blk;
-		location.entry_idx = i;
-		break;
-	}
+	dfs_err err = DFS_SUCCESS;
+	ssize_t readc;
+	entry_pointer entry;
 
-	free(entries);
+	//Writers update the entry of an open file under its lock, copy it while they are held off
+	open_object *obj = get_open_object(pt, src_loc);
+	if (obj)
+		pthread_mutex_lock(&obj->lock);
 
-	if (!next_idx) //Couldn't find dir/file in current block
+	readc = device_read_at_entry_loc(src_loc, &entry, pt);
+	if (readc != sizeof(entry_pointer))
+		err = DFS_FAILED_DEVICE_READ;
+	else
 	{
-		if (!cur_header.next_blk) return DFS_PATH_NOT_FOUND;
+		entry_copy_name(entry.name, name);
+		entry.name_hash = entry_name_hash(name);
+		entry.flags &= ~ENTRY_GEN_MASK;
 
-		return find_entry_ptr_recursion(pt, cur_header.next_blk, path, entry, entry_loc);
-	}
-	else //Found dir/file
-	{
-		if (next_idx && strlen(root)) //It's not final, continue search on next block
-			return find_entry_ptr_recursion(pt, next_idx, tail, entry, entry_loc);
-		else //It's the requested dir/file, return index
+		if (target)
 		{
-			if (entry)
-				*entry = found_entry;
-			if (entry_loc)
-				*entry_loc = location;
-			return DFS_SUCCESS;
+			//Ids of the replaced file must not lead to the copy
+			entry_pointer replaced;
+			readc = device_read_at_entry_loc(*target, &replaced, pt);
+			if (readc == sizeof(entry_pointer))
+			{
+				entry.flags |= (replaced.flags + (1 << ENTRY_GEN_SHIFT)) & ENTRY_GEN_MASK;
+				readc = device_write_at_entry_loc(*target, &entry, pt);
+			}
+			err = readc == sizeof(entry_pointer) ? DFS_SUCCESS : DFS_FAILED_DEVICE_WRITE;
+			*new_loc = *target;
+
+			//The slot now holds a different name, its block filter has to know it
+			pthread_mutex_lock(&pt->dir_filters->lock);
+			dir_filter *filter = get_dir_filter(pt, target->blk_idx);
+			if (filter)
+				dir_filter_add(filter, entry.name_hash);
+			pthread_mutex_unlock(&pt->dir_filters->lock);
 		}
+		else if (removed_blk)
+			err = reuse_removed_entry(pt, removed_blk, &entry, new_loc);
+		else
+			err = append_entries_to_dir(pt, parent_loc, dir_last_blk_idx, dir_last_blk, &entry, 1, new_loc, NULL);
 	}
+
+	if (obj && !err)
+		open_object_relocate(pt, obj, *new_loc);
+	if (obj)
+		pthread_mutex_unlock(&obj->lock);
+	ERR_NZERO(err, err, "Failed to copy entry to its new location.\n");
+
+	dir_handles_relocate(pt, src_loc, *new_loc);
+	return DFS_SUCCESS;
 }
 
-static dfs_err find_free_blk(const dfs_partition *pt, blk_idx_t *index)
+static dfs_err path_crosses_entry(const dfs_partition *pt, const dfs_dir *base, const char *path, const entry_ptr_loc entry_loc, bool *crosses)
 {
+	//Tells whether resolving the directory path from base passes through entry_loc, prefixes are resolved one by one
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
-	ERR_NULL(index, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(index));
+	ERR_NULL(path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(path));
+	ERR_NULL(crosses, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(crosses));
 
+	char prefix[MAX_PATH + 1];
 	dfs_err err;
-	uint32_t i;
+	entry_ptr_loc loc;
+	size_t len = strnlen(path, MAX_PATH);
+	*crosses = false;
 
-	//OPTIMIZE: Use usage_map byte searches (8 bits at a time)
-	for (i = 0; i < pt->blk_count; i++)
+	for (size_t i = 1; i <= len; i++)
 	{
-		bool used;
-		ERR_NZERO((err = get_blk_used(pt, i, &used)), err, "Failed to retrieve block usage state.\n");
+		if (i < len && path[i] != DIR_SEPARATOR_CH)
+			continue;
 
-		if (!used)
+		memcpy(prefix, path, i);
+		prefix[i] = '\0';
+		ERR_NZERO((err = find_entry_ptr(pt, base, prefix, NULL, &loc)), err, "Could not resolve '%s'.\n", prefix);
+
+		if (loc.blk_idx == entry_loc.blk_idx && loc.entry_idx == entry_loc.entry_idx)
 		{
-			*index = i;
-			return DFS_SUCCESS;
+			*crosses = true;
+			break;
 		}
 	}
 
-	ERR(DFS_NO_SPACE, "Failed to allocate space for new block.\n");
+	return DFS_SUCCESS;
 }
-#pragma endregion
-#pragma region Block manipulation
-static dfs_err append_blk_to_file(const dfs_partition *pt, const entry_ptr_loc entry_loc, blk_idx_t *new_idx, dfs_file *handle)
-{ //REVIEW: Maybe break down into smaller functions
+
+static dfs_err open_copy_objects(dfs_partition *pt, const dfs_dir *base, const char *src_path, const char *dst_path, open_object **src, open_object **dst)
+{
+	//Creates the destination file and attaches both objects, expects meta_lock to be held for writing
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(base, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(base));
+	ERR_NULL(src, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(src));
+	ERR_NULL(dst, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(dst));
+	ERR_IF(dfs_path_is_empty(src_path), DFS_NVAL_PATH, ERR_MSG_EMPTY_PATH("copy"));
 
 	dfs_err err;
 	ssize_t readc;
-	uint32_t new_blk_idx, old_block_idx;
-	entry_pointer entry;
-	block_header new_blk, old_block;
+	entry_pointer src_entry, dst_entry;
+	entry_ptr_loc src_loc, dst_loc;
 
-	//Find block and reserve
-	ERR_NZERO((err = find_free_blk(pt, &new_blk_idx)), err, "Could not find a free block.\n");
-	ERR_NZERO((err = set_blk_used(pt, new_blk_idx, true)), err, "Coult not flag block as used.\n");
-	ERR_NZERO((err = flush_full_blk_map(pt)), err, "Failed to flush block map.\n");
+	ERR_NZERO((err = find_entry_ptr(pt, base, src_path, &src_entry, &src_loc)), err, "Could not find entry for file '%s'.\n", src_path);
+	ERR_IF(!object_is_file(src_entry) || !object_is_writable(src_entry), DFS_UNAUTHORIZED_ACCESS, ERR_MSG_UNAUTHORIZED_ACCESS("copy", src_path));
 
-	//Read entry pointer
-	readc = device_read_at_entry_loc(entry_loc, &entry, pt);
-	ERR_IF(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
-
-	//Update last block index in entry
-	old_block_idx = entry.last_blk;
-	entry.last_blk = new_blk_idx;
-
-	//Flush changes
-	readc = device_write_at_entry_loc(entry_loc, &entry, pt);
-	ERR_IF(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
-
-	//Create new block header
-	new_blk.next_blk = 0;
-	new_blk.prev_blk = old_block_idx;
-	new_blk.used_space = 0;
-	new_blk.resvd = 0;
-
-	//Store new block
-	readc = device_write_at_blk(new_blk_idx, &new_blk, sizeof(block_header), pt);
-	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
-
-	//Read old block
-	readc = device_read_at_blk(old_block_idx, &old_block, sizeof(block_header), pt);
-	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
-
-	//Update index and used space
-	old_block.next_blk = new_blk_idx;
-	old_block.used_space = BLOCK_DATA_SIZE;
-
-	//Flush changes
-	readc = device_write_at_blk(old_block_idx, &old_block, sizeof(block_header), pt);
-	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+	//Denying writes only keeps new writers off, handles already writing to the source refuse the copy
+	pthread_mutex_lock(&pt->handle_lock);
+	err = handle_acquire_object(pt, src_entry, src_loc, copy_src_flags, src);
+	if (!err && (*src)->writers)
+	{
+		open_object_release(pt, *src, copy_src_flags);
+		err = DFS_UNAUTHORIZED_ACCESS;
+	}
+	pthread_mutex_unlock(&pt->handle_lock);
+	ERR_NZERO(err, err, "Could not open file '%s' for copying.\n", src_path);
 
-	if (new_idx)
-		*new_idx = new_blk_idx;
+	//Appending an entry never moves existing ones, the source stays where it was attached
+	err = create_object(pt, base, dst_path, ENTRY_FLAG_FILE, &dst_loc);
+	if (!err)
+	{
+		readc = device_read_at_entry_loc(dst_loc, &dst_entry, pt);
+		err = readc == sizeof(entry_pointer) ? DFS_SUCCESS : DFS_FAILED_DEVICE_READ;
+	}
 
-	if (handle)
-		handle->last_blk_idx = new_blk_idx;
+	pthread_mutex_lock(&pt->handle_lock);
+	if (!err)
+		err = handle_acquire_object(pt, dst_entry, dst_loc, copy_dst_flags, dst);
+	if (err)
+		open_object_release(pt, *src, copy_src_flags);
+	pthread_mutex_unlock(&pt->handle_lock);
+	ERR_NZERO(err, err, "Could not create file '%s'.\n", dst_path);
 
 	return DFS_SUCCESS;
 }
 
-static dfs_err append_entry_to_dir(const dfs_partition *pt, const entry_ptr_loc dir_entryLoc, entry_pointer new_entry)
+static dfs_err copy_object_data(dfs_partition *pt, open_object *src, open_object *dst)
 {
+	//Moves up to COPY_BATCH blocks per write, source blocks following each other on the device are read in one call
+	//Holes are skipped, the blocks of the run after them are reserved behind as many holes in the copy
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(src, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(src));
+	ERR_NULL(dst, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(dst));
 
-	entry_pointer dir_entry;
-	block_header dir_blk;
-	uint32_t blk_idx;
+	//Expects to be registered as a reader of src, the size is loaded once after that
 	dfs_err err;
 	ssize_t readc;
+	struct iovec iov[COPY_BATCH];
+	size_t size = src->size, written;
+	size_t chain_len = (size + BLOCK_DATA_SIZE - 1) / BLOCK_DATA_SIZE;
+	size_t chain_idx = 0;
 
-	//Read dir entry
-	readc = device_read_at_entry_loc(dir_entryLoc, &dir_entry, pt);
-	ERR_IF(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
-
-	//Load last block
-	blk_idx = dir_entry.last_blk;
-	readc = device_read_at_blk(blk_idx, &dir_blk, sizeof(block_header), pt);
-	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+	//Whole blocks are read, headers included, iov then points at the data of each one
+	char *buffer = malloc((size_t)COPY_BATCH * BLOCK_SIZE);
+	ERR_NULL(buffer, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
 
-	if (dir_blk.used_space + sizeof(entry_pointer) >= BLOCK_DATA_SIZE) //No free space
+	while (chain_idx < chain_len)
 	{
-		//Append block and update block index
-		ERR_NZERO((err = append_blk_to_file(pt, dir_entryLoc, &blk_idx, NULL)), err, "Failed to append block to file.\n");
+		if (src->chain[chain_idx] == BLK_IDX_HOLE)
+		{
+			chain_idx++;
+			continue;
+		}
 
-		//Load new block
-		readc = device_read_at_blk(blk_idx, &dir_blk, sizeof(block_header), pt);
-		ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
-	}
+		size_t run = 0, run_len = 0;
+		while (run < COPY_BATCH && chain_idx + run < chain_len && src->chain[chain_idx + run] != BLK_IDX_HOLE)
+		{
+			//Extend the device read over blocks placed right after each other
+			size_t span = 1;
+			blk_idx_t first = src->chain[chain_idx + run];
+			while (run + span < COPY_BATCH && chain_idx + run + span < chain_len && src->chain[chain_idx + run + span] == first + span)
+				span++;
 
-	//Write new entry pointer
-	size_t addr = blk_off_to_addr(pt, blk_idx, dir_blk.used_space);
-	readc = device_write_at(addr, &new_entry, sizeof(entry_pointer), pt);
-	ERR_IF(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+			readc = device_read_at(blk_idx_to_addr(pt, first), &buffer[run * BLOCK_SIZE], span * BLOCK_SIZE, pt);
+			ERR_IF_FREE1(readc < 0 || (size_t)readc != span * BLOCK_SIZE, DFS_FAILED_DEVICE_READ, buffer, ERR_MSG_DEVICE_READ_FAIL);
 
-	//Update block header
-	dir_blk.used_space += (uint32_t)sizeof(entry_pointer);
+			for (size_t i = run; i < run + span; i++)
+			{
+				iov[i].iov_base = &buffer[i * BLOCK_SIZE + sizeof(block_header)];
+				iov[i].iov_len = MIN(BLOCK_DATA_SIZE, size - (chain_idx + i) * BLOCK_DATA_SIZE);
+				run_len += iov[i].iov_len;
+			}
+			run += span;
+		}
 
-	//Flush header changes
-	readc = device_write_at_blk(blk_idx, &dir_blk, sizeof(block_header), pt);
-	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+		pthread_mutex_lock(&dst->lock);
+		err = DFS_SUCCESS;
+		if (chain_idx > dst->chain_len)
+			err = open_object_append_blks(pt, dst, run, chain_idx - dst->chain_len);
+		if (!err)
+			err = object_writev_at(pt, dst, chain_idx * BLOCK_DATA_SIZE, iov, (int)run, &written);
+		pthread_mutex_unlock(&dst->lock);
+		ERR_NZERO_FREE1(err, err, buffer, "Failed to write copied blocks.\n");
+		ERR_IF_FREE1(written != run_len, DFS_FAILED_DEVICE_WRITE, buffer, ERR_MSG_DEVICE_WRITE_FAIL);
+
+		chain_idx += run;
+	}
 
+	free(buffer);
 	return DFS_SUCCESS;
 }
-#pragma endregion
-#pragma region File manipulation
-static dfs_err create_object(dfs_partition *pt, const char *path, const uint16_t flags)
-{ //REVIEW: Maybe break down into smaller functions
-	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
-	ERR_NULL(path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(path));
-	
-	char parent_dir[MAX_PATH + 1];
-	char name[MAX_PATH_NAME + 1];
 
-	dfs_err err;
-	entry_pointer new_entry = { 0 };
-	entry_ptr_loc parent_loc;
-	block_header new_blk;
-	uint32_t new_blk_idx;
-	ssize_t readc;
+static dfs_err blk_array_push(blk_idx_t **array, size_t *count, size_t *cap, const blk_idx_t blk_idx)
+{
+	ERR_NULL(array, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(array));
 
-	ERR_IF(dfs_path_is_empty(path), DFS_NVAL_PATH, "Cannot create root object. (The provided path was empty)\n");
+	if (*count == *cap)
+	{
+		size_t new_cap = *cap ? *cap * 2 : ENTRIES_PER_BLK;
+		blk_idx_t *new_array = realloc(*array, new_cap * sizeof(blk_idx_t));
+		ERR_NULL(new_array, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
 
-	err = find_entry_ptr(pt, path, NULL, NULL);
-	ERR_IF(err == DFS_SUCCESS, DFS_ALREADY_EXISTS, ERR_MSG_ALREADY_EXISTS(path));
+		*array = new_array;
+		*cap = new_cap;
+	}
 
-	dfs_path_get_parent(parent_dir, path);
-	dfs_path_get_name(name, path);
+	(*array)[(*count)++] = blk_idx;
+	return DFS_SUCCESS;
+}
 
-	//Find parent dir
-	ERR_NZERO((err = find_entry_ptr(pt, parent_dir, NULL, &parent_loc)), err, "Could not find parent directory.\n");
+static int compare_requests_by_parent(const void *a, const void *b)
+{
+	//Shallower parents first, so parents created in the same call exist before their children
+	const create_request *ra = a, *rb = b;
 
-	//Check if parent is a directory
-	entry_pointer parent;
-	readc = device_read_at_entry_loc(parent_loc, &parent, pt);
-	ERR_IF(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
-	ERR_IF(!(parent.flags & ENTRY_FLAG_DIR), DFS_NVAL_PATH, "Cannot create object inside a file.\n");
+	if (ra->depth != rb->depth)
+		return ra->depth < rb->depth ? -1 : 1;
 
-	//Find and reserve free block
-	ERR_NZERO((err = find_free_blk(pt, &new_blk_idx)), err, "Could not find free block.\n");
-	ERR_NZERO((err = set_blk_used(pt, new_blk_idx, true)), err, "Could not flag block as used.\n");
-	ERR_NZERO((err = flush_full_blk_map(pt)), err, "Could not flush block map.\n");
+	int cmp = memcmp(ra->path, rb->path, MIN(ra->parent_len, rb->parent_len));
+	if (cmp)
+		return cmp;
+	if (ra->parent_len != rb->parent_len)
+		return ra->parent_len < rb->parent_len ? -1 : 1;
 
-	//Create new entry
-	memset(new_entry.name, 0, MAX_PATH_NAME);
-	strncpy(new_entry.name, name, MAX_PATH_NAME);
-	new_entry.first_blk = new_blk_idx;
-	new_entry.last_blk = new_blk_idx;
-	new_entry.resvd = 0;
-	new_entry.flags = flags;
+	return ra->idx < rb->idx ? -1 : (ra->idx > rb->idx);
+}
 
-	//Append entry to parent
-	ERR_NZERO((err = append_entry_to_dir(pt, parent_loc, new_entry)), err, "Could not append entry to directory.\n");
+static int compare_requests_by_name(const void *a, const void *b)
+{
+	const create_request *ra = a, *rb = b;
 
-	//Set new block header
-	new_blk.next_blk = 0;
-	new_blk.prev_blk = 0;
-	new_blk.used_space = 0;
-	new_blk.resvd = 0;
+	if (ra->hash != rb->hash)
+		return ra->hash < rb->hash ? -1 : 1;
 
-	//Flush changes
-	readc = device_write_at_blk(new_blk_idx, &new_blk, sizeof(block_header), pt);
-	ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_WRITE, ERR_MSG_DEVICE_WRITE_FAIL);
+	int cmp = strncmp(ra->name, rb->name, MAX_PATH_NAME);
+	if (cmp)
+		return cmp;
 
-	return DFS_SUCCESS;
+	return ra->idx < rb->idx ? -1 : (ra->idx > rb->idx);
 }
 
 static dfs_err determine_file_size(dfs_partition *pt, const entry_pointer entry, size_t *size)
@@ -1072,7 +3702,11 @@ static dfs_err determine_file_size(dfs_partition *pt, const entry_pointer entry,
 		readc = device_read_at_blk(blk_idx, &cur_blk, sizeof(block_header), pt);
 		ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
 
-		counter += cur_blk.used_space; //In theory all but last should be full
+		//In theory all but last should be full, directory blocks count their removed entries instead of holes
+		if (object_is_file(entry))
+			counter += (size_t)cur_blk.holes * BLOCK_DATA_SIZE + cur_blk.used_space;
+		else
+			counter += cur_blk.used_space - (size_t)cur_blk.holes * sizeof(entry_pointer);
 		blk_idx = cur_blk.next_blk;
 	}
 	
@@ -1081,6 +3715,75 @@ static dfs_err determine_file_size(dfs_partition *pt, const entry_pointer entry,
 	return DFS_SUCCESS;
 }
 
+static dfs_err read_entry_by_id(const dfs_partition *pt, const dfs_obj_id id, entry_pointer *entry, entry_ptr_loc *entry_loc)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(entry, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(entry));
+
+	dfs_err err;
+	ssize_t readc;
+	entry_ptr_loc loc = id_to_entry_loc(id);
+
+	if (id == DFS_OBJ_ID_ROOT)
+	{
+		readc = device_read_at_entry_loc(loc, entry, pt);
+		ERR_IF(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+	}
+	else
+	{
+		//Malformed ids can never have been handed out, every check value is well formed and only compared below
+		ERR_IF(loc.blk_idx >= pt->blk_count || loc.entry_idx >= ENTRIES_PER_BLK,
+			DFS_NVAL_ID, "Object id '%lx' is out of range.\n", (unsigned long)id);
+
+		//Anything else that doesn't lead back to the same entry is stale, its blocks may hold other data by now
+		//The reclaimer releases blocks under the map lock only
+		bool used;
+		pthread_mutex_lock(&pt->usage_map->lock);
+		err = get_blk_used(pt, loc.blk_idx, &used);
+		pthread_mutex_unlock(&pt->usage_map->lock);
+		ERR_NZERO(err, err, "Failed to retrieve block usage state.\n");
+		ERR_IF(!used, DFS_FAILED_ENTRY_LOOKUP, "Object id '%lx' points to a free block.\n", (unsigned long)id);
+
+		block_header dir_blk;
+		readc = device_read_at_blk(loc.blk_idx, &dir_blk, sizeof(block_header), pt);
+		ERR_IF(readc != sizeof(block_header), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+		ERR_IF(loc.entry_idx >= dir_blk.used_space / sizeof(entry_pointer), DFS_FAILED_ENTRY_LOOKUP,
+			"Object id '%lx' points past the directory block's entries.\n", (unsigned long)id);
+
+		readc = device_read_at_entry_loc(loc, entry, pt);
+		ERR_IF(readc != sizeof(entry_pointer), DFS_FAILED_DEVICE_READ, ERR_MSG_DEVICE_READ_FAIL);
+		ERR_IF(!entry->first_blk || entry->first_blk >= pt->blk_count || entry_loc_to_id(loc, entry) != id, DFS_FAILED_ENTRY_LOOKUP,
+			"Object id '%lx' does not point to its entry anymore.\n", (unsigned long)id);
+
+		pthread_mutex_lock(&pt->usage_map->lock);
+		err = get_blk_used(pt, entry->first_blk, &used);
+		pthread_mutex_unlock(&pt->usage_map->lock);
+		ERR_NZERO(err, err, "Failed to retrieve block usage state.\n");
+		ERR_IF(!used, DFS_FAILED_ENTRY_LOOKUP, "Object id '%lx' points to an entry without blocks.\n", (unsigned long)id);
+	}
+
+	if (entry_loc)
+		*entry_loc = loc;
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err fill_entry_info(dfs_partition *pt, const entry_pointer entry, const entry_ptr_loc entry_loc, dfs_entry *info)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(info, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(info));
+
+	dfs_err err;
+
+	info->dir = entry.flags & ENTRY_FLAG_DIR;
+	info->id = entry_loc_to_id(entry_loc, &entry);
+	ERR_NZERO((err = determine_file_size(pt, entry, &info->length)), err, "Failed to determine object size.\n");
+	memcpy(info->name, entry.name, MAX_PATH_NAME);
+	info->name[MAX_PATH_NAME] = '\0';
+
+	return DFS_SUCCESS;
+}
+
 static bool object_is_file(entry_pointer entry)
 {
 	return !(entry.flags & ENTRY_FLAG_DIR);
@@ -1090,33 +3793,124 @@ static bool object_is_writable(entry_pointer entry)
 {
 	return !(entry.flags & ENTRY_FLAG_READONLY);
 }
+
+static bool entry_is_removed(entry_pointer entry)
+{
+	return entry.flags & ENTRY_FLAG_REMOVED;
+}
 #pragma endregion
 #pragma region File handles
-static dfs_err handle_can_open(dfs_partition *pt, const char *path, const dfs_filem_flags flags, bool *can_open)
+static dfs_err handle_can_open(dfs_partition *pt, const entry_ptr_loc entry_loc, const dfs_filem_flags flags, bool *can_open)
 {
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
-	ERR_NULL(path, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(path));
 	ERR_NULL(can_open, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(can_open));
 
+	open_object *obj = get_open_object(pt, entry_loc);
 	bool compatible = true;
-	for (size_t i = 0; i < DFS_MAX_HANDLES; i++)
+
+	if (obj)
 	{
-		dfs_file cur = pt->open_handles[i];
+		if ((flags & DFS_FILEM_READ) && obj->deny_read)
+			compatible = false;
+		if ((flags & DFS_FILEM_WRITE) && obj->deny_write)
+			compatible = false;
+	}
 
-		if (!cur.present)
-			continue;
+	*can_open = compatible;
+	return DFS_SUCCESS;
+}
 
-		if (strcmp(cur.path, path))
-			continue;
+static dfs_err handle_acquire_object(dfs_partition *pt, const entry_pointer entry, const entry_ptr_loc entry_loc, const dfs_filem_flags flags, open_object **obj)
+{
+	//Attaches to the open object of the entry, loading it if needed, expects handle_lock to be held
+	//Also expects meta_lock to be held, so the entry stays in place while handle_lock is dropped to load the chain
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(obj, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(obj));
+
+	dfs_err err;
+	open_object *found, *loaded = NULL;
+	size_t loaded_freed = 0;
+
+	while (true)
+	{
+		//Sharing is checked by entry location, the same file may be reached through different paths
+		bool can_open = false;
+		ERR_NZERO_CLEANUP((err = handle_can_open(pt, entry_loc, flags, &can_open)), err, open_object_free(loaded), "Failed to test if file can be opened.\n");
+		ERR_IF_CLEANUP(!can_open, DFS_UNAUTHORIZED_ACCESS, open_object_free(loaded), "Could not open file due to sharing restrictions.\n");
 
-		if (!handle_open_flags_compatible(flags, cur.flags))
+		found = get_open_object(pt, entry_loc);
+		if (found)
 		{
-			compatible = false;
+			open_object_free(loaded);
+			break;
+		}
+
+		//Only a file without open object is unchanged while its chain is read, no handle can write to it
+		//One that was opened, written and closed meanwhile shows up as a freed object, its chain is loaded again
+		size_t freed = pt->open_objects->freed;
+		if (loaded && freed == loaded_freed)
+		{
+			open_object_insert(pt, loaded);
+			found = loaded;
 			break;
 		}
+
+		open_object_free(loaded);
+		loaded = NULL;
+		loaded_freed = freed;
+
+		//Large files take many device reads, other opens and closes go on meanwhile
+		pthread_mutex_unlock(&pt->handle_lock);
+		err = open_object_create(pt, entry, entry_loc, &loaded);
+		pthread_mutex_lock(&pt->handle_lock);
+		ERR_NZERO(err, err, "Failed to load open file state.\n");
 	}
 
-	*can_open = compatible;
+	open_object_attach(found, flags);
+	*obj = found;
+	return DFS_SUCCESS;
+}
+
+static dfs_err handle_open(dfs_partition *pt, const entry_pointer entry, const entry_ptr_loc entry_loc, const dfs_filem_flags flags, int *descriptor)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(descriptor, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(descriptor));
+	ERR_IF(pt->read_only && (flags & DFS_FILEM_WRITE), DFS_UNAUTHORIZED_ACCESS, "Cannot open files for writing on a read-only partition.\n");
+
+	char *wbuf = NULL;
+	if (flags & DFS_FILEM_BUFFERED)
+	{
+		wbuf = malloc(HANDLE_WBUF_SIZE + BLOCK_DATA_SIZE);
+		ERR_NULL(wbuf, DFS_FAILED_ALLOC, ERR_MSG_ALLOC_FAIL);
+	}
+
+	dfs_err err;
+	open_object *obj;
+	pthread_mutex_lock(&pt->handle_lock);
+	ERR_NZERO_CLEANUP_FREE1((err = handle_acquire_object(pt, entry, entry_loc, flags, &obj)), err, pthread_mutex_unlock(&pt->handle_lock), wbuf,
+		"Could not attach to file.\n");
+
+	int new_descriptor;
+	void *slot;
+	ERR_NZERO_CLEANUP_FREE1((err = handle_table_alloc(&pt->open_handles, &new_descriptor, &slot)), err,
+		open_object_release(pt, obj, flags); pthread_mutex_unlock(&pt->handle_lock), wbuf, "Failed to allocate file handle.\n");
+
+	dfs_file handle = {
+		.flags = flags,
+		.head = 0,
+		.obj = obj,
+		.wbuf = wbuf,
+		.wbuf_len = 0,
+		.rbuf = wbuf ? wbuf + HANDLE_WBUF_SIZE : NULL,
+		.rbuf_off = 0,
+		.rbuf_len = 0,
+		.rbuf_gen = 0
+	};
+
+	*(dfs_file*)slot = handle;
+	pthread_mutex_unlock(&pt->handle_lock);
+
+	*descriptor = new_descriptor;
 	return DFS_SUCCESS;
 }
 
@@ -1124,21 +3918,134 @@ static dfs_err handle_get(dfs_partition *pt, const int descriptor, dfs_file **fi
 {
 	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
 	ERR_NULL(file, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(file));
-	ERR_IF(descriptor < 0, DFS_NVAL_DESCRIPTOR, ERR_MSG_NVAL_DESCRIPTOR("access", descriptor));
-	ERR_IF(descriptor > DFS_MAX_HANDLES, DFS_NVAL_DESCRIPTOR, ERR_MSG_NVAL_DESCRIPTOR("access", descriptor));
-	ERR_IF(!pt->open_handles[descriptor].present, DFS_NVAL_DESCRIPTOR, ERR_MSG_NVAL_DESCRIPTOR("access", descriptor));
 
-	*file = &pt->open_handles[descriptor];
+	dfs_file *handle = handle_table_get(&pt->open_handles, descriptor);
+	ERR_NULL(handle, DFS_NVAL_DESCRIPTOR, ERR_MSG_NVAL_DESCRIPTOR("access", descriptor));
+
+	*file = handle;
 	return DFS_SUCCESS;
 }
 
-static bool handle_open_flags_compatible(const dfs_filem_flags new, const dfs_filem_flags open)
+static dfs_err handle_flush(dfs_partition *pt, dfs_file *file)
 {
-	if ((new & DFS_FILEM_READ) && !(open & DFS_FILEM_SHARE_READ))
-		return false;
-	if ((new & DFS_FILEM_WRITE) && !(open & DFS_FILEM_SHARE_WRITE))
-		return false;
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(file, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(file));
 
-	return true;
+	if (!file->wbuf_len)
+		return DFS_SUCCESS;
+
+	dfs_err err;
+	size_t writec;
+	pthread_mutex_lock(&file->obj->lock);
+	size_t start = handle_write_pos(file);
+	err = object_write_at(pt, file->obj, start, file->wbuf, file->wbuf_len, &writec);
+
+	//A failed flush keeps what did not land, a later flush or close retries it
+	file->head = start + file->wbuf_len;
+	handle_drop_buffered(file, writec);
+	pthread_mutex_unlock(&file->obj->lock);
+	ERR_NZERO(err, err, "Failed to write buffered data.\n");
+
+	return DFS_SUCCESS;
+}
+
+static void handle_drop_buffered(dfs_file *file, const size_t len)
+{
+	//Removes the first len bytes of the write buffer once they are on the device
+	file->wbuf_len -= len;
+	if (file->wbuf_len)
+		memmove(file->wbuf, &file->wbuf[len], file->wbuf_len);
+}
+
+static size_t handle_write_pos(const dfs_file *file)
+{
+	//Where pending writes of the handle land, expects obj->lock to be held so appends see the final size
+	if (file->flags & DFS_FILEM_APPEND)
+		return file->obj->size;
+
+	return file->head - file->wbuf_len;
+}
+
+static dfs_err handle_read_buffered(dfs_partition *pt, dfs_file *file, void *buffer, const size_t len, size_t *read)
+{
+	//Serves reads from a copy of the block under head, refilled on a miss or after the file changed
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(file, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(file));
+
+	dfs_err err;
+	open_object *obj = file->obj;
+	size_t buff_head = 0;
+	*read = 0;
+
+	while (buff_head < len)
+	{
+		//Generation is taken before reading, a concurrent write leaves the copy stale rather than torn
+		size_t generation = obj->generation;
+		if (generation != file->rbuf_gen || file->head < file->rbuf_off || file->head >= file->rbuf_off + file->rbuf_len)
+		{
+			size_t readc;
+			file->rbuf_off = file->head - file->head % BLOCK_DATA_SIZE;
+			file->rbuf_len = 0;
+			file->rbuf_gen = generation;
+			ERR_NZERO((err = object_read_at(pt, obj, file->rbuf_off, file->rbuf, BLOCK_DATA_SIZE, &readc)), err, "Failed to fill read buffer.\n");
+			file->rbuf_len = readc;
+
+			if (file->head >= file->rbuf_off + file->rbuf_len) //End of file
+				break;
+		}
+
+		size_t to_copy = MIN(len - buff_head, file->rbuf_off + file->rbuf_len - file->head);
+		memcpy(&((char*)buffer)[buff_head], &file->rbuf[file->head - file->rbuf_off], to_copy);
+
+		buff_head += to_copy;
+		file->head += to_copy;
+		*read = buff_head;
+	}
+
+	return DFS_SUCCESS;
+}
+
+static dfs_err dir_handle_get(dfs_partition *pt, const int dir_descriptor, dfs_dir **dir)
+{
+	ERR_NULL(pt, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(pt));
+	ERR_NULL(dir, DFS_NVAL_ARGS, ERR_MSG_NULL_ARG(dir));
+
+	if (dir_descriptor == DFS_DIR_ROOT)
+	{
+		*dir = &pt->root_dir;
+		return DFS_SUCCESS;
+	}
+
+	dfs_dir *handle = handle_table_get(&pt->open_dirs, dir_descriptor);
+	ERR_NULL(handle, DFS_NVAL_DESCRIPTOR, ERR_MSG_NVAL_DESCRIPTOR("access", dir_descriptor));
+
+	*dir = handle;
+	return DFS_SUCCESS;
+}
+
+static bool dir_handle_open(const dfs_partition *pt, const entry_ptr_loc entry_loc)
+{
+	//Expects handle_lock to be held
+	for (size_t i = 0; i < pt->open_dirs.page_count * HANDLE_PAGE_SLOTS; i++)
+	{
+		dfs_dir *dir = handle_table_get(&pt->open_dirs, (int)i);
+
+		if (dir && dir->entry_loc.blk_idx == entry_loc.blk_idx && dir->entry_loc.entry_idx == entry_loc.entry_idx)
+			return true;
+	}
+
+	return false;
+}
+
+static void dir_handles_relocate(dfs_partition *pt, const entry_ptr_loc from, const entry_ptr_loc to)
+{
+	//Expects meta_lock to be held for writing and handle_lock, lookups only read entry_loc under meta_lock
+	for (size_t i = 0; i < pt->open_dirs.page_count * HANDLE_PAGE_SLOTS; i++)
+	{
+		dfs_dir *dir = handle_table_get(&pt->open_dirs, (int)i);
+
+		if (dir && dir->entry_loc.blk_idx == from.blk_idx && dir->entry_loc.entry_idx == from.entry_idx)
+			dir->entry_loc = to;
+	}
 }
 #pragma endregion
@@ -5,6 +5,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #include "paths.h"
 
@@ -18,6 +19,8 @@ typedef uint16_t dfs_filec_flags;
 typedef uint32_t dfs_filem_flags;
 ///@brief Represents a partition handle
 typedef struct dfs_partition dfs_partition;
+///@brief Identifies an object by the location of its entry. Stays valid until the object is removed or moved
+typedef uint64_t dfs_obj_id;
 
 
 //===Structs===
@@ -25,12 +28,16 @@ typedef struct
 {
 	bool dir;
 	size_t length;
+	dfs_obj_id id;
 	char name[MAX_PATH];
 } dfs_entry;
 
 
 //===Constants===
-#define DFS_MAX_HANDLES 64
+///@brief Directory descriptor that refers to the partition root, accepted by every *_at function
+#define DFS_DIR_ROOT -1
+///@brief Object id of the partition root
+#define DFS_OBJ_ID_ROOT (dfs_obj_id)0xFFFFFFFFFFFFFFFF
 
 
 //===Error codes===
@@ -72,6 +79,14 @@ typedef struct
 #define DFS_ALREADY_EXISTS (dfs_err)16
 ///@brief Attempted to access an invalid path
 #define DFS_NVAL_PATH (dfs_err)17
+///@brief Attempted to access an invalid object id
+#define DFS_NVAL_ID (dfs_err)18
+///@brief Attempted to remove a directory that still holds entries
+#define DFS_DIR_NOT_EMPTY (dfs_err)19
+///@brief Failed to write to a host file descriptor
+#define DFS_FAILED_FD_WRITE (dfs_err)20
+///@brief An object id no longer leads to its object
+#define DFS_FAILED_ENTRY_LOOKUP (dfs_err)21
 
 //===File mode flags===
 #define DFS_FILEM_READ (dfs_filem_flags)0x00000001
@@ -80,6 +95,16 @@ typedef struct
 #define DFS_FILEM_SHARE_READ (dfs_filem_flags)0x00000004
 #define DFS_FILEM_SHARE_WRITE (dfs_filem_flags)0x00000008
 #define DFS_FILEM_SHARE_RDWR (DFS_FILEM_SHARE_READ | DFS_FILEM_SHARE_WRITE)
+#define DFS_FILEM_BUFFERED (dfs_filem_flags)0x00000010
+#define DFS_FILEM_APPEND (dfs_filem_flags)0x00000020
+
+//===File creation flags===
+#define DFS_FILEC_FILE (dfs_filec_flags)0x0000
+#define DFS_FILEC_DIR (dfs_filec_flags)0x0001
+#define DFS_FILEC_READONLY (dfs_filec_flags)0x0002
+#define DFS_FILEC_SYSTEM (dfs_filec_flags)0x0004
+#define DFS_FILEC_HIDDEN (dfs_filec_flags)0x0008
+#define DFS_FILEC_ALL (DFS_FILEC_DIR | DFS_FILEC_READONLY | DFS_FILEC_SYSTEM | DFS_FILEC_HIDDEN)
 
 //===Logging levels===
 #define DFS_LOG_NONE 0
@@ -117,6 +142,16 @@ dfs_err dfs_pcreate(const char *device, size_t total_size);
  * @return int containing the error code for the operation
  */
 dfs_err dfs_popen(const char *device, dfs_partition **pt);
+/**
+ * @brief Opens an existing partition without ever writing to the file/device
+ * 
+ * Creating objects and opening files for writing are refused with DFS_UNAUTHORIZED_ACCESS
+ * 
+ * @param device Path to the file/device to use
+ * @param pt Pointer to a partition handle pointer
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_popen_readonly(const char *device, dfs_partition **pt);
 /**
  * @brief Closes an open partition, releasing all associated resources
  * 
@@ -125,6 +160,34 @@ dfs_err dfs_popen(const char *device, dfs_partition **pt);
  */
 dfs_err dfs_pclose(dfs_partition *pt);
 
+/**
+ * @brief Opens a directory handle, used to resolve paths relative to it
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param path Path of the directory to be opened
+ * @param dir_descriptor Pointer to the directory descriptor to populate
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_dopen(dfs_partition *pt, const char *path, int *dir_descriptor);
+/**
+ * @brief Opens a directory handle, with path relative to another open directory
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param dir_descriptor Descriptor of the directory path is relative to, or DFS_DIR_ROOT
+ * @param path Path of the directory to be opened
+ * @param new_dir_descriptor Pointer to the directory descriptor to populate
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_dopen_at(dfs_partition *pt, const int dir_descriptor, const char *path, int *new_dir_descriptor);
+/**
+ * @brief Closes an open directory handle
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param dir_descriptor Descriptor of the directory to be closed
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_dclose(dfs_partition *pt, const int dir_descriptor);
+
 /**
  * @brief Creates an empty directory at the specified path
  * 
@@ -133,6 +196,15 @@ dfs_err dfs_pclose(dfs_partition *pt);
  * @return int containing the error code for the operation
  */
 dfs_err dfs_dcreate(dfs_partition *pt, const char *path);
+/**
+ * @brief Creates an empty directory, with path relative to an open directory
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param dir_descriptor Descriptor of the directory path is relative to, or DFS_DIR_ROOT
+ * @param path Path of the directory to be created
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_dcreate_at(dfs_partition *pt, const int dir_descriptor, const char *path);
 /**
  * @brief Create an empty file at the specified path
  * 
@@ -141,6 +213,148 @@ dfs_err dfs_dcreate(dfs_partition *pt, const char *path);
  * @return int containing the error code for the operation
  */
 dfs_err dfs_fcreate(dfs_partition *pt, const char *path);
+/**
+ * @brief Create an empty file, with path relative to an open directory
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param dir_descriptor Descriptor of the directory path is relative to, or DFS_DIR_ROOT
+ * @param path Path of the file to be created
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_fcreate_at(dfs_partition *pt, const int dir_descriptor, const char *path);
+/**
+ * @brief Creates an empty object with the given flags, with path relative to an open directory
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param dir_descriptor Descriptor of the directory path is relative to, or DFS_DIR_ROOT
+ * @param path Path of the object to be created
+ * @param flags File creation flags to be used
+ * @param id Referenced variable will be set to the id of the new object. Can be set to NULL
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_ocreate_at(dfs_partition *pt, const int dir_descriptor, const char *path, const dfs_filec_flags flags, dfs_obj_id *id);
+/**
+ * @brief Creates many empty files/directories in a single call
+ * 
+ * Paths are grouped by parent directory, so each parent is resolved and scanned once,
+ * and the first blocks of all new objects are reserved in a single block map update.
+ * A path may have its parent created earlier in the same call.
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param paths Array of paths of the objects to be created
+ * @param flags File creation flags to be used for every object
+ * @param n Number of paths in paths
+ * @param results Array of n error codes, one per path. Can be set to NULL
+ * @return int containing the error code of the first path that failed, DFS_SUCCESS if none did
+ */
+dfs_err dfs_create_many(dfs_partition *pt, const char **paths, const dfs_filec_flags flags, const size_t n, dfs_err *results);
+/**
+ * @brief Removes a file
+ * 
+ * The entry is removed right away, the file's blocks are released in the background
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param path Path of the file to be removed, the file must not be open
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_frm(dfs_partition *pt, const char *path);
+/**
+ * @brief Removes a file, with path relative to an open directory
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param dir_descriptor Descriptor of the directory path is relative to, or DFS_DIR_ROOT
+ * @param path Path of the file to be removed, the file must not be open
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_frm_at(dfs_partition *pt, const int dir_descriptor, const char *path);
+/**
+ * @brief Removes an empty directory
+ * 
+ * The entry is removed right away, the directory's blocks are released in the background
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param path Path of the directory to be removed, the directory must not be open
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_drm(dfs_partition *pt, const char *path);
+/**
+ * @brief Removes an empty directory, with path relative to an open directory
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param dir_descriptor Descriptor of the directory path is relative to, or DFS_DIR_ROOT
+ * @param path Path of the directory to be removed, the directory must not be open
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_drm_at(dfs_partition *pt, const int dir_descriptor, const char *path);
+/**
+ * @brief Removes a directory and everything below it
+ * 
+ * The tree is read once and its entry is removed, then all of its blocks are released in a single
+ * block map update. Nothing is removed if any object in the tree is open or read-only
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param path Path of the directory to be removed
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_rmtree(dfs_partition *pt, const char *path);
+/**
+ * @brief Removes a directory and everything below it, with path relative to an open directory
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param dir_descriptor Descriptor of the directory path is relative to, or DFS_DIR_ROOT
+ * @param path Path of the directory to be removed
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_rmtree_at(dfs_partition *pt, const int dir_descriptor, const char *path);
+/**
+ * @brief Moves or renames a file or directory
+ * 
+ * Only the object's entry is moved, its data stays in place and open handles keep working.
+ * An existing file at new_path is replaced in a single entry write, so readers see either the
+ * old or the new file. Directories cannot replace existing objects or be moved below themselves
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param old_path Path of the object to be moved
+ * @param new_path New path of the object, its parent directory must exist
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_rename(dfs_partition *pt, const char *old_path, const char *new_path);
+/**
+ * @brief Moves or renames a file or directory, with paths relative to an open directory
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param dir_descriptor Descriptor of the directory both paths are relative to, or DFS_DIR_ROOT
+ * @param old_path Path of the object to be moved
+ * @param new_path New path of the object, its parent directory must exist
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_rename_at(dfs_partition *pt, const int dir_descriptor, const char *old_path, const char *new_path);
+
+/**
+ * @brief Copies a file into a new file inside the same partition
+ * 
+ * Data is moved in batches of blocks without going through the caller, blocks of the copy are reserved
+ * together so they can be placed side by side. Holes of sparse files stay holes in the copy.
+ * Sources open for writing are not copied, and cannot be opened for writing while they are copied.
+ * The copy cannot be opened at all until it is complete.
+ * Every block is duplicated, the copy never shares blocks with the source
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param src_path Path of the file to be copied
+ * @param dst_path Path of the new file, it must not exist
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_fcopy(dfs_partition *pt, const char *src_path, const char *dst_path);
+/**
+ * @brief Copies a file into a new file inside the same partition, with paths relative to an open directory
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param dir_descriptor Descriptor of the directory both paths are relative to, or DFS_DIR_ROOT
+ * @param src_path Path of the file to be copied
+ * @param dst_path Path of the new file, it must not exist
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_fcopy_at(dfs_partition *pt, const int dir_descriptor, const char *src_path, const char *dst_path);
 
 /**
  * @brief Opens an existing file at the specified path
@@ -152,6 +366,27 @@ dfs_err dfs_fcreate(dfs_partition *pt, const char *path);
  * @return int containing the error code for the operation
  */
 dfs_err dfs_fopen(dfs_partition *pt, const char *path, const dfs_filem_flags flags, int *descriptor);
+/**
+ * @brief Opens an existing file, with path relative to an open directory
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param dir_descriptor Descriptor of the directory path is relative to, or DFS_DIR_ROOT
+ * @param path Path of the file to be opened
+ * @param flags File mode flags to be used
+ * @param descriptor Pointer to the file descriptor to populate
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_fopen_at(dfs_partition *pt, const int dir_descriptor, const char *path, const dfs_filem_flags flags, int *descriptor);
+/**
+ * @brief Opens an existing file by object id, skipping path resolution
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param id Id of the file to be opened, as returned by listings, stat or creation
+ * @param flags File mode flags to be used
+ * @param descriptor Pointer to the file descriptor to populate
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_fopen_by_id(dfs_partition *pt, const dfs_obj_id id, const dfs_filem_flags flags, int *descriptor);
 /**
  * @brief Closes an open file handle and flushes buffered changes
  * 
@@ -161,9 +396,27 @@ dfs_err dfs_fopen(dfs_partition *pt, const char *path, const dfs_filem_flags fla
  */
 dfs_err dfs_fclose(dfs_partition *pt, const int descriptor);
 
+/**
+ * @brief Writes buffered data of a handle opened with DFS_FILEM_BUFFERED to the partition
+ * 
+ * Buffered writes are not visible to other handles until flushed. Buffers are also flushed when
+ * full, and before seeking, reading or closing through the same handle. Blocks for buffered
+ * data are only allocated on flush, together, so files written in small pieces stay contiguous.
+ * Small reads through buffered handles are served from a copy of the current block, which is
+ * refreshed whenever the file is written through any handle
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param descriptor Descriptor of the file to be flushed
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_fflush(dfs_partition *pt, const int descriptor);
+
 /**
  * @brief Writes a block of data to a file
  * 
+ * Handles opened with DFS_FILEM_APPEND always write at the current end of the file, even if
+ * other handles have grown it since, and leave the stream position after the written data
+ * 
  * @param pt Pointer to a partition handle to be used
  * @param descriptor Descriptor of the file to be written to
  * @param buffer Pointer to the buffer to write the data from
@@ -184,7 +437,69 @@ dfs_err dfs_fwrite(dfs_partition *pt, const int descriptor, const void *buffer,
  */
 dfs_err dfs_fread(dfs_partition *pt, const int descriptor, void *buffer, const size_t len, size_t *read);
 /**
- * @brief Sets the stream position
+ * @brief Writes a block of data to a file at the given offset, without moving the stream position
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param descriptor Descriptor of the file to be written to
+ * @param offset Offset in the file to start writing at, writing past the end grows the file. DFS_FILEM_APPEND is ignored
+ * @param buffer Pointer to the buffer to write the data from
+ * @param len Length in bytes of the data to be written
+ * @param written Referenced variable will be set to the actual number of bytes written
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_pwrite(dfs_partition *pt, const int descriptor, const size_t offset, const void *buffer, const size_t len, size_t *written);
+/**
+ * @brief Reads a block of data from a file at the given offset, without moving the stream position
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param descriptor Descriptor of the file to be read from
+ * @param offset Offset in the file to start reading at
+ * @param buffer Pointer to a buffer to read the data to
+ * @param len Length in bytes of the data to be read
+ * @param read Referenced variable will be set to the actual number of bytes read
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_pread(dfs_partition *pt, const int descriptor, const size_t offset, void *buffer, const size_t len, size_t *read);
+/**
+ * @brief Sends file data at the given offset to a host file descriptor, without moving the stream position
+ * 
+ * Each block's data goes from the device to out_fd with sendfile, without passing through user-space buffers.
+ * Holes, and descriptors sendfile cannot write to, are served through a single block buffer instead.
+ * Data is written at the current position of out_fd, like with write
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param descriptor Descriptor of the file to be sent
+ * @param out_fd Host file descriptor to write the data to, such as a socket, pipe or regular file
+ * @param offset Offset in the file to start sending at
+ * @param len Length in bytes of the data to be sent
+ * @param sent Referenced variable will be set to the actual number of bytes sent, also when sending fails midway
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_fsendfile(dfs_partition *pt, const int descriptor, const int out_fd, const size_t offset, const size_t len, size_t *sent);
+/**
+ * @brief Writes the contents of several buffers to a file as one contiguous write
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param descriptor Descriptor of the file to be written to
+ * @param iov Array of buffers to write the data from, in order
+ * @param iovcnt Number of buffers in iov
+ * @param written Referenced variable will be set to the actual number of bytes written
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_fwritev(dfs_partition *pt, const int descriptor, const struct iovec *iov, const int iovcnt, size_t *written);
+/**
+ * @brief Reads a contiguous region of a file into several buffers
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param descriptor Descriptor of the file to be read from
+ * @param iov Array of buffers to read the data to, each is filled before moving to the next
+ * @param iovcnt Number of buffers in iov
+ * @param read Referenced variable will be set to the actual number of bytes read
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_freadv(dfs_partition *pt, const int descriptor, const struct iovec *iov, const int iovcnt, size_t *read);
+/**
+ * @brief Sets the stream position, positions past the end only grow the file once written to
  * 
  * @param pt Pointer to a partition handle to be used
  * @param descriptor Descriptor of the file to be read from
@@ -192,6 +507,20 @@ dfs_err dfs_fread(dfs_partition *pt, const int descriptor, void *buffer, const s
  * @return int containing the error code for the operation
  */
 dfs_err dfs_fseek(dfs_partition *pt, const int descriptor, const size_t offset, const int whence);
+/**
+ * @brief Shrinks or grows a file to the given size
+ * 
+ * Blocks past the new end are released once reads started before the call are done. Grown ranges
+ * read as zeros and only the block holding the new last byte is allocated. Stream positions of
+ * open handles are left unchanged. Files, holes included, cannot grow past the partition's block
+ * count; larger sizes, and writes reaching past it, fail with DFS_NVAL_ARGS
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param descriptor Descriptor of the file to be truncated, must be open for writing
+ * @param size The new size of the file in bytes
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_ftruncate(dfs_partition *pt, const int descriptor, const size_t size);
 /**
  * @brief Gets the stream position
  * 
@@ -212,4 +541,24 @@ dfs_err dfs_fget_pos(dfs_partition *pt, const int descriptor, size_t *pos);
  * @param count Used to return the nunmber of entries available
 */
 dfs_err dfs_dlist_entries(dfs_partition *pt, const char *path, size_t capacity, dfs_entry *entries, size_t *count);
+/**
+ * @brief Lists entries present in a directory, with path relative to an open directory
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param dir_descriptor Descriptor of the directory path is relative to, or DFS_DIR_ROOT
+ * @param path Path of the directory whose contents should be listed, empty for the directory itself
+ * @param capacity Maximum number of entries that may be stored in entries
+ * @param entries Pointer to an array to store the found entries. Can be set to NULL, if capacity is zero
+ * @param count Used to return the nunmber of entries available
+*/
+dfs_err dfs_dlist_entries_at(dfs_partition *pt, const int dir_descriptor, const char *path, size_t capacity, dfs_entry *entries, size_t *count);
+/**
+ * @brief Gets information about an object by object id, skipping path resolution
+ * 
+ * @param pt Pointer to a partition handle to be used
+ * @param id Id of the object, as returned by listings or creation
+ * @param entry Referenced variable will be set to the object's information
+ * @return int containing the error code for the operation
+ */
+dfs_err dfs_stat_by_id(dfs_partition *pt, const dfs_obj_id id, dfs_entry *entry);
 #endif
@@ -17,18 +17,20 @@ static size_t blk_idx_to_addr(const dfs_partition *partition, const blk_idx_t in
 static size_t blk_off_to_addr(const dfs_partition *partition, const blk_idx_t index, const size_t offset);
 static size_t entry_loc_to_addr(const dfs_partition *partition, const entry_ptr_loc entry_loc);
 static entry_ptr_loc get_root_loc();
+static dfs_obj_id entry_loc_to_id(const entry_ptr_loc entry_loc, const entry_pointer *entry);
+static uint32_t entry_id_check(const entry_pointer *entry);
+static entry_ptr_loc id_to_entry_loc(const dfs_obj_id id);
 #pragma endregion
 
 #pragma region Device helpers
-off_t device_seek(const int whence, const size_t offset, const dfs_partition *partition);
-ssize_t device_write(void *buffer, const size_t len, const dfs_partition *partition);
-ssize_t device_write_at(const size_t addr, void *buffer, const size_t len, const dfs_partition *partition);
-ssize_t device_write_at_blk(const blk_idx_t index, void *buffer, const size_t len, const dfs_partition *partition);
-ssize_t device_write_at_entry_loc(const entry_ptr_loc entry_loc, entry_pointer *buffer, const dfs_partition *partition);
-ssize_t device_read(void *buffer, const size_t len, const dfs_partition *partition);
+ssize_t device_write_at(const size_t addr, const void *buffer, const size_t len, const dfs_partition *partition);
+ssize_t device_write_at_blk(const blk_idx_t index, const void *buffer, const size_t len, const dfs_partition *partition);
+ssize_t device_write_at_entry_loc(const entry_ptr_loc entry_loc, const entry_pointer *buffer, const dfs_partition *partition);
 ssize_t device_read_at(const size_t addr, void *buffer, const size_t len, const dfs_partition *partition);
 ssize_t device_read_at_blk(const blk_idx_t index, void *buffer, const size_t len, const dfs_partition *partition);
 ssize_t device_read_at_entry_loc(const entry_ptr_loc entry_loc, void *buffer, const dfs_partition *partition);
+ssize_t device_writev_at(const size_t addr, const struct iovec *iov, const int iovcnt, const dfs_partition *partition);
+ssize_t device_readv_at(const size_t addr, const struct iovec *iov, const int iovcnt, const dfs_partition *partition);
 static dfs_err force_allocate_space(const char *device, size_t size);
 #pragma endregion
 
@@ -38,33 +40,88 @@ static size_t determine_size_from_blk_count(size_t blk_count);
 static size_t determine_blk_count(size_t maxSize, size_t *partition_size);
 static dfs_err init_empty_partition(const char *device, size_t blk_count);
 static dfs_err validate_partition_header(const dfs_partition *pt);
-static dfs_err set_stream_pos(dfs_partition *pt, const size_t position, dfs_file *file);
-static dfs_err advance_stream(dfs_partition *pt, size_t offset, dfs_file *file);
-static dfs_err rewind_stream(dfs_partition *pt, dfs_file *file);
+static dfs_err open_partition(const char *device, const bool read_only, dfs_partition **pt);
 #pragma endregion
 
 #pragma region Block navigation
-static dfs_err find_entry_ptr(const dfs_partition *pt, const char *path, entry_pointer *entry, entry_ptr_loc *entry_loc);
-static dfs_err find_entry_ptr_recursion(const dfs_partition *pt, const blk_idx_t cur_blk, const char *path, entry_pointer *entry, entry_ptr_loc *entry_loc);
-static dfs_err find_free_blk(const dfs_partition *pt, blk_idx_t *index);
+static dfs_err find_entry_ptr(const dfs_partition *pt, const dfs_dir *base, const char *path, entry_pointer *entry, entry_ptr_loc *entry_loc);
+static dfs_err find_entry_in_dir(const dfs_partition *pt, const blk_idx_t first_blk, const char *name, entry_pointer *entry, entry_ptr_loc *entry_loc, blk_idx_t *last_blk_idx, block_header *last_blk, blk_idx_t *removed_blk);
+static dfs_err find_free_blks(const dfs_partition *pt, const size_t count, blk_idx_t *indices, size_t *found);
+static dfs_err find_free_run(const dfs_partition *pt, const blk_idx_t goal, const size_t count, blk_idx_t *indices, size_t *found);
+static uint16_t entry_name_hash(const char *name);
+static void entry_copy_name(char *dst, const char *name);
 #pragma endregion
 
 #pragma region Block manipulation
-static dfs_err append_blk_to_file(const dfs_partition *pt, const entry_ptr_loc entry_loc, blk_idx_t *new_blk_idx, dfs_file *handle);
-static dfs_err append_entry_to_dir(const dfs_partition *pt, const entry_ptr_loc dir_entryLoc, entry_pointer new_entry);
+static dfs_err alloc_blk(const dfs_partition *pt, blk_idx_t *index);
+static dfs_err alloc_blks(const dfs_partition *pt, const blk_idx_t goal, const size_t count, blk_idx_t *indices, size_t *found);
+static dfs_err release_blks(const dfs_partition *pt, const blk_idx_t *indices, const size_t count);
+static dfs_err append_blk_to_file(const dfs_partition *pt, const entry_ptr_loc entry_loc, blk_idx_t *new_blk_idx, const size_t holes, open_object *obj);
+static dfs_err open_object_append_blks(dfs_partition *pt, open_object *obj, const size_t count, const size_t holes);
+static bool file_size_fits(const dfs_partition *pt, const size_t size);
+static void open_object_drop_reserved(dfs_partition *pt, open_object *obj, const size_t chain_len, const blk_idx_t *indices, const size_t count);
+static void open_object_trim_reserved(dfs_partition *pt, open_object *obj);
+static dfs_err open_object_extend(dfs_partition *pt, open_object *obj, const size_t new_size, const bool zero_fill);
+static dfs_err open_object_grow_blk(dfs_partition *pt, open_object *obj, const size_t chain_idx, const size_t old_used, const size_t used, const bool zero_fill);
+static dfs_err open_object_shrink(dfs_partition *pt, open_object *obj, const size_t new_size);
+static dfs_err open_object_fill_hole(dfs_partition *pt, open_object *obj, const size_t chain_idx);
+static unsigned open_object_read_begin(open_object *obj);
+static void open_object_read_end(open_object *obj, const unsigned epoch);
+static void open_object_wait_readers(open_object *obj);
+static dfs_err zero_blk_range(const dfs_partition *pt, const blk_idx_t blk_idx, const size_t from, const size_t to);
+static dfs_err object_write_at(dfs_partition *pt, open_object *obj, const size_t offset, const void *buffer, const size_t len, size_t *written);
+static dfs_err object_read_at(dfs_partition *pt, open_object *obj, const size_t offset, void *buffer, const size_t len, size_t *read);
+static dfs_err object_writev_at(dfs_partition *pt, open_object *obj, const size_t offset, const struct iovec *iov, const int iovcnt, size_t *written);
+static dfs_err object_readv_at(dfs_partition *pt, open_object *obj, const size_t offset, const struct iovec *iov, const int iovcnt, size_t *read);
+static dfs_err object_readv_blks(dfs_partition *pt, open_object *obj, const size_t offset, const struct iovec *iov, const int iovcnt, size_t *read);
+static dfs_err object_send_at(dfs_partition *pt, open_object *obj, const size_t offset, const int out_fd, const size_t len, size_t *sent);
+static dfs_err object_send_blks(dfs_partition *pt, open_object *obj, const size_t offset, const int out_fd, const size_t len, size_t *sent);
+static dfs_err fd_send_device(const dfs_partition *pt, const size_t addr, const int out_fd, const size_t len, bool *supported, size_t *sent);
+static dfs_err fd_write_all(const int out_fd, char *buffer, const size_t len, size_t *written);
+static int iov_gather(const struct iovec *iov, const int iovcnt, int *iov_idx, size_t *iov_off, const size_t max_len, struct iovec *segs, size_t *seg_len);
+static dfs_err append_entries_to_dir(const dfs_partition *pt, const entry_ptr_loc dir_entryLoc, blk_idx_t last_blk_idx, block_header last_blk, const entry_pointer *new_entries, size_t count, entry_ptr_loc *new_locs, size_t *appended);
 #pragma endregion
 
 #pragma region File manipulation
-static dfs_err create_object(dfs_partition *pt, const char *path, const uint16_t flags);
+static dfs_err create_object(dfs_partition *pt, const dfs_dir *base, const char *path, const uint16_t flags, entry_ptr_loc *new_loc);
+static dfs_err create_many_in_dir(dfs_partition *pt, create_request *requests, size_t count, const uint16_t flags, blk_idx_t *free_blks, size_t *free_used, size_t free_count, dfs_err *results);
+static dfs_err mark_existing_names(const dfs_partition *pt, const blk_idx_t first_blk, create_request *requests, size_t count, dfs_err *results, blk_idx_t *last_blk_idx, block_header *last_blk);
+static dfs_err remove_object(dfs_partition *pt, const dfs_dir *base, const char *path, const bool dir);
+static dfs_err remove_entry(dfs_partition *pt, const entry_ptr_loc entry_loc);
+static dfs_err reuse_removed_entry(const dfs_partition *pt, const blk_idx_t blk_idx, entry_pointer *entry, entry_ptr_loc *new_loc);
+static dfs_err dir_is_empty(const dfs_partition *pt, const blk_idx_t first_blk, bool *empty);
+static dfs_err remove_tree(dfs_partition *pt, const dfs_dir *base, const char *path);
+static dfs_err collect_tree_blks(dfs_partition *pt, const blk_idx_t first_blk, blk_idx_t **blks, size_t *count, size_t *cap);
+static dfs_err collect_chain_blks(const dfs_partition *pt, const blk_idx_t first_blk, blk_idx_t **blks, size_t *count, size_t *cap);
+static dfs_err rename_object(dfs_partition *pt, const dfs_dir *base, const char *old_path, const char *new_path);
+static dfs_err relink_entry(dfs_partition *pt, const entry_ptr_loc src_loc, const char *name, const entry_ptr_loc *target, const entry_ptr_loc parent_loc,
+	const blk_idx_t removed_blk, const blk_idx_t dir_last_blk_idx, const block_header dir_last_blk, entry_ptr_loc *new_loc);
+static dfs_err path_crosses_entry(const dfs_partition *pt, const dfs_dir *base, const char *path, const entry_ptr_loc entry_loc, bool *crosses);
+static dfs_err open_copy_objects(dfs_partition *pt, const dfs_dir *base, const char *src_path, const char *dst_path, open_object **src, open_object **dst);
+static dfs_err copy_object_data(dfs_partition *pt, open_object *src, open_object *dst);
+static dfs_err blk_array_push(blk_idx_t **array, size_t *count, size_t *cap, const blk_idx_t blk_idx);
+static int compare_requests_by_parent(const void *a, const void *b);
+static int compare_requests_by_name(const void *a, const void *b);
 static dfs_err determine_file_size(dfs_partition *pt, const entry_pointer entry, size_t *size);
+static dfs_err read_entry_by_id(const dfs_partition *pt, const dfs_obj_id id, entry_pointer *entry, entry_ptr_loc *entry_loc);
+static dfs_err fill_entry_info(dfs_partition *pt, const entry_pointer entry, const entry_ptr_loc entry_loc, dfs_entry *info);
 static bool object_is_file(entry_pointer entry);
+static bool entry_is_removed(entry_pointer entry);
 #pragma endregion
 
 #pragma region File handles
-static dfs_err handle_can_open(dfs_partition *pt, const char *path, const dfs_filem_flags flags, bool *can_open);
+static dfs_err handle_can_open(dfs_partition *pt, const entry_ptr_loc entry_loc, const dfs_filem_flags flags, bool *can_open);
+static dfs_err handle_acquire_object(dfs_partition *pt, const entry_pointer entry, const entry_ptr_loc entry_loc, const dfs_filem_flags flags, open_object **obj);
+static dfs_err handle_open(dfs_partition *pt, const entry_pointer entry, const entry_ptr_loc entry_loc, const dfs_filem_flags flags, int *descriptor);
 static dfs_err handle_get(dfs_partition *pt, const int descriptor, dfs_file **file);
+static dfs_err dir_handle_get(dfs_partition *pt, const int dir_descriptor, dfs_dir **dir);
+static bool dir_handle_open(const dfs_partition *pt, const entry_ptr_loc entry_loc);
+static void dir_handles_relocate(dfs_partition *pt, const entry_ptr_loc from, const entry_ptr_loc to);
+static dfs_err handle_flush(dfs_partition *pt, dfs_file *file);
+static void handle_drop_buffered(dfs_file *file, const size_t len);
+static size_t handle_write_pos(const dfs_file *file);
+static dfs_err handle_read_buffered(dfs_partition *pt, dfs_file *file, void *buffer, const size_t len, size_t *read);
 
-static bool handle_open_flags_compatible(const dfs_filem_flags new, const dfs_filem_flags open);
 static bool object_is_writable(entry_pointer entry);
 #pragma endregion
 
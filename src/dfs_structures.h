@@ -5,6 +5,8 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "dfs.h"
 #include "paths.h"
@@ -16,6 +18,22 @@
 #define MAGIC_NUMBER 0x69ADDE69
 #define MAX_BLKS 0xFFFFFFFF
 #define MAX_PARTITION_CAPACITY MAX_BLKS * BLOCK_DATA_SIZE
+#define DIR_FILTER_BITS 8192
+#define DIR_FILTER_HASHES 3
+#define DIR_FILTER_BUCKETS 1024
+#define DIR_FILTER_MAX_COUNT 4096
+#define HANDLE_PAGE_SLOTS 64
+#define HANDLE_DIR_MIN_PAGES 4
+#define OPEN_OBJECT_BUCKETS 256
+#define OPEN_OBJECT_CHAIN_MIN 16
+#define OPEN_OBJECT_MAX_RETIRED 32 //Chains double from OPEN_OBJECT_CHAIN_MIN, at most 28 times for MAX_BLKS
+#define BLK_IDX_HOLE (blk_idx_t)0xFFFFFFFF //Marks sparse file blocks in chain indices, never a valid block
+#define DEVICE_IOV_MAX 64 //Segments per vectored device call, well below IOV_MAX
+#define RECLAIM_BATCH 1024 //Blocks released per block map update by the reclaimer
+#define HANDLE_WBUF_SIZE (4 * BLOCK_DATA_SIZE) //Dirty bytes a buffered handle holds, blocks are only reserved on flush
+#define COPY_BATCH 64 //Blocks moved per write when copying files, also the most read by one device call
+#define OBJ_ID_ENTRY_BITS 10 //Low object id bits holding the entry index, ENTRIES_PER_BLK fits
+#define OBJ_ID_CHECK_MASK 0x3FFFFF //Object id bits above the entry index, checked against the entry to reject stale ids
 
 #pragma region Entry flags
 #define ENTRY_FLAG_EMPTY (file_flags_t)0x0000
@@ -25,6 +43,9 @@
 #define ENTRY_FLAG_READONLY (file_flags_t)0x0002
 #define ENTRY_FLAG_SYSTEM (file_flags_t)0x0004
 #define ENTRY_FLAG_HIDDEN (file_flags_t)0x0008
+#define ENTRY_FLAG_REMOVED (file_flags_t)0x0010 //Slot of a removed entry, kept so the other entries of the block don't move
+#define ENTRY_GEN_SHIFT 8 //Flag bits from here on count how often the slot was reused, object ids carry them
+#define ENTRY_GEN_MASK (file_flags_t)0xFF00
 #pragma endregion
 
 
@@ -35,13 +56,99 @@ typedef uint16_t file_flags_t;
 
 
 
+//==="Physical" representations===
+typedef struct
+{
+	uint32_t magic_number;
+	blk_idx_t block_count;
+	uint64_t resvd;
+} __attribute__((packed)) partition_header;
+
+typedef struct
+{
+	blk_idx_t prev_blk;
+	blk_idx_t next_blk;
+	uint32_t used_space; //Could be 16-bit since block can hold up to 32K-16 < 64K
+	uint32_t holes; //Unallocated blocks of zeros preceding this one in a file, removed entries in a directory block
+} __attribute__((packed)) block_header;
+
+typedef struct 
+{
+	blk_idx_t first_blk;
+	blk_idx_t last_blk;
+	file_flags_t flags;
+	uint16_t name_hash; //0 for entries written before hashes were stored
+	char name[MAX_PATH_NAME];
+} __attribute__((packed)) entry_pointer;
+
+
+
 //==="Private" logical representations===
 typedef struct
 {
 	size_t length;
 	uint8_t *map;
+	pthread_mutex_t lock; //Held while searching and flagging blocks
+	bool dirty; //A range flush failed, the full map is written on close
 } blk_map;
 
+//Chain of a removed object waiting to be released
+typedef struct reclaim_item
+{
+	blk_idx_t first_blk;
+	struct reclaim_item *next;
+} reclaim_item;
+
+//Background thread releasing the blocks of removed objects
+typedef struct
+{
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond; //Signalled when chains are queued or the partition is closing
+	reclaim_item *head, *tail;
+	bool stopping; //Queued chains are still released before the thread exits
+} reclaimer;
+
+//Bloom filter over the name hashes of a single directory block
+typedef struct dir_filter
+{
+	blk_idx_t blk_idx;
+	struct dir_filter *next;
+	uint8_t bits[DIR_FILTER_BITS >> 3];
+} dir_filter;
+
+typedef struct
+{
+	size_t count;
+	pthread_mutex_t lock; //Lookups may build filters lazily
+	dir_filter *buckets[DIR_FILTER_BUCKETS];
+} dir_filter_table;
+
+typedef struct
+{
+	atomic_bool used[HANDLE_PAGE_SLOTS];
+	_Alignas(16) uint8_t slots[];
+} handle_page;
+
+//Replaced when full, older directories are kept until the table is destroyed for lock-free lookups
+typedef struct handle_dir
+{
+	struct handle_dir *retired;
+	size_t page_cap;
+	handle_page *_Atomic pages[];
+} handle_dir;
+
+//Growable table of handles, pages are never moved so handle pointers stay valid while open
+//Lookups take no lock, allocation and release must hold the partition's handle_lock
+typedef struct
+{
+	size_t elem_size;
+	size_t page_count;
+	handle_dir *_Atomic dir;
+	int *free_next; //Next free slot of each free slot
+	int free_head; //-1 when no slot is free
+} handle_table;
+
 //Set to -1, -1 for root
 typedef struct
 {
@@ -49,63 +156,123 @@ typedef struct
 	uint32_t entry_idx;
 } entry_ptr_loc;
 
+//State shared by every handle open on the same file
+typedef struct open_object
+{
+	entry_ptr_loc entry_loc;
+	struct open_object *next;
+	pthread_mutex_t lock; //Held by writers, readers rely on size being published after the chain
+	size_t refcount;
+	size_t deny_read, deny_write; //Handles not sharing read/write access
+	size_t writers; //Handles with write access
+	atomic_size_t size;
+	_Atomic blk_idx_t *_Atomic chain; //chain[i] holds file data starting at i * BLOCK_DATA_SIZE, or BLK_IDX_HOLE
+	size_t chain_len, chain_cap;
+	_Atomic blk_idx_t *retired_chains[OPEN_OBJECT_MAX_RETIRED]; //Outgrown chains, readers may still hold them
+	size_t retired_count;
+	block_header last_blk;
+	atomic_size_t generation; //Bumped after file data or size change, invalidates read buffers
+	atomic_uint reader_epoch; //Flipped by shrinks, whose dropped blocks wait for the readers of the old epoch
+	atomic_size_t readers[2]; //Lock-free readers in flight, by the parity of the epoch they started in
+} open_object;
+
+typedef struct
+{
+	size_t count;
+	size_t freed; //Objects freed so far, chains loaded outside handle_lock before one was freed may be stale
+	open_object *buckets[OPEN_OBJECT_BUCKETS];
+} open_object_table;
+
+//Single object of a dfs_create_many call
+typedef struct
+{
+	size_t idx;
+	const char *path;
+	size_t parent_len;
+	size_t depth;
+	uint16_t hash;
+	char name[MAX_PATH_NAME + 1];
+} create_request;
+
 typedef struct
 {
 	//Handle tracking
 	bool present;
-	char path[MAX_PATH];
 	dfs_filem_flags flags;
 
 	//Positioning
 	size_t head;
-	blk_idx_t cur_blk_idx, first_blk_idx, last_blk_idx;
-	entry_ptr_loc entry_loc;
+	open_object *obj;
+
+	//Buffering, only allocated with DFS_FILEM_BUFFERED, rbuf shares wbuf's allocation
+	char *wbuf; //Holds the wbuf_len bytes preceding head, up to HANDLE_WBUF_SIZE
+	size_t wbuf_len;
+	char *rbuf; //Holds rbuf_len bytes of the file block starting at rbuf_off
+	size_t rbuf_off, rbuf_len;
+	size_t rbuf_gen; //Object generation rbuf was filled at
 } dfs_file;
 
+typedef struct
+{
+	entry_ptr_loc entry_loc;
+	blk_idx_t first_blk_idx;
+} dfs_dir;
+
+//Lock order: meta_lock, handle_lock, open_object lock, dir_filters lock, usage_map lock, reclaimer lock
 struct dfs_partition
 {
+	pthread_rwlock_t meta_lock; //Directory tree and entries
+	pthread_mutex_t handle_lock; //Handle tables and open object table
 	int device;
+	bool read_only;
 	size_t root_blk_addr;
 	uint32_t blk_count;
 	blk_map *usage_map;
-	dfs_file open_handles[DFS_MAX_HANDLES];
+	reclaimer *reclaimer; //NULL on read-only partitions
+	dir_filter_table *dir_filters;
+	open_object_table *open_objects;
+	handle_table open_handles;
+	dfs_dir root_dir;
+	handle_table open_dirs;
 };
 
 
 
-//==="Physical" representations===
-typedef struct
-{
-	uint32_t magic_number;
-	blk_idx_t block_count;
-	uint64_t resvd;
-} __attribute__((packed)) partition_header;
-
-typedef struct
-{
-	blk_idx_t prev_blk;
-	blk_idx_t next_blk;
-	uint32_t used_space; //Could be 16-bit since block can hold up to 32K-16 < 64K
-	uint32_t resvd;
-} __attribute__((packed)) block_header;
-
-typedef struct 
-{
-	blk_idx_t first_blk;
-	blk_idx_t last_blk;
-	file_flags_t flags;
-	uint16_t resvd;
-	char name[MAX_PATH_NAME];
-} __attribute__((packed)) entry_pointer;
-
-
 //"Private" logical representation methods
-static int get_lowest_unused_descriptor(const dfs_partition pt);
+static void handle_table_init(handle_table *table, size_t elem_size);
+static dfs_err handle_table_alloc(handle_table *table, int *descriptor, void **slot);
+static void *handle_table_get(const handle_table *table, int descriptor);
+static dfs_err handle_table_release(handle_table *table, int descriptor);
+static void handle_table_destroy(handle_table *table);
 
 static dfs_err load_blk_map(dfs_partition *host);
 static dfs_err get_blk_used(const dfs_partition *pt, blk_idx_t blk_idx, bool *used);
 static dfs_err set_blk_used(const dfs_partition *pt, blk_idx_t blk_idx, bool used);
 static dfs_err flush_full_blk_map(const dfs_partition *pt);
-//static int flush_blk_map_changes(dfs_partition *pt);
+static dfs_err flush_blk_map_range(const dfs_partition *pt, blk_idx_t first_blk_idx, blk_idx_t last_blk_idx);
 static dfs_err destroy_blk_map(dfs_partition *pt);
+
+static dfs_err load_reclaimer(dfs_partition *pt);
+static dfs_err reclaimer_queue(const dfs_partition *pt, blk_idx_t first_blk);
+static void *reclaimer_run(void *arg);
+static dfs_err reclaim_chain(const dfs_partition *pt, blk_idx_t first_blk);
+static dfs_err destroy_reclaimer(dfs_partition *pt);
+
+static dfs_err load_dir_filters(dfs_partition *pt);
+static dir_filter *get_dir_filter(const dfs_partition *pt, blk_idx_t blk_idx);
+static dfs_err build_dir_filter(const dfs_partition *pt, blk_idx_t blk_idx, const entry_pointer *entries, size_t count, dir_filter **filter);
+static void dir_filter_add(dir_filter *filter, uint16_t name_hash);
+static bool dir_filter_may_contain(const dir_filter *filter, uint16_t name_hash);
+static dfs_err destroy_dir_filters(dfs_partition *pt);
+
+static dfs_err load_open_objects(dfs_partition *pt);
+static size_t open_object_bucket(const entry_ptr_loc entry_loc);
+static open_object *get_open_object(const dfs_partition *pt, const entry_ptr_loc entry_loc);
+static dfs_err open_object_create(dfs_partition *pt, const entry_pointer entry, const entry_ptr_loc entry_loc, open_object **obj);
+static void open_object_attach(open_object *obj, const dfs_filem_flags flags);
+static void open_object_release(dfs_partition *pt, open_object *obj, const dfs_filem_flags flags);
+static void open_object_relocate(dfs_partition *pt, open_object *obj, const entry_ptr_loc entry_loc);
+static dfs_err open_object_chain_push(open_object *obj, const blk_idx_t blk_idx);
+static void open_object_free(open_object *obj);
+static dfs_err destroy_open_objects(dfs_partition *pt);
 #endif
@@ -7,6 +7,11 @@
 #undef read
 #undef write
 #undef lseek
+#undef pread
+#undef pwrite
+#undef preadv
+#undef pwritev
+#undef sendfile
 #endif
 
 #include <stddef.h>
@@ -16,6 +21,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/types.h>
+#include <pthread.h>
 
 #ifdef MOCK_DEVICE
 
@@ -28,8 +34,15 @@ typedef struct mem_fd_t
 } mem_fd_t;
 
 size_t device_size_limit = ~0u;
+size_t device_write_count = 0;
+int sendfile_errno = 0;
+atomic_int device_write_errno = 0;
+atomic_int device_write_fail_at = 0;
+ssize_t fd_write_budget = -1;
+void (*_Atomic device_read_hook)(void) = NULL;
 static int fd_counter = 0;
 static mem_fd_t files[MAX_FILES];
+static pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER; //Devices may be accessed from many threads
 
 static int file_ensure_capacity(int fd, size_t capacity)
 {
@@ -58,10 +71,9 @@ static int file_ensure_capacity(int fd, size_t capacity)
 	return 0;
 }
 
-int ram_open(const char *pathname, int flags, ...)
+static int ram_open_unlocked(const char *pathname, int flags)
 {
 	//printf("Open with %s and %d\n", pathname, flags);
-	//ignore varargs
 
 	int fd = -1;
 
@@ -104,7 +116,7 @@ int ram_close(int fd)
 	return 0;
 }
 
-ssize_t ram_read(int fd, void *buf, size_t count)
+static ssize_t ram_read_unlocked(int fd, void *buf, size_t count)
 { //Assume valid fd
 	size_t max_count = files[fd].length - files[fd].offset;
 	size_t actual_count = count > max_count ? max_count : count;
@@ -113,7 +125,7 @@ ssize_t ram_read(int fd, void *buf, size_t count)
 	return actual_count;
 }
 
-ssize_t ram_write(int fd, void *buf, size_t count)
+static ssize_t ram_write_unlocked(int fd, const void *buf, size_t count)
 { //Assume valid fd
 	int ret = file_ensure_capacity(fd, files[fd].offset + count);
 	if (ret)
@@ -121,10 +133,11 @@ ssize_t ram_write(int fd, void *buf, size_t count)
 	
 	memcpy(&files[fd].data[files[fd].offset], buf, count);
 	files[fd].offset += count;
+	device_write_count++;
 	return count;
 }
 
-off_t ram_lseek(int fd, off_t offset, int whence)
+static off_t ram_lseek_unlocked(int fd, off_t offset, int whence)
 { //Assume valid fd
 	if (whence == SEEK_SET)
 	{
@@ -154,11 +167,193 @@ off_t ram_lseek(int fd, off_t offset, int whence)
 	return -1;
 }
 
+static int device_write_fails(void)
+{
+	if (device_write_errno)
+	{
+		errno = device_write_errno;
+		return 1;
+	}
+
+	int left = device_write_fail_at;
+	while (left > 0 && !atomic_compare_exchange_weak(&device_write_fail_at, &left, left - 1));
+	if (left == 1)
+	{
+		errno = EIO;
+		return 1;
+	}
+
+	return 0;
+}
+
+static int fd_write_take(size_t *count)
+{
+	if (fd_write_budget < 0)
+		return 0;
+	if (fd_write_budget == 0)
+	{
+		errno = EPIPE;
+		return 1;
+	}
+
+	if (*count > (size_t)fd_write_budget)
+		*count = (size_t)fd_write_budget;
+	fd_write_budget -= (ssize_t)*count;
+	return 0;
+}
+
+int ram_open(const char *pathname, int flags, ...)
+{
+	//ignore varargs
+	pthread_mutex_lock(&files_lock);
+	int ret = ram_open_unlocked(pathname, flags);
+	pthread_mutex_unlock(&files_lock);
+	return ret;
+}
+
+ssize_t ram_read(int fd, void *buf, size_t count)
+{
+	pthread_mutex_lock(&files_lock);
+	ssize_t ret = ram_read_unlocked(fd, buf, count);
+	pthread_mutex_unlock(&files_lock);
+	return ret;
+}
+
+ssize_t ram_write(int fd, void *buf, size_t count)
+{
+	if (fd_write_take(&count))
+		return -1;
+
+	pthread_mutex_lock(&files_lock);
+	ssize_t ret = ram_write_unlocked(fd, buf, count);
+	pthread_mutex_unlock(&files_lock);
+	return ret;
+}
+
+off_t ram_lseek(int fd, off_t offset, int whence)
+{
+	pthread_mutex_lock(&files_lock);
+	off_t ret = ram_lseek_unlocked(fd, offset, whence);
+	pthread_mutex_unlock(&files_lock);
+	return ret;
+}
+
+ssize_t ram_pread(int fd, void *buf, size_t count, off_t offset)
+{ //Assume valid fd, does not move the file offset
+	void (*read_hook)(void) = device_read_hook;
+	if (read_hook)
+		read_hook();
+
+	pthread_mutex_lock(&files_lock);
+	size_t old_offset = files[fd].offset;
+	ssize_t ret = ram_lseek_unlocked(fd, offset, SEEK_SET);
+	if (ret >= 0)
+		ret = ram_read_unlocked(fd, buf, count);
+	files[fd].offset = old_offset;
+	pthread_mutex_unlock(&files_lock);
+	return ret;
+}
+
+ssize_t ram_pwrite(int fd, const void *buf, size_t count, off_t offset)
+{ //Assume valid fd, does not move the file offset
+	if (device_write_fails())
+		return -1;
+
+	pthread_mutex_lock(&files_lock);
+	size_t old_offset = files[fd].offset;
+	ssize_t ret = ram_lseek_unlocked(fd, offset, SEEK_SET);
+	if (ret >= 0)
+		ret = ram_write_unlocked(fd, buf, count);
+	files[fd].offset = old_offset;
+	pthread_mutex_unlock(&files_lock);
+	return ret;
+}
+
+ssize_t ram_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{ //Assume valid fd, does not move the file offset
+	void (*read_hook)(void) = device_read_hook;
+	if (read_hook)
+		read_hook();
+
+	pthread_mutex_lock(&files_lock);
+	size_t old_offset = files[fd].offset;
+	ssize_t ret = ram_lseek_unlocked(fd, offset, SEEK_SET);
+	if (ret >= 0)
+	{
+		ret = 0;
+		for (int i = 0; i < iovcnt; i++)
+			ret += ram_read_unlocked(fd, iov[i].iov_base, iov[i].iov_len);
+	}
+	files[fd].offset = old_offset;
+	pthread_mutex_unlock(&files_lock);
+	return ret;
+}
+
+ssize_t ram_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset)
+{ //Assume valid fd, does not move the file offset
+	if (device_write_fails())
+		return -1;
+
+	pthread_mutex_lock(&files_lock);
+	size_t old_offset = files[fd].offset;
+	ssize_t ret = ram_lseek_unlocked(fd, offset, SEEK_SET);
+	if (ret >= 0)
+	{
+		ret = 0;
+		for (int i = 0; ret >= 0 && i < iovcnt; i++)
+		{
+			ssize_t writec = ram_write_unlocked(fd, iov[i].iov_base, iov[i].iov_len);
+			ret = writec < 0 ? writec : ret + writec;
+		}
+	}
+	files[fd].offset = old_offset;
+	pthread_mutex_unlock(&files_lock);
+	return ret;
+}
+
+ssize_t ram_sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{ //Assume valid fds, writes at out_fd's offset and only moves the in_fd offset through the pointer
+	void (*read_hook)(void) = device_read_hook;
+	if (read_hook)
+		read_hook();
+
+	if (sendfile_errno)
+	{
+		errno = sendfile_errno;
+		return -1;
+	}
+
+	pthread_mutex_lock(&files_lock);
+	if (*offset < 0 || (size_t)*offset >= files[in_fd].length)
+	{
+		pthread_mutex_unlock(&files_lock);
+		return 0;
+	}
+
+	size_t max_count = files[in_fd].length - (size_t)*offset;
+	size_t actual_count = count > max_count ? max_count : count;
+	if (fd_write_take(&actual_count))
+	{
+		pthread_mutex_unlock(&files_lock);
+		return -1;
+	}
+	ssize_t ret = ram_write_unlocked(out_fd, &files[in_fd].data[*offset], actual_count);
+	if (ret > 0)
+		*offset += ret;
+	pthread_mutex_unlock(&files_lock);
+	return ret;
+}
+
 void ram_reset_files(char do_free)
 {
 	for (int i = 0; i < MAX_FILES && do_free; i++)
 		free(files[i].data);
 	memset(files, 0, sizeof(files));
+	sendfile_errno = 0;
+	device_write_errno = 0;
+	device_write_fail_at = 0;
+	fd_write_budget = -1;
+	device_read_hook = NULL;
 	fd_counter = 0;
 }
 #endif
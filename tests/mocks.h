@@ -3,16 +3,29 @@
 
 #include <stddef.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <stdatomic.h>
 
 #ifdef MOCK_DEVICE
 #define MAX_FILES 32
 
 extern size_t device_size_limit;
+extern size_t device_write_count; //Successful write calls on any device
+extern int sendfile_errno; //Fails sendfile with this error when set, reset on setup
+extern atomic_int device_write_errno; //Fails positional (device) writes with this error when set, reset on setup
+extern atomic_int device_write_fail_at; //Fails only the device write this counts down to with EIO, 0 disables, reset on setup
+extern ssize_t fd_write_budget; //Bytes write and sendfile take before failing with EPIPE, calls are cut short to it, negative disables, reset on setup
+extern void (*_Atomic device_read_hook)(void); //Called before every positional read and sendfile when set, reset on setup
 int ram_open(const char *pathname, int flags, ...);
 int ram_close(int fd);
 ssize_t ram_read(int fd, void *buf, size_t count);
 ssize_t ram_write(int fd, void *buf, size_t count);
 off_t ram_lseek(int fd, off_t offset, int whence);
+ssize_t ram_pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t ram_pwrite(int fd, const void *buf, size_t count, off_t offset);
+ssize_t ram_preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+ssize_t ram_pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset);
+ssize_t ram_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
 void ram_reset_files(char do_free);
 #endif
 
@@ -9,6 +9,11 @@
 #define read(fd, buf, count) ram_read(fd, buf, count)
 #define write(fd, buf, count) ram_write(fd, buf, count)
 #define lseek(fd, offset, whence) ram_lseek(fd, offset, whence)
+#define pread(fd, buf, count, offset) ram_pread(fd, buf, count, offset)
+#define pwrite(fd, buf, count, offset) ram_pwrite(fd, buf, count, offset)
+#define preadv(fd, iov, iovcnt, offset) ram_preadv(fd, iov, iovcnt, offset)
+#define pwritev(fd, iov, iovcnt, offset) ram_pwritev(fd, iov, iovcnt, offset)
+#define sendfile(out_fd, in_fd, offset, count) ram_sendfile(out_fd, in_fd, offset, count)
 #endif
 
 #endif
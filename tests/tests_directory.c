@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "framework/unity.h"
 #include "framework/unity_fixture.h"
@@ -8,6 +9,7 @@
 #include "mocks_interface.h"
 
 #include "../src/dfs.h"
+#include "../src/dfs_structures.h"
 
 
 static dfs_err err;
@@ -62,10 +64,295 @@ TEST(directory_good, create_directory_nested)
 	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
 }
 
+TEST(directory_good, lookup_many_entries)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	char name[MAX_PATH_NAME + 1];
+	int fd;
+
+	dfs_dcreate(pt, "many");
+
+	for (int i = 0; i < 24; i++)
+	{
+		snprintf(name, sizeof(name), "many/entry%d", i);
+		err = dfs_fcreate(pt, name);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	}
+
+	for (int i = 23; i >= 0; i--)
+	{
+		snprintf(name, sizeof(name), "many/entry%d", i);
+		err = dfs_fopen(pt, name, DFS_FILEM_READ, &fd);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		dfs_fclose(pt, fd);
+	}
+
+	err = dfs_fopen(pt, "many/entry24", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_PATH_NOT_FOUND, err);
+}
+
+TEST(directory_good, create_directory_multi_block)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	//Needs more blocks than the default partition, one per file and a few for the directory
+	dfs_pclose(pt);
+	dfs_pcreate("./test_directories_big.hex", 40 << 20);
+	dfs_popen("./test_directories_big.hex", &pt);
+
+	char name[MAX_PATH_NAME + 1];
+	int fd;
+	size_t count;
+	int total = ENTRIES_PER_BLK + 64;
+
+	dfs_dcreate(pt, "big");
+
+	for (int i = 0; i < total; i++)
+	{
+		snprintf(name, sizeof(name), "big/e%d", i);
+		err = dfs_fcreate(pt, name);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	}
+
+	err = dfs_fcreate(pt, "big/e0");
+	TEST_ASSERT_EQUAL_INT(DFS_ALREADY_EXISTS, err);
+	err = dfs_fcreate(pt, "big/e1050");
+	TEST_ASSERT_EQUAL_INT(DFS_ALREADY_EXISTS, err);
+
+	err = dfs_dlist_entries(pt, "big", 0, NULL, &count);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(total, count);
+
+	err = dfs_fopen(pt, "big/e1080", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fclose(pt, fd);
+
+	err = dfs_fopen(pt, "big/e5000", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_PATH_NOT_FOUND, err);
+}
+
+TEST(directory_good, create_many)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const char *dirs[] = { "bulk/sub", "bulk" };
+	const char *files[] = { "bulk/a", "bulk/sub/b", "bulk/a", "nodir/c", "top", "bulk/d" };
+	dfs_err results[6];
+	size_t count;
+
+	//Parent of "bulk/sub" is created in the same call
+	err = dfs_create_many(pt, dirs, DFS_FILEC_DIR, 2, results);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, results[0]);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, results[1]);
+
+	err = dfs_create_many(pt, files, DFS_FILEC_FILE, 6, results);
+	TEST_ASSERT_EQUAL_INT(DFS_ALREADY_EXISTS, err);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, results[0]);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, results[1]);
+	TEST_ASSERT_EQUAL_INT(DFS_ALREADY_EXISTS, results[2]);
+	TEST_ASSERT_EQUAL_INT(DFS_PATH_NOT_FOUND, results[3]);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, results[4]);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, results[5]);
+
+	dfs_dlist_entries(pt, "", 0, NULL, &count);
+	TEST_ASSERT_EQUAL_INT(2, count);
+	dfs_dlist_entries(pt, "bulk", 0, NULL, &count);
+	TEST_ASSERT_EQUAL_INT(3, count);
+	dfs_dlist_entries(pt, "bulk/sub", 0, NULL, &count);
+	TEST_ASSERT_EQUAL_INT(1, count);
+
+	err = dfs_fcreate(pt, "bulk/d");
+	TEST_ASSERT_EQUAL_INT(DFS_ALREADY_EXISTS, err);
+}
+
+TEST(directory_good, relative_operations)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	int dd, sub_dd, fd;
+	size_t count;
+	dfs_entry entries[4] = { 0 };
+
+	dfs_dcreate(pt, "work");
+
+	err = dfs_dopen(pt, "work", &dd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	err = dfs_dcreate_at(pt, dd, "sub");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_fcreate_at(pt, dd, "a.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_fcreate_at(pt, dd, "sub/b.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	err = dfs_dlist_entries_at(pt, dd, "", 4, entries, &count);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(2, count);
+
+	err = dfs_dopen_at(pt, dd, "sub", &sub_dd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	err = dfs_fopen_at(pt, sub_dd, "b.file", DFS_FILEM_RDWR, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fclose(pt, fd);
+
+	//Relative and absolute paths reach the same objects
+	err = dfs_fopen(pt, "work/sub/b.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fclose(pt, fd);
+
+	err = dfs_fopen_at(pt, DFS_DIR_ROOT, "work/a.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fclose(pt, fd);
+
+	err = dfs_dclose(pt, sub_dd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_dclose(pt, dd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+}
+
+TEST(directory_good, remove_directory)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	int dd;
+	size_t count;
+	dfs_entry entries[4] = { 0 };
+
+	dfs_dcreate(pt, "gone");
+	dfs_dcreate(pt, "kept");
+	dfs_dopen(pt, "kept", &dd);
+
+	err = dfs_drm(pt, "gone");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	dfs_dlist_entries(pt, "", 4, entries, &count);
+	TEST_ASSERT_EQUAL_INT(1, count);
+	TEST_ASSERT_EQUAL_STRING("kept", entries[0].name);
+
+	//The open handle follows its moved entry
+	err = dfs_fcreate_at(pt, dd, "inner.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_dlist_entries_at(pt, dd, "", 4, entries, &count);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(1, count);
+	dfs_dclose(pt, dd);
+
+	err = dfs_frm(pt, "kept/inner.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_drm(pt, "kept");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	dfs_dlist_entries(pt, "", 0, NULL, &count);
+	TEST_ASSERT_EQUAL_INT(0, count);
+
+	err = dfs_dcreate(pt, "gone");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+}
+
+TEST(directory_good, remove_tree)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const char *paths[] = { "tree", "tree/a", "tree/a/deep", "tree/a/deep/x.file", "tree/a/y.file", "tree/b", "tree/z.file", "sibling.file" };
+	const size_t path_count = sizeof(paths) / sizeof(paths[0]);
+	char data[BLOCK_DATA_SIZE + 100] = { 0 };
+	size_t count, used_before = 0, used_after = 0;
+	dfs_entry entries[4] = { 0 };
+	int fd;
+
+	for (size_t i = 0; i < pt->usage_map->length; i++)
+		used_before += __builtin_popcount(pt->usage_map->map[i]);
+
+	for (size_t i = 0; i < path_count; i++)
+	{
+		if (strstr(paths[i], ".file"))
+			dfs_fcreate(pt, paths[i]);
+		else
+			dfs_dcreate(pt, paths[i]);
+	}
+
+	dfs_fopen(pt, "tree/a/deep/x.file", DFS_FILEM_WRITE, &fd);
+	dfs_fwrite(pt, fd, data, sizeof(data), NULL);
+	dfs_fclose(pt, fd);
+
+	err = dfs_rmtree(pt, "tree");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	err = dfs_dlist_entries(pt, "", 4, entries, &count);
+	TEST_ASSERT_EQUAL_INT(1, count);
+	TEST_ASSERT_EQUAL_STRING("sibling.file", entries[0].name);
+
+	//Only the sibling's block is left
+	for (size_t i = 0; i < pt->usage_map->length; i++)
+		used_after += __builtin_popcount(pt->usage_map->map[i]);
+	TEST_ASSERT_EQUAL_INT(used_before + 1, used_after);
+
+	err = dfs_fopen(pt, "sibling.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fclose(pt, fd);
+
+	err = dfs_dcreate(pt, "tree");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+}
+
+TEST(directory_good, move_directory)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	int dd, fd;
+	size_t count;
+	dfs_entry entries[4] = { 0 };
+
+	dfs_dcreate(pt, "src");
+	dfs_dcreate(pt, "src/sub");
+	dfs_fcreate(pt, "src/sub/a.file");
+	dfs_dcreate(pt, "dest");
+	dfs_dopen(pt, "src/sub", &dd);
+
+	//The whole subtree moves with its entry, the open directory handle follows it
+	err = dfs_rename(pt, "src/sub", "dest/moved");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	err = dfs_dlist_entries(pt, "src", 4, entries, &count);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(0, count);
+
+	err = dfs_fopen(pt, "dest/moved/a.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fclose(pt, fd);
+
+	err = dfs_fcreate_at(pt, dd, "b.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_dclose(pt, dd);
+
+	err = dfs_dlist_entries(pt, "dest/moved", 4, entries, &count);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(2, count);
+
+	err = dfs_rename(pt, "dest", "renamed");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_fopen(pt, "renamed/moved/b.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fclose(pt, fd);
+
+	err = dfs_dcreate(pt, "src/sub");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+}
+
 TEST_GROUP_RUNNER(directory_good)
 {
 	RUN_TEST_CASE(directory_good, create_directory);
 	RUN_TEST_CASE(directory_good, create_directory_nested);
+	RUN_TEST_CASE(directory_good, lookup_many_entries);
+	RUN_TEST_CASE(directory_good, create_directory_multi_block);
+	RUN_TEST_CASE(directory_good, create_many);
+	RUN_TEST_CASE(directory_good, relative_operations);
+	RUN_TEST_CASE(directory_good, remove_directory);
+	RUN_TEST_CASE(directory_good, remove_tree);
+	RUN_TEST_CASE(directory_good, move_directory);
 }
 
 
@@ -130,10 +417,164 @@ TEST(directory_err, object_inside_files_errors)
 	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_PATH, err, "dfs_dcreate allowed the creation of directory under a file.");
 }
 
+TEST(directory_err, create_many_errors)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const char *paths[] = { "one", NULL, "" };
+	dfs_err results[3];
+
+	err = dfs_create_many(NULL, paths, DFS_FILEC_FILE, 3, results);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_create_many accepted a NULL partition.");
+
+	err = dfs_create_many(pt, NULL, DFS_FILEC_FILE, 3, results);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_create_many accepted NULL paths.");
+
+	err = dfs_create_many(pt, paths, 0x8000, 3, results);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_FLAGS, err, "dfs_create_many accepted invalid flags.");
+
+	err = dfs_create_many(pt, paths, DFS_FILEC_FILE, 3, results);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_create_many accepted a NULL path.");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, results[0]);
+	TEST_ASSERT_EQUAL_INT(DFS_NVAL_ARGS, results[1]);
+	TEST_ASSERT_EQUAL_INT(DFS_NVAL_PATH, results[2]);
+}
+
+TEST(directory_err, relative_operations_errors)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	int dd, fd;
+
+	dfs_fcreate(pt, "plain.file");
+
+	err = dfs_dopen(pt, "plain.file", &dd);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_PATH, err, "dfs_dopen opened a file as a directory.");
+
+	err = dfs_dopen(pt, "nodir", &dd);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_PATH_NOT_FOUND, err, "dfs_dopen opened a non-existing directory.");
+
+	err = dfs_dopen(pt, "", NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_dopen accepted a NULL descriptor pointer.");
+
+	err = dfs_fcreate_at(pt, 5, "x.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_DESCRIPTOR, err, "dfs_fcreate_at accepted a closed directory descriptor.");
+
+	err = dfs_fopen_at(pt, -7, "plain.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_DESCRIPTOR, err, "dfs_fopen_at accepted an invalid directory descriptor.");
+
+	err = dfs_dclose(pt, DFS_DIR_ROOT);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_DESCRIPTOR, err, "dfs_dclose closed the root directory.");
+}
+
+TEST(directory_err, remove_directories_errors)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	int dd;
+
+	dfs_dcreate(pt, "full");
+	dfs_fcreate(pt, "full/inner.file");
+	dfs_dcreate(pt, "open");
+
+	err = dfs_drm(NULL, "full");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_drm accepted a NULL partition.");
+
+	err = dfs_drm(pt, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_drm accepted a NULL path.");
+
+	err = dfs_drm(pt, "");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_PATH, err, "dfs_drm removed the root directory.");
+
+	err = dfs_drm(pt, "full");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_DIR_NOT_EMPTY, err, "dfs_drm removed a non-empty directory.");
+
+	err = dfs_drm(pt, "full/inner.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_PATH, err, "dfs_drm removed a file.");
+
+	dfs_dopen(pt, "open", &dd);
+	err = dfs_drm(pt, "open");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_drm removed an open directory.");
+	dfs_dclose(pt, dd);
+}
+
+TEST(directory_err, remove_tree_errors)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	int fd;
+	size_t count;
+
+	dfs_dcreate(pt, "tree");
+	dfs_dcreate(pt, "tree/sub");
+	dfs_fcreate(pt, "tree/sub/open.file");
+
+	err = dfs_rmtree(NULL, "tree");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_rmtree accepted a NULL partition.");
+
+	err = dfs_rmtree(pt, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_rmtree accepted a NULL path.");
+
+	err = dfs_rmtree(pt, "");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_PATH, err, "dfs_rmtree removed the root directory.");
+
+	err = dfs_rmtree(pt, "tree/sub/open.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_PATH, err, "dfs_rmtree removed a file.");
+
+	err = dfs_rmtree(pt, "missing");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_PATH_NOT_FOUND, err, "dfs_rmtree removed a non-existing directory.");
+
+	//A single open object keeps the whole tree in place
+	dfs_fopen(pt, "tree/sub/open.file", DFS_FILEM_READ, &fd);
+	err = dfs_rmtree(pt, "tree");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_rmtree removed a tree holding an open file.");
+	dfs_fclose(pt, fd);
+
+	err = dfs_dlist_entries(pt, "tree/sub", 0, NULL, &count);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_SUCCESS, err, "Refused dfs_rmtree still removed part of the tree.");
+	TEST_ASSERT_EQUAL_INT(1, count);
+}
+
+TEST(directory_err, move_directories_errors)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	size_t count;
+
+	dfs_dcreate(pt, "dir");
+	dfs_dcreate(pt, "dir/sub");
+	dfs_dcreate(pt, "other");
+	dfs_fcreate(pt, "a.file");
+
+	err = dfs_rename(pt, "dir", "dir/sub/inner");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_PATH, err, "dfs_rename moved a directory below itself.");
+
+	err = dfs_rename(pt, "dir", "dir/inner");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_PATH, err, "dfs_rename moved a directory into itself.");
+
+	err = dfs_rename(pt, "dir", "other");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_ALREADY_EXISTS, err, "dfs_rename replaced a directory.");
+
+	err = dfs_rename(pt, "dir", "a.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_ALREADY_EXISTS, err, "dfs_rename replaced a file with a directory.");
+
+	err = dfs_rename(pt, "", "moved");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_PATH, err, "dfs_rename moved the root directory.");
+
+	err = dfs_dlist_entries(pt, "dir", 0, NULL, &count);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_SUCCESS, err, "Refused dfs_rename still moved the directory.");
+	TEST_ASSERT_EQUAL_INT(1, count);
+}
+
 TEST_GROUP_RUNNER(directory_err)
 {
 	RUN_TEST_CASE(directory_err, null_args_directories_errors);
 	RUN_TEST_CASE(directory_err, duplicated_directories_errors);
 	RUN_TEST_CASE(directory_err, empty_name_directories_errors);
 	RUN_TEST_CASE(directory_err, object_inside_files_errors);
+	RUN_TEST_CASE(directory_err, create_many_errors);
+	RUN_TEST_CASE(directory_err, relative_operations_errors);
+	RUN_TEST_CASE(directory_err, remove_directories_errors);
+	RUN_TEST_CASE(directory_err, remove_tree_errors);
+	RUN_TEST_CASE(directory_err, move_directories_errors);
 }
@@ -1,5 +1,11 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
 
 #include "framework/unity.h"
 #include "framework/unity_fixture.h"
@@ -264,6 +270,1273 @@ TEST(file_good, read_write_align_file)
 	free(data);
 }
 
+TEST(file_good, shared_open_object)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const size_t data_len = 40000; //Spans two blocks
+	char *data = malloc(data_len);
+	char *buffer = malloc(data_len);
+	for (size_t i = 0; i < data_len; i++)
+		data[i] = (char)(i * 7);
+
+	int writer, reader;
+	size_t readc, pos;
+
+	dfs_fcreate(pt, "shared.file");
+	err = dfs_fopen(pt, "shared.file", DFS_FILEM_WRITE | DFS_FILEM_SHARE_RDWR, &writer);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_fopen(pt, "shared.file", DFS_FILEM_READ | DFS_FILEM_SHARE_RDWR, &reader);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	//Growth through one handle is seen by the other
+	err = dfs_fwrite(pt, writer, data, data_len, NULL);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	err = dfs_fseek(pt, reader, 0, DFS_SEEK_END);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fget_pos(pt, reader, &pos);
+	TEST_ASSERT_EQUAL_INT(data_len, pos);
+
+	dfs_fseek(pt, reader, 0, DFS_SEEK_SET);
+	err = dfs_fread(pt, reader, buffer, data_len, &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(data_len, readc);
+	TEST_ASSERT_EQUAL_MEMORY(data, buffer, data_len);
+
+	dfs_fclose(pt, writer);
+	dfs_fclose(pt, reader);
+
+	free(data);
+	free(buffer);
+}
+
+TEST(file_good, block_aligned_files)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	//Each file fits one block exactly, the partition could not hold two blocks per file
+	const int file_count = 24;
+	char *data = malloc(BLOCK_DATA_SIZE);
+	char *buffer = malloc(BLOCK_DATA_SIZE + 1);
+	char path[32];
+	size_t readc, pos;
+	int fd;
+
+	for (int i = 0; i < file_count; i++)
+	{
+		memset(data, 'a' + i, BLOCK_DATA_SIZE);
+		snprintf(path, sizeof(path), "aligned%d.file", i);
+
+		err = dfs_fcreate(pt, path);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		dfs_fopen(pt, path, DFS_FILEM_RDWR, &fd);
+		err = dfs_fwrite(pt, fd, data, BLOCK_DATA_SIZE, &readc);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		TEST_ASSERT_EQUAL_INT(BLOCK_DATA_SIZE, readc);
+
+		//Head rests past the last block until more data is written
+		dfs_fget_pos(pt, fd, &pos);
+		TEST_ASSERT_EQUAL_INT(BLOCK_DATA_SIZE, pos);
+		dfs_fclose(pt, fd);
+	}
+
+	for (int i = 0; i < file_count; i++)
+	{
+		memset(data, 'a' + i, BLOCK_DATA_SIZE);
+		snprintf(path, sizeof(path), "aligned%d.file", i);
+
+		dfs_fopen(pt, path, DFS_FILEM_READ, &fd);
+		err = dfs_fread(pt, fd, buffer, BLOCK_DATA_SIZE + 1, &readc);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		TEST_ASSERT_EQUAL_INT(BLOCK_DATA_SIZE, readc);
+		TEST_ASSERT_EQUAL_MEMORY(data, buffer, BLOCK_DATA_SIZE);
+		dfs_fclose(pt, fd);
+	}
+
+	//Writing at the end allocates the next block
+	dfs_fopen(pt, "aligned0.file", DFS_FILEM_RDWR, &fd);
+	dfs_fseek(pt, fd, 0, DFS_SEEK_END);
+	err = dfs_fwrite(pt, fd, "more", 4, NULL);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_pread(pt, fd, BLOCK_DATA_SIZE - 1, buffer, 8, &readc);
+	TEST_ASSERT_EQUAL_INT(5, readc);
+	TEST_ASSERT_EQUAL_MEMORY("amore", buffer, 5);
+	dfs_fclose(pt, fd);
+
+	free(data);
+	free(buffer);
+}
+
+TEST(file_good, sparse_file)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	//Spans every block of the partition, far more than it has free, skipped blocks must not be allocated
+	const size_t hole_end = ((size_t)pt->blk_count - 1) * BLOCK_DATA_SIZE;
+	const size_t middle = (size_t)(pt->blk_count / 2) * BLOCK_DATA_SIZE + 10;
+	char zeros[64] = { 0 };
+	char buffer[64];
+	size_t readc, pos;
+	int fd;
+
+	dfs_fcreate(pt, "sparse.file");
+	dfs_fopen(pt, "sparse.file", DFS_FILEM_RDWR, &fd);
+	dfs_fwrite(pt, fd, "head", 4, NULL);
+
+	err = dfs_fseek(pt, fd, hole_end, DFS_SEEK_SET);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_fwrite(pt, fd, "tail", 4, NULL);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	//Unwritten ranges read as zeros, both inside the first block and in holes
+	err = dfs_pread(pt, fd, 4, buffer, sizeof(buffer), &readc);
+	TEST_ASSERT_EQUAL_INT(sizeof(buffer), readc);
+	TEST_ASSERT_EQUAL_MEMORY(zeros, buffer, sizeof(buffer));
+	err = dfs_pread(pt, fd, middle - 32, buffer, sizeof(buffer), &readc);
+	TEST_ASSERT_EQUAL_INT(sizeof(buffer), readc);
+	TEST_ASSERT_EQUAL_MEMORY(zeros, buffer, sizeof(buffer));
+
+	//Writing into a hole allocates only that block
+	err = dfs_pwrite(pt, fd, middle, "middle", 6, NULL);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fclose(pt, fd);
+
+	//Holes are kept on the partition
+	dfs_fopen(pt, "sparse.file", DFS_FILEM_READ, &fd);
+	dfs_fseek(pt, fd, 0, DFS_SEEK_END);
+	dfs_fget_pos(pt, fd, &pos);
+	TEST_ASSERT_EQUAL_INT(hole_end + 4, pos);
+
+	err = dfs_pread(pt, fd, middle - 10, buffer, 20, &readc);
+	TEST_ASSERT_EQUAL_INT(20, readc);
+	TEST_ASSERT_EQUAL_MEMORY(zeros, buffer, 10);
+	TEST_ASSERT_EQUAL_MEMORY("middle", &buffer[10], 6);
+	TEST_ASSERT_EQUAL_MEMORY(zeros, &buffer[16], 4);
+
+	err = dfs_pread(pt, fd, middle + BLOCK_DATA_SIZE, buffer, sizeof(buffer), &readc);
+	TEST_ASSERT_EQUAL_MEMORY(zeros, buffer, sizeof(buffer));
+	err = dfs_pread(pt, fd, hole_end, buffer, sizeof(buffer), &readc);
+	TEST_ASSERT_EQUAL_INT(4, readc);
+	TEST_ASSERT_EQUAL_MEMORY("tail", buffer, 4);
+
+	dfs_fclose(pt, fd);
+}
+
+static size_t count_used_blks(void)
+{
+	size_t used = 0;
+	for (size_t i = 0; i < pt->usage_map->length; i++)
+		used += __builtin_popcount(pt->usage_map->map[i]);
+	return used;
+}
+
+TEST(file_good, truncate_file)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const size_t data_len = 5 * BLOCK_DATA_SIZE + 100;
+	char *data = malloc(data_len);
+	char *buffer = malloc(data_len);
+	char zeros[64] = { 0 };
+	size_t readc, pos;
+	int fd;
+
+	for (size_t i = 0; i < data_len; i++)
+		data[i] = 'a' + i % 26;
+
+	dfs_fcreate(pt, "truncated.file");
+	dfs_fopen(pt, "truncated.file", DFS_FILEM_RDWR, &fd);
+	size_t used_empty = count_used_blks();
+	dfs_fwrite(pt, fd, data, data_len, NULL);
+	TEST_ASSERT_EQUAL_INT(used_empty + 5, count_used_blks());
+
+	//Shrinking frees the tail and keeps the head position
+	err = dfs_ftruncate(pt, fd, BLOCK_DATA_SIZE + 10);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(used_empty + 1, count_used_blks());
+	dfs_fget_pos(pt, fd, &pos);
+	TEST_ASSERT_EQUAL_INT(data_len, pos);
+
+	err = dfs_pread(pt, fd, 0, buffer, data_len, &readc);
+	TEST_ASSERT_EQUAL_INT(BLOCK_DATA_SIZE + 10, readc);
+	TEST_ASSERT_EQUAL_MEMORY(data, buffer, readc);
+
+	//Growing reads back zeros, not the truncated data
+	err = dfs_ftruncate(pt, fd, 2 * BLOCK_DATA_SIZE);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_pread(pt, fd, BLOCK_DATA_SIZE + 10, buffer, sizeof(zeros), &readc);
+	TEST_ASSERT_EQUAL_INT(sizeof(zeros), readc);
+	TEST_ASSERT_EQUAL_MEMORY(zeros, buffer, sizeof(zeros));
+
+	//Growing far only allocates the new last block, shrinking into the hole fills it
+	err = dfs_ftruncate(pt, fd, 10 * BLOCK_DATA_SIZE);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(used_empty + 2, count_used_blks());
+	err = dfs_ftruncate(pt, fd, 5 * BLOCK_DATA_SIZE);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(used_empty + 2, count_used_blks());
+	err = dfs_pread(pt, fd, 5 * BLOCK_DATA_SIZE - sizeof(zeros), buffer, data_len, &readc);
+	TEST_ASSERT_EQUAL_INT(sizeof(zeros), readc);
+	TEST_ASSERT_EQUAL_MEMORY(zeros, buffer, sizeof(zeros));
+
+	//Truncating to zero and rewriting reuses the file, also after reopening
+	err = dfs_ftruncate(pt, fd, 0);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(used_empty, count_used_blks());
+	dfs_pwrite(pt, fd, 0, &data[100], 2 * BLOCK_DATA_SIZE, NULL);
+	dfs_fclose(pt, fd);
+
+	dfs_fopen(pt, "truncated.file", DFS_FILEM_READ, &fd);
+	err = dfs_fread(pt, fd, buffer, data_len, &readc);
+	TEST_ASSERT_EQUAL_INT(2 * BLOCK_DATA_SIZE, readc);
+	TEST_ASSERT_EQUAL_MEMORY(&data[100], buffer, readc);
+	dfs_fclose(pt, fd);
+
+	free(data);
+	free(buffer);
+}
+
+TEST(file_good, remove_file)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const size_t data_len = 4 * BLOCK_DATA_SIZE;
+	char *data = malloc(data_len);
+	char buffer[16];
+	size_t readc, used_before;
+	int fd, last_fd;
+
+	for (size_t i = 0; i < data_len; i++)
+		data[i] = 'a' + i % 26;
+
+	used_before = count_used_blks();
+	dfs_fcreate(pt, "first.file");
+	dfs_fcreate(pt, "big.file");
+	dfs_fcreate(pt, "last.file");
+
+	dfs_fopen(pt, "big.file", DFS_FILEM_WRITE, &fd);
+	dfs_fwrite(pt, fd, data, data_len, NULL);
+	dfs_fclose(pt, fd);
+
+	err = dfs_fopen(pt, "last.file", DFS_FILEM_RDWR, &last_fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	//The other entries keep their slots, an open handle keeps working
+	err = dfs_frm(pt, "first.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_fopen(pt, "first.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_PATH_NOT_FOUND, err);
+
+	err = dfs_fwrite(pt, last_fd, data, BLOCK_DATA_SIZE + 10, NULL);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fclose(pt, last_fd);
+
+	err = dfs_frm(pt, "big.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	err = dfs_fcreate(pt, "first.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_frm(pt, "first.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	//Closing waits for the reclaimer, only the last file's blocks remain
+	dfs_pclose(pt);
+	dfs_popen("./test_files_good.hex", &pt);
+	TEST_ASSERT_EQUAL_INT(used_before + 2, count_used_blks());
+
+	dfs_fopen(pt, "last.file", DFS_FILEM_READ, &fd);
+	dfs_fseek(pt, fd, BLOCK_DATA_SIZE, DFS_SEEK_SET);
+	err = dfs_fread(pt, fd, buffer, sizeof(buffer), &readc);
+	TEST_ASSERT_EQUAL_INT(10, readc);
+	TEST_ASSERT_EQUAL_MEMORY(&data[BLOCK_DATA_SIZE], buffer, 10);
+	dfs_fclose(pt, fd);
+
+	free(data);
+}
+
+TEST(file_good, rename_file)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const size_t data_len = 3 * BLOCK_DATA_SIZE;
+	char *data = malloc(data_len);
+	char buffer[16];
+	size_t readc, used_before;
+	int fd, moved_fd;
+
+	for (size_t i = 0; i < data_len; i++)
+		data[i] = 'a' + i % 26;
+
+	used_before = count_used_blks();
+	dfs_dcreate(pt, "dir");
+	dfs_fcreate(pt, "moved.file");
+	dfs_fcreate(pt, "other.file");
+	dfs_fcreate(pt, "dir/old.file");
+
+	dfs_fopen(pt, "dir/old.file", DFS_FILEM_WRITE, &fd);
+	dfs_fwrite(pt, fd, data, data_len, NULL);
+	dfs_fclose(pt, fd);
+
+	err = dfs_fopen(pt, "moved.file", DFS_FILEM_RDWR, &moved_fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	//Renaming inside the same directory, the open handle follows the entry
+	err = dfs_rename(pt, "moved.file", "renamed.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_fopen(pt, "moved.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_PATH_NOT_FOUND, err);
+
+	err = dfs_fwrite(pt, moved_fd, data, BLOCK_DATA_SIZE + 10, NULL);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	//Replacing an existing file in another directory while still open
+	err = dfs_rename(pt, "renamed.file", "dir/old.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_fopen(pt, "renamed.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_PATH_NOT_FOUND, err);
+
+	err = dfs_fwrite(pt, moved_fd, "0123456789", 10, NULL);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fclose(pt, moved_fd);
+
+	err = dfs_rename(pt, "other.file", "other.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	//Closing waits for the reclaimer, the replaced file's blocks are released
+	dfs_pclose(pt);
+	dfs_popen("./test_files_good.hex", &pt);
+	TEST_ASSERT_EQUAL_INT(used_before + 4, count_used_blks());
+
+	err = dfs_fopen(pt, "dir/old.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fseek(pt, fd, BLOCK_DATA_SIZE, DFS_SEEK_SET);
+	err = dfs_fread(pt, fd, buffer, sizeof(buffer), &readc);
+	TEST_ASSERT_EQUAL_INT(16, readc);
+	TEST_ASSERT_EQUAL_MEMORY(&data[BLOCK_DATA_SIZE], buffer, 10);
+	TEST_ASSERT_EQUAL_MEMORY("012345", &buffer[10], 6);
+	dfs_fclose(pt, fd);
+
+	err = dfs_fopen(pt, "other.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fclose(pt, fd);
+
+	free(data);
+}
+
+TEST(file_good, copy_file)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const size_t head_len = 3 * BLOCK_DATA_SIZE;
+	const size_t tail_off = 10 * BLOCK_DATA_SIZE + 7;
+	const size_t tail_len = 3 * BLOCK_DATA_SIZE;
+	char *data = malloc(tail_len);
+	char *buffer = malloc(tail_len);
+	char zeros[64] = { 0 };
+	size_t readc, pos, used_before;
+	int fd, src_fd;
+
+	for (size_t i = 0; i < tail_len; i++)
+		data[i] = 'a' + i % 26;
+
+	dfs_fcreate(pt, "source.file");
+	dfs_fopen(pt, "source.file", DFS_FILEM_WRITE, &fd);
+	dfs_fwrite(pt, fd, data, head_len, NULL);
+	dfs_pwrite(pt, fd, tail_off, data, tail_len, NULL);
+	dfs_fclose(pt, fd);
+
+	//Readers of the source do not get in the way
+	dfs_fopen(pt, "source.file", DFS_FILEM_READ | DFS_FILEM_SHARE_RDWR, &src_fd);
+
+	used_before = count_used_blks();
+	err = dfs_fcopy(pt, "source.file", "copy.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fclose(pt, src_fd);
+
+	//The hole is not allocated in the copy, both have 7 blocks of data
+	TEST_ASSERT_EQUAL_INT(used_before + 7, count_used_blks());
+
+	dfs_fopen(pt, "copy.file", DFS_FILEM_READ, &fd);
+	dfs_fseek(pt, fd, 0, DFS_SEEK_END);
+	dfs_fget_pos(pt, fd, &pos);
+	TEST_ASSERT_EQUAL_INT(tail_off + tail_len, pos);
+
+	err = dfs_pread(pt, fd, 0, buffer, head_len, &readc);
+	TEST_ASSERT_EQUAL_INT(head_len, readc);
+	TEST_ASSERT_EQUAL_MEMORY(data, buffer, head_len);
+
+	err = dfs_pread(pt, fd, 6 * BLOCK_DATA_SIZE, buffer, sizeof(zeros), &readc);
+	TEST_ASSERT_EQUAL_INT(sizeof(zeros), readc);
+	TEST_ASSERT_EQUAL_MEMORY(zeros, buffer, sizeof(zeros));
+	err = dfs_pread(pt, fd, tail_off - 7, buffer, 7, &readc);
+	TEST_ASSERT_EQUAL_INT(7, readc);
+	TEST_ASSERT_EQUAL_MEMORY(zeros, buffer, 7);
+
+	err = dfs_pread(pt, fd, tail_off, buffer, tail_len, &readc);
+	TEST_ASSERT_EQUAL_INT(tail_len, readc);
+	TEST_ASSERT_EQUAL_MEMORY(data, buffer, tail_len);
+	dfs_fclose(pt, fd);
+
+	//The copy is independent of its source
+	dfs_fopen(pt, "copy.file", DFS_FILEM_WRITE, &fd);
+	dfs_fwrite(pt, fd, "changed", 7, NULL);
+	dfs_fclose(pt, fd);
+
+	dfs_fopen(pt, "source.file", DFS_FILEM_READ, &fd);
+	err = dfs_fread(pt, fd, buffer, 7, &readc);
+	TEST_ASSERT_EQUAL_MEMORY(data, buffer, 7);
+	dfs_fclose(pt, fd);
+
+	//Empty files copy to empty files
+	dfs_fcreate(pt, "empty.file");
+	err = dfs_fcopy(pt, "empty.file", "empty_copy.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fopen(pt, "empty_copy.file", DFS_FILEM_READ, &fd);
+	dfs_fseek(pt, fd, 0, DFS_SEEK_END);
+	dfs_fget_pos(pt, fd, &pos);
+	TEST_ASSERT_EQUAL_INT(0, pos);
+	dfs_fclose(pt, fd);
+
+	free(data);
+	free(buffer);
+}
+
+TEST(file_good, send_file)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const size_t data_len = 2 * BLOCK_DATA_SIZE + 100;
+	const size_t hole_end = 4 * BLOCK_DATA_SIZE;
+	const size_t total_len = hole_end + data_len;
+	char *data = malloc(data_len);
+	char *buffer = malloc(total_len);
+	char *expected = calloc(1, total_len);
+	size_t sent, readc;
+	int fd, out_fd;
+
+	for (size_t i = 0; i < data_len; i++)
+		data[i] = 'a' + i % 26;
+	memcpy(expected, data, data_len);
+	memcpy(&expected[hole_end], data, data_len);
+
+	dfs_fcreate(pt, "sent.file");
+	dfs_fopen(pt, "sent.file", DFS_FILEM_RDWR | DFS_FILEM_BUFFERED, &fd);
+	dfs_pwrite(pt, fd, 0, data, data_len, NULL);
+	dfs_pwrite(pt, fd, hole_end, data, data_len - 10, NULL);
+
+	//Buffered data is flushed before sending, the stream position is left alone
+	dfs_fseek(pt, fd, hole_end + data_len - 10, DFS_SEEK_SET);
+	dfs_fwrite(pt, fd, &data[data_len - 10], 10, NULL);
+
+	out_fd = open("./sent.out", O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+	err = dfs_fsendfile(pt, fd, out_fd, 10, total_len, &sent);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(total_len - 10, sent);
+
+	readc = pread(out_fd, buffer, total_len - 10, 0);
+	TEST_ASSERT_EQUAL_INT(total_len - 10, readc);
+	TEST_ASSERT_EQUAL_MEMORY(&expected[10], buffer, total_len - 10);
+
+	//Descriptors sendfile refuses are written through a buffer, at their current position
+	sendfile_errno = EINVAL;
+	err = dfs_fsendfile(pt, fd, out_fd, 0, 10, &sent);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(10, sent);
+
+	readc = pread(out_fd, buffer, 10, total_len - 10);
+	TEST_ASSERT_EQUAL_INT(10, readc);
+	TEST_ASSERT_EQUAL_MEMORY(expected, buffer, 10);
+
+	//Other failures are reported
+	sendfile_errno = EIO;
+	err = dfs_fsendfile(pt, fd, out_fd, 0, 10, &sent);
+	TEST_ASSERT_EQUAL_INT(DFS_FAILED_FD_WRITE, err);
+	TEST_ASSERT_EQUAL_INT(0, sent);
+	sendfile_errno = 0;
+
+	//Descriptors that stop taking data midway report how far they got, also within a block
+	fd_write_budget = BLOCK_DATA_SIZE + 100;
+	err = dfs_fsendfile(pt, fd, out_fd, 0, total_len, &sent);
+	TEST_ASSERT_EQUAL_INT(DFS_FAILED_FD_WRITE, err);
+	TEST_ASSERT_EQUAL_INT(BLOCK_DATA_SIZE + 100, sent);
+
+	sendfile_errno = EINVAL;
+	fd_write_budget = 100;
+	err = dfs_fsendfile(pt, fd, out_fd, 0, total_len, &sent);
+	TEST_ASSERT_EQUAL_INT(DFS_FAILED_FD_WRITE, err);
+	TEST_ASSERT_EQUAL_INT(100, sent);
+	sendfile_errno = 0;
+	fd_write_budget = -1;
+
+	//Nothing is sent past the end of the file
+	err = dfs_fsendfile(pt, fd, out_fd, total_len, 10, &sent);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(0, sent);
+
+	close(out_fd);
+	dfs_fclose(pt, fd);
+
+	free(data);
+	free(buffer);
+	free(expected);
+}
+
+TEST(file_good, positional_read_write)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const size_t data_len = BLOCK_DATA_SIZE * 2 + 100;
+	char *data = malloc(data_len);
+	char *buffer = malloc(data_len);
+	size_t readc, pos;
+	int fd;
+
+	for (size_t i = 0; i < data_len; i++)
+		data[i] = 'a' + i % 26;
+
+	dfs_fcreate(pt, "positional.file");
+	dfs_fopen(pt, "positional.file", DFS_FILEM_RDWR, &fd);
+
+	//Write the tail first, past the end of the file
+	err = dfs_pwrite(pt, fd, BLOCK_DATA_SIZE, &data[BLOCK_DATA_SIZE], data_len - BLOCK_DATA_SIZE, &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(data_len - BLOCK_DATA_SIZE, readc);
+	err = dfs_pwrite(pt, fd, 0, data, BLOCK_DATA_SIZE, NULL);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	dfs_fget_pos(pt, fd, &pos);
+	TEST_ASSERT_EQUAL_INT(0, pos);
+
+	//Reads across block boundaries and stops at the end of file
+	err = dfs_pread(pt, fd, BLOCK_DATA_SIZE - 50, buffer, data_len, &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(data_len - BLOCK_DATA_SIZE + 50, readc);
+	TEST_ASSERT_EQUAL_MEMORY(&data[BLOCK_DATA_SIZE - 50], buffer, readc);
+
+	err = dfs_pread(pt, fd, data_len + 10, buffer, 10, &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(0, readc);
+
+	//Stream reads are unaffected
+	err = dfs_fread(pt, fd, buffer, data_len, &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(data_len, readc);
+	TEST_ASSERT_EQUAL_MEMORY(data, buffer, data_len);
+
+	dfs_fclose(pt, fd);
+
+	free(data);
+	free(buffer);
+}
+
+TEST(file_good, vectored_read_write)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	char header[12] = "record head";
+	size_t payload_len = BLOCK_DATA_SIZE + 500;
+	char *payload = malloc(payload_len);
+	char *payload_in = malloc(payload_len);
+	char header_in[12];
+	size_t readc;
+	int fd;
+
+	for (size_t i = 0; i < payload_len; i++)
+		payload[i] = 'a' + i % 26;
+
+	struct iovec out[3] = {
+		{ .iov_base = header, .iov_len = sizeof(header) },
+		{ .iov_base = NULL, .iov_len = 0 },
+		{ .iov_base = payload, .iov_len = payload_len }
+	};
+	struct iovec in[2] = {
+		{ .iov_base = header_in, .iov_len = sizeof(header_in) },
+		{ .iov_base = payload_in, .iov_len = payload_len }
+	};
+
+	dfs_fcreate(pt, "vectored.file");
+	dfs_fopen(pt, "vectored.file", DFS_FILEM_RDWR, &fd);
+
+	//Two records appended back to back
+	err = dfs_fwritev(pt, fd, out, 3, &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(sizeof(header) + payload_len, readc);
+	err = dfs_fwritev(pt, fd, out, 3, NULL);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	dfs_fseek(pt, fd, 0, DFS_SEEK_SET);
+	for (int i = 0; i < 2; i++)
+	{
+		memset(header_in, 0, sizeof(header_in));
+		memset(payload_in, 0, payload_len);
+
+		err = dfs_freadv(pt, fd, in, 2, &readc);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		TEST_ASSERT_EQUAL_INT(sizeof(header) + payload_len, readc);
+		TEST_ASSERT_EQUAL_MEMORY(header, header_in, sizeof(header));
+		TEST_ASSERT_EQUAL_MEMORY(payload, payload_in, payload_len);
+	}
+
+	//Stops at the end of file
+	err = dfs_freadv(pt, fd, in, 2, &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(0, readc);
+
+	dfs_fclose(pt, fd);
+
+	free(payload);
+	free(payload_in);
+}
+
+TEST(file_good, buffered_writes)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const size_t record_len = 100, record_count = 2000; //More than one handle buffer, less than two
+	const size_t data_len = record_len * record_count;
+	char *data = malloc(data_len);
+	char *buffer = malloc(data_len);
+	size_t readc;
+	int writer, reader;
+
+	for (size_t i = 0; i < data_len; i++)
+		data[i] = 'a' + i % 26;
+
+	dfs_fcreate(pt, "buffered.file");
+	err = dfs_fopen(pt, "buffered.file", DFS_FILEM_RDWR | DFS_FILEM_SHARE_READ | DFS_FILEM_BUFFERED, &writer);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fopen(pt, "buffered.file", DFS_FILEM_READ | DFS_FILEM_SHARE_RDWR, &reader);
+
+	for (size_t off = 0; off < data_len; off += record_len)
+	{
+		err = dfs_fwrite(pt, writer, &data[off], record_len, &readc);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		TEST_ASSERT_EQUAL_INT(record_len, readc);
+	}
+
+	//Only records up to the one filling the handle buffer reached the partition so far
+	size_t flushed_len = (HANDLE_WBUF_SIZE + record_len - 1) / record_len * record_len;
+	err = dfs_fread(pt, reader, buffer, data_len, &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(flushed_len, readc);
+	TEST_ASSERT_EQUAL_MEMORY(data, buffer, readc);
+
+	err = dfs_fflush(pt, writer);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	err = dfs_pread(pt, reader, 0, buffer, data_len, &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(data_len, readc);
+	TEST_ASSERT_EQUAL_MEMORY(data, buffer, data_len);
+
+	//Seeking flushes before moving, closing flushes the rest
+	dfs_fwrite(pt, writer, "XYZ", 3, NULL);
+	dfs_fseek(pt, writer, 0, DFS_SEEK_SET);
+	dfs_fwrite(pt, writer, "ABC", 3, NULL);
+
+	err = dfs_pread(pt, reader, data_len, buffer, 3, &readc);
+	TEST_ASSERT_EQUAL_INT(3, readc);
+	TEST_ASSERT_EQUAL_MEMORY("XYZ", buffer, 3);
+
+	err = dfs_fclose(pt, writer);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	err = dfs_pread(pt, reader, 0, buffer, 3, &readc);
+	TEST_ASSERT_EQUAL_INT(3, readc);
+	TEST_ASSERT_EQUAL_MEMORY("ABC", buffer, 3);
+
+	dfs_fclose(pt, reader);
+
+	free(data);
+	free(buffer);
+}
+
+TEST(file_good, buffered_writes_placement)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const size_t record_len = 100, data_len = 3 * BLOCK_DATA_SIZE + 1000; //Buffered whole until flushed
+	char *data = malloc(data_len);
+	char *buffer = malloc(data_len);
+	size_t readc;
+	int writers[2];
+
+	for (size_t i = 0; i < data_len; i++)
+		data[i] = 'a' + i % 26;
+
+	dfs_fcreate(pt, "placed1.file");
+	dfs_fcreate(pt, "placed2.file");
+	dfs_fopen(pt, "placed1.file", DFS_FILEM_RDWR | DFS_FILEM_BUFFERED, &writers[0]);
+	dfs_fopen(pt, "placed2.file", DFS_FILEM_RDWR | DFS_FILEM_BUFFERED, &writers[1]);
+
+	//Interleaved small writes, blocks are only picked once each buffer is flushed
+	for (size_t off = 0; off < data_len; off += record_len)
+	{
+		size_t len = data_len - off < record_len ? data_len - off : record_len;
+		for (int w = 0; w < 2; w++)
+		{
+			err = dfs_fwrite(pt, writers[w], &data[off], len, NULL);
+			TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		}
+	}
+
+	for (int w = 0; w < 2; w++)
+	{
+		err = dfs_fflush(pt, writers[w]);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	}
+
+	//Blocks appended past the one reserved on creation sit next to each other
+	size_t checked = 0;
+	for (size_t b = 0; b < OPEN_OBJECT_BUCKETS; b++)
+	{
+		for (open_object *obj = pt->open_objects->buckets[b]; obj; obj = obj->next)
+		{
+			TEST_ASSERT_EQUAL_INT(4, obj->chain_len);
+			for (size_t i = 2; i < obj->chain_len; i++)
+				TEST_ASSERT_EQUAL_UINT32(obj->chain[i - 1] + 1, obj->chain[i]);
+			checked++;
+		}
+	}
+	TEST_ASSERT_EQUAL_INT(2, checked);
+
+	for (int w = 0; w < 2; w++)
+	{
+		err = dfs_pread(pt, writers[w], 0, buffer, data_len, &readc);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		TEST_ASSERT_EQUAL_INT(data_len, readc);
+		TEST_ASSERT_EQUAL_MEMORY(data, buffer, data_len);
+
+		dfs_fclose(pt, writers[w]);
+	}
+
+	free(data);
+	free(buffer);
+}
+
+TEST(file_good, buffered_reads)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const size_t record_len = 64;
+	const size_t data_len = BLOCK_DATA_SIZE + 1000;
+	char *data = malloc(data_len);
+	char record[64];
+	size_t readc, total = 0;
+	int writer, reader;
+
+	for (size_t i = 0; i < data_len; i++)
+		data[i] = 'a' + i % 26;
+
+	dfs_fcreate(pt, "records.file");
+	dfs_fopen(pt, "records.file", DFS_FILEM_WRITE | DFS_FILEM_SHARE_READ, &writer);
+	dfs_fwrite(pt, writer, data, data_len, NULL);
+
+	err = dfs_fopen(pt, "records.file", DFS_FILEM_READ | DFS_FILEM_SHARE_RDWR | DFS_FILEM_BUFFERED, &reader);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	err = dfs_fread(pt, reader, record, record_len, &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_MEMORY(data, record, record_len);
+	total += readc;
+
+	//Writes through another handle must not be hidden by the buffered copy
+	memset(&data[record_len], 'Z', record_len);
+	dfs_pwrite(pt, writer, record_len, &data[record_len], record_len, NULL);
+
+	while (total < data_len)
+	{
+		err = dfs_fread(pt, reader, record, record_len, &readc);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		TEST_ASSERT_EQUAL_INT(data_len - total < record_len ? data_len - total : record_len, readc);
+		TEST_ASSERT_EQUAL_MEMORY(&data[total], record, readc);
+		total += readc;
+	}
+
+	err = dfs_fread(pt, reader, record, record_len, &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(0, readc);
+
+	//Appends past the buffered end are picked up
+	dfs_fwrite(pt, writer, "tail", 4, NULL);
+	err = dfs_fread(pt, reader, record, record_len, &readc);
+	TEST_ASSERT_EQUAL_INT(4, readc);
+	TEST_ASSERT_EQUAL_MEMORY("tail", record, 4);
+
+	dfs_fclose(pt, writer);
+	dfs_fclose(pt, reader);
+
+	free(data);
+}
+
+typedef struct
+{
+	int idx;
+	dfs_err err;
+} concurrent_worker;
+
+static void *concurrent_write_worker(void *arg)
+{
+	concurrent_worker *worker = arg;
+	char path[32], data[40000];
+	int fd;
+
+	snprintf(path, sizeof(path), "thread%d.file", worker->idx);
+	memset(data, 'a' + worker->idx, sizeof(data));
+
+	worker->err = dfs_fcreate(pt, path);
+	if (!worker->err)
+		worker->err = dfs_fopen(pt, path, DFS_FILEM_RDWR, &fd);
+	if (worker->err)
+		return NULL;
+
+	//Small writes so threads interleave block allocations
+	for (size_t off = 0; !worker->err && off < sizeof(data); off += 1000)
+		worker->err = dfs_fwrite(pt, fd, &data[off], 1000, NULL);
+
+	dfs_fclose(pt, fd);
+	return NULL;
+}
+
+TEST(file_good, concurrent_writes)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const int thread_count = 4;
+	pthread_t threads[4];
+	concurrent_worker workers[4];
+	char path[32], expected[40000], buffer[40000];
+	size_t readc;
+	int fd;
+
+	for (int i = 0; i < thread_count; i++)
+	{
+		workers[i].idx = i;
+		workers[i].err = DFS_SUCCESS;
+		pthread_create(&threads[i], NULL, concurrent_write_worker, &workers[i]);
+	}
+	for (int i = 0; i < thread_count; i++)
+		pthread_join(threads[i], NULL);
+
+	for (int i = 0; i < thread_count; i++)
+	{
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, workers[i].err);
+
+		snprintf(path, sizeof(path), "thread%d.file", i);
+		memset(expected, 'a' + i, sizeof(expected));
+
+		err = dfs_fopen(pt, path, DFS_FILEM_READ, &fd);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		err = dfs_fread(pt, fd, buffer, sizeof(buffer), &readc);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		TEST_ASSERT_EQUAL_INT(sizeof(expected), readc);
+		TEST_ASSERT_EQUAL_MEMORY(expected, buffer, sizeof(expected));
+		dfs_fclose(pt, fd);
+	}
+}
+
+typedef struct
+{
+	int fd;
+	size_t target;
+	dfs_err err;
+	int mismatch;
+} concurrent_reader;
+
+static void *concurrent_read_worker(void *arg)
+{
+	concurrent_reader *reader = arg;
+	char buffer[1000];
+	size_t total = 0, readc;
+
+	//Reads what the writer has published so far, retrying at the end of file
+	while (!reader->err && total < reader->target)
+	{
+		reader->err = dfs_fread(pt, reader->fd, buffer, sizeof(buffer), &readc);
+		for (size_t i = 0; i < readc; i++)
+			if (buffer[i] != (char)('a' + (total + i) % 26))
+				reader->mismatch = 1;
+		total += readc;
+	}
+
+	return NULL;
+}
+
+TEST(file_good, concurrent_reads)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const int thread_count = 4;
+	const size_t data_len = 100000;
+	pthread_t threads[4];
+	concurrent_reader readers[4];
+	char chunk[1000];
+	int writer;
+
+	dfs_fcreate(pt, "shared.file");
+	err = dfs_fopen(pt, "shared.file", DFS_FILEM_WRITE | DFS_FILEM_SHARE_READ, &writer);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	for (int i = 0; i < thread_count; i++)
+	{
+		err = dfs_fopen(pt, "shared.file", DFS_FILEM_READ | DFS_FILEM_SHARE_RDWR, &readers[i].fd);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		readers[i].target = data_len;
+		readers[i].err = DFS_SUCCESS;
+		readers[i].mismatch = 0;
+		pthread_create(&threads[i], NULL, concurrent_read_worker, &readers[i]);
+	}
+
+	//Appends force the block chain index to be reallocated under the readers
+	for (size_t off = 0; off < data_len; off += sizeof(chunk))
+	{
+		for (size_t i = 0; i < sizeof(chunk); i++)
+			chunk[i] = 'a' + (off + i) % 26;
+		err = dfs_fwrite(pt, writer, chunk, sizeof(chunk), NULL);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	}
+
+	for (int i = 0; i < thread_count; i++)
+	{
+		pthread_join(threads[i], NULL);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, readers[i].err);
+		TEST_ASSERT_EQUAL_INT(0, readers[i].mismatch);
+		dfs_fclose(pt, readers[i].fd);
+	}
+
+	dfs_fclose(pt, writer);
+}
+
+TEST(file_good, append_mode)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const dfs_filem_flags flags = DFS_FILEM_RDWR | DFS_FILEM_SHARE_RDWR | DFS_FILEM_APPEND;
+	char buffer[16];
+	size_t readc, pos;
+	int first, second;
+
+	dfs_fcreate(pt, "append.file");
+	dfs_fopen(pt, "append.file", flags, &first);
+	err = dfs_fopen(pt, "append.file", flags | DFS_FILEM_BUFFERED, &second);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	dfs_fwrite(pt, first, "abc", 3, NULL);
+	dfs_fwrite(pt, second, "def", 3, NULL);
+	dfs_fflush(pt, second);
+
+	//Seeking away does not change where appends go
+	dfs_fseek(pt, first, 0, DFS_SEEK_SET);
+	dfs_fwrite(pt, first, "ghi", 3, NULL);
+
+	dfs_fget_pos(pt, first, &pos);
+	TEST_ASSERT_EQUAL_INT(9, pos);
+
+	err = dfs_pread(pt, first, 0, buffer, sizeof(buffer), &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(9, readc);
+	TEST_ASSERT_EQUAL_MEMORY("abcdefghi", buffer, 9);
+
+	dfs_fclose(pt, first);
+	dfs_fclose(pt, second);
+}
+
+static void *concurrent_append_worker(void *arg)
+{
+	concurrent_worker *worker = arg;
+	char record[50];
+	int fd;
+
+	memset(record, 'a' + worker->idx, sizeof(record));
+
+	worker->err = dfs_fopen(pt, "log.file", DFS_FILEM_WRITE | DFS_FILEM_SHARE_RDWR | DFS_FILEM_APPEND, &fd);
+	for (int i = 0; !worker->err && i < 200; i++)
+		worker->err = dfs_fwrite(pt, fd, record, sizeof(record), NULL);
+
+	dfs_fclose(pt, fd);
+	return NULL;
+}
+
+TEST(file_good, concurrent_appends)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const int thread_count = 4;
+	const size_t data_len = 4 * 200 * 50;
+	pthread_t threads[4];
+	concurrent_worker workers[4];
+	char *buffer = malloc(data_len + 1);
+	size_t readc;
+	int fd;
+
+	dfs_fcreate(pt, "log.file");
+
+	for (int i = 0; i < thread_count; i++)
+	{
+		workers[i].idx = i;
+		workers[i].err = DFS_SUCCESS;
+		pthread_create(&threads[i], NULL, concurrent_append_worker, &workers[i]);
+	}
+	for (int i = 0; i < thread_count; i++)
+	{
+		pthread_join(threads[i], NULL);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, workers[i].err);
+	}
+
+	//Records never overlap or interleave
+	dfs_fopen(pt, "log.file", DFS_FILEM_READ, &fd);
+	err = dfs_fread(pt, fd, buffer, data_len + 1, &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(data_len, readc);
+	for (size_t off = 0; off < data_len; off += 50)
+		for (size_t i = 1; i < 50; i++)
+			TEST_ASSERT_EQUAL_CHAR(buffer[off], buffer[off + i]);
+
+	dfs_fclose(pt, fd);
+	free(buffer);
+}
+
+static atomic_int read_pause_state; //0 idle, 1 armed, 2 a reader is paused, 3 released
+
+static void pause_first_read(void)
+{
+	//Holds the first device read until released, bounded so a reader blocking the release cannot hang the test
+	int armed = 1;
+	if (!atomic_compare_exchange_strong(&read_pause_state, &armed, 2))
+		return;
+
+	struct timespec delay = { .tv_nsec = 1000000 };
+	for (int i = 0; i < 200 && read_pause_state != 3; i++)
+		nanosleep(&delay, NULL);
+}
+
+typedef struct
+{
+	int fd;
+	int out_fd;
+	char *buffer;
+	size_t len;
+	size_t done;
+	dfs_err err;
+} truncated_reader;
+
+static void *truncated_read_worker(void *arg)
+{
+	truncated_reader *reader = arg;
+	reader->err = dfs_pread(pt, reader->fd, 0, reader->buffer, reader->len, &reader->done);
+	return NULL;
+}
+
+static void *truncated_send_worker(void *arg)
+{
+	truncated_reader *reader = arg;
+	reader->err = dfs_fsendfile(pt, reader->fd, reader->out_fd, 0, reader->len, &reader->done);
+	return NULL;
+}
+
+TEST(file_good, concurrent_truncates)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const size_t data_len = 4 * BLOCK_DATA_SIZE;
+	char *data = malloc(data_len);
+	char *other = malloc(data_len);
+	char *buffer = malloc(data_len);
+	void *(*workers[2])(void*) = { truncated_read_worker, truncated_send_worker };
+	truncated_reader reader;
+	pthread_t thread;
+	size_t readc;
+	int fd, other_fd;
+
+	memset(data, 'v', data_len);
+	memset(other, 'o', data_len);
+	dfs_fcreate(pt, "shrunk.file");
+	dfs_fopen(pt, "shrunk.file", DFS_FILEM_RDWR | DFS_FILEM_SHARE_READ, &fd);
+
+	for (int i = 0; i < 2; i++)
+	{
+		char other_path[32];
+		snprintf(other_path, sizeof(other_path), "other%d.file", i);
+
+		err = dfs_pwrite(pt, fd, 0, data, data_len, NULL);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+		reader = (truncated_reader){ .len = data_len, .buffer = buffer };
+		reader.out_fd = open("./shrunk.out", O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+		dfs_fopen(pt, "shrunk.file", DFS_FILEM_READ | DFS_FILEM_SHARE_RDWR, &reader.fd);
+		memset(buffer, 0, data_len);
+
+		//The reader has seen the old size when the file is shrunk and its blocks are wanted by another file
+		read_pause_state = 1;
+		device_read_hook = pause_first_read;
+		pthread_create(&thread, NULL, workers[i], &reader);
+		while (read_pause_state != 2)
+			sched_yield();
+
+		err = dfs_ftruncate(pt, fd, 100);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		dfs_fcreate(pt, other_path);
+		dfs_fopen(pt, other_path, DFS_FILEM_WRITE, &other_fd);
+		err = dfs_pwrite(pt, other_fd, 0, other, data_len, NULL);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		dfs_fclose(pt, other_fd);
+
+		read_pause_state = 3;
+		pthread_join(thread, NULL);
+		device_read_hook = NULL;
+
+		//Data read under the old size still belongs to this file
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, reader.err);
+		TEST_ASSERT_EQUAL_INT(data_len, reader.done);
+		if (workers[i] == truncated_send_worker)
+		{
+			readc = pread(reader.out_fd, buffer, data_len, 0);
+			TEST_ASSERT_EQUAL_INT(data_len, readc);
+		}
+		TEST_ASSERT_EQUAL_MEMORY(data, buffer, data_len);
+
+		close(reader.out_fd);
+		dfs_fclose(pt, reader.fd);
+	}
+
+	dfs_fclose(pt, fd);
+	free(data);
+	free(other);
+	free(buffer);
+}
+
+static atomic_int chain_read_count, chain_pause_at, chain_pause_state; //State: 0 idle, 2 paused, 3 released, 4 timed out
+
+static void pause_chain_load(void)
+{
+	//Holds the device read chain_pause_at, bounded so a caller blocking the release cannot hang the test
+	if (atomic_fetch_add(&chain_read_count, 1) + 1 != chain_pause_at)
+		return;
+
+	int paused = 2;
+	struct timespec delay = { .tv_nsec = 1000000 };
+	chain_pause_state = 2;
+	for (int i = 0; i < 200 && chain_pause_state != 3; i++)
+		nanosleep(&delay, NULL);
+	atomic_compare_exchange_strong(&chain_pause_state, &paused, 4);
+}
+
+static void *open_big_worker(void *arg)
+{
+	concurrent_reader *reader = arg;
+	reader->err = dfs_fopen(pt, "big.file", DFS_FILEM_READ | DFS_FILEM_SHARE_RDWR, &reader->fd);
+	return NULL;
+}
+
+TEST(file_good, concurrent_opens)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const size_t blk_count = 8;
+	char *data = calloc(blk_count, BLOCK_DATA_SIZE);
+	concurrent_reader reader = { .err = DFS_SUCCESS };
+	pthread_t thread;
+	int fd, paused = 2;
+
+	dfs_fcreate(pt, "big.file");
+	dfs_fcreate(pt, "small.file");
+	dfs_fopen(pt, "big.file", DFS_FILEM_WRITE, &fd);
+	dfs_fwrite(pt, fd, data, blk_count * BLOCK_DATA_SIZE, NULL);
+	dfs_fclose(pt, fd);
+	free(data);
+
+	//Opening a closed file reads its path, then one header per block
+	chain_read_count = 0;
+	chain_pause_at = 0;
+	chain_pause_state = 0;
+	device_read_hook = pause_chain_load;
+	dfs_fopen(pt, "big.file", DFS_FILEM_READ, &fd);
+	dfs_fclose(pt, fd);
+
+	//Pause on the second header, other files open and close meanwhile
+	chain_pause_at = chain_read_count - blk_count + 2;
+	chain_read_count = 0;
+	pthread_create(&thread, NULL, open_big_worker, &reader);
+	for (int i = 0; i < 1000 && chain_pause_state == 0; i++)
+		nanosleep(&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+	TEST_ASSERT_EQUAL_INT(2, chain_pause_state);
+
+	err = dfs_fopen(pt, "small.file", DFS_FILEM_RDWR, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_fclose(pt, fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	//The same file shrunk and closed meanwhile has its chain loaded again, its first header was read already
+	err = dfs_fopen(pt, "big.file", DFS_FILEM_WRITE | DFS_FILEM_SHARE_RDWR, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_ftruncate(pt, fd, 100);
+	dfs_fclose(pt, fd);
+	TEST_ASSERT_TRUE_MESSAGE(atomic_compare_exchange_strong(&chain_pause_state, &paused, 3), "Opening a file waited for another file's chain to load.");
+
+	pthread_join(thread, NULL);
+	device_read_hook = NULL;
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, reader.err);
+
+	size_t pos;
+	dfs_fseek(pt, reader.fd, 0, DFS_SEEK_END);
+	dfs_fget_pos(pt, reader.fd, &pos);
+	TEST_ASSERT_EQUAL_INT(100, pos);
+	dfs_fclose(pt, reader.fd);
+}
+
+TEST(file_good, many_open_handles)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const int handle_count = 300;
+	int fds[300];
+	char buffer[8];
+	size_t readc;
+
+	dfs_fcreate(pt, "many.file");
+
+	int fd;
+	dfs_fopen(pt, "many.file", DFS_FILEM_WRITE | DFS_FILEM_SHARE_READ, &fd);
+	dfs_fwrite(pt, fd, "shared", 6, NULL);
+	dfs_fclose(pt, fd);
+
+	for (int i = 0; i < handle_count; i++)
+	{
+		err = dfs_fopen(pt, "many.file", DFS_FILEM_READ | DFS_FILEM_SHARE_READ, &fds[i]);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	}
+
+	//Handles must stay independent as the table grows
+	err = dfs_fread(pt, fds[0], buffer, 6, &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_fread(pt, fds[handle_count - 1], buffer, 6, &readc);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_MEMORY("shared", buffer, 6);
+
+	for (int i = 0; i < handle_count; i += 2)
+	{
+		err = dfs_fclose(pt, fds[i]);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	}
+
+	//Freed descriptors are reused before the table grows again
+	err = dfs_fopen(pt, "many.file", DFS_FILEM_READ | DFS_FILEM_SHARE_READ, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_TRUE(fd < handle_count);
+	TEST_ASSERT_EQUAL_INT(0, fd % 2);
+	dfs_fclose(pt, fd);
+
+	for (int i = 1; i < handle_count; i += 2)
+	{
+		err = dfs_fclose(pt, fds[i]);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	}
+
+	err = dfs_fclose(pt, fds[1]);
+	TEST_ASSERT_EQUAL_INT(DFS_NVAL_DESCRIPTOR, err);
+}
+
 TEST_GROUP_RUNNER(file_good)
 {
 	RUN_TEST_CASE(file_good, create_file);
@@ -271,7 +1544,27 @@ TEST_GROUP_RUNNER(file_good)
 	RUN_TEST_CASE(file_good, read_write_file);
 	RUN_TEST_CASE(file_good, read_eof);
 	RUN_TEST_CASE(file_good, seek_file);
+	RUN_TEST_CASE(file_good, positional_read_write);
+	RUN_TEST_CASE(file_good, sparse_file);
+	RUN_TEST_CASE(file_good, truncate_file);
+	RUN_TEST_CASE(file_good, remove_file);
+	RUN_TEST_CASE(file_good, rename_file);
+	RUN_TEST_CASE(file_good, copy_file);
+	RUN_TEST_CASE(file_good, send_file);
+	RUN_TEST_CASE(file_good, block_aligned_files);
+	RUN_TEST_CASE(file_good, vectored_read_write);
+	RUN_TEST_CASE(file_good, buffered_writes);
+	RUN_TEST_CASE(file_good, buffered_writes_placement);
+	RUN_TEST_CASE(file_good, buffered_reads);
 	RUN_TEST_CASE(file_good, read_write_align_file);
+	RUN_TEST_CASE(file_good, shared_open_object);
+	RUN_TEST_CASE(file_good, many_open_handles);
+	RUN_TEST_CASE(file_good, concurrent_writes);
+	RUN_TEST_CASE(file_good, concurrent_reads);
+	RUN_TEST_CASE(file_good, append_mode);
+	RUN_TEST_CASE(file_good, concurrent_appends);
+	RUN_TEST_CASE(file_good, concurrent_truncates);
+	RUN_TEST_CASE(file_good, concurrent_opens);
 }
 
 
@@ -336,6 +1629,29 @@ TEST(file_err, null_args_files_errors)
 	err = dfs_fclose(NULL, fd);
 	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fclose accepted a NULL partition.");
 
+	//==fflush==
+	err = dfs_fflush(NULL, fd);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fflush accepted a NULL partition.");
+
+	err = dfs_fflush(pt, 1234);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_DESCRIPTOR, err, "dfs_fflush accepted an invalid descriptor.");
+
+	err = dfs_ftruncate(NULL, fd, 0);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_ftruncate accepted a NULL partition.");
+
+	err = dfs_ftruncate(pt, 1234, 0);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_DESCRIPTOR, err, "dfs_ftruncate accepted an invalid descriptor.");
+
+	//==fsendfile==
+	err = dfs_fsendfile(NULL, fd, 1, 0, 10, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fsendfile accepted a NULL partition.");
+
+	err = dfs_fsendfile(pt, fd, -1, 0, 10, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fsendfile accepted an invalid output descriptor.");
+
+	err = dfs_fsendfile(pt, 1234, 1, 0, 10, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_DESCRIPTOR, err, "dfs_fsendfile accepted an invalid descriptor.");
+
 	//==fwrite==
 	err = dfs_fwrite(NULL, fd, buff, 0, NULL);
 	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fwrite accepted a NULL partition.");
@@ -350,6 +1666,44 @@ TEST(file_err, null_args_files_errors)
 	err = dfs_fread(pt, fd, NULL, 0, NULL);
 	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fread accepted a NULL buffer.");
 
+	//==pwrite==
+	err = dfs_pwrite(NULL, fd, 0, buff, 0, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_pwrite accepted a NULL partition.");
+
+	err = dfs_pwrite(pt, fd, 0, NULL, 0, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_pwrite accepted a NULL buffer.");
+
+	//==pread==
+	err = dfs_pread(NULL, fd, 0, buff, 0, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_pread accepted a NULL partition.");
+
+	err = dfs_pread(pt, fd, 0, NULL, 0, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_pread accepted a NULL buffer.");
+
+	err = dfs_pread(pt, 1234, 0, buff, sizeof(buff), NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_DESCRIPTOR, err, "dfs_pread accepted an invalid descriptor.");
+
+	//==fwritev==
+	struct iovec iov = { .iov_base = buff, .iov_len = sizeof(buff) };
+	err = dfs_fwritev(NULL, fd, &iov, 1, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fwritev accepted a NULL partition.");
+
+	err = dfs_fwritev(pt, fd, NULL, 1, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fwritev accepted a NULL buffer array.");
+
+	err = dfs_fwritev(pt, fd, &iov, -1, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fwritev accepted a negative buffer count.");
+
+	//==freadv==
+	err = dfs_freadv(NULL, fd, &iov, 1, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_freadv accepted a NULL partition.");
+
+	err = dfs_freadv(pt, fd, NULL, 1, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_freadv accepted a NULL buffer array.");
+
+	err = dfs_freadv(pt, fd, &iov, -1, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_freadv accepted a negative buffer count.");
+
 	//==fseek==
 	err = dfs_fseek(NULL, fd, 0, DFS_SEEK_SET);
 	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fset_pos accepted a NULL partition.");
@@ -364,6 +1718,369 @@ TEST(file_err, null_args_files_errors)
 	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fget_pos accepted a NULL position.");
 }
 
+TEST(file_err, access_mode_errors)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	struct iovec iov = { .iov_base = "data", .iov_len = 4 };
+	int fd;
+
+	dfs_fcreate(pt, "mode.file");
+	dfs_fopen(pt, "mode.file", DFS_FILEM_READ, &fd);
+
+	err = dfs_fwrite(pt, fd, "data", 4, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_fwrite wrote through a read-only handle.");
+
+	err = dfs_pwrite(pt, fd, 0, "data", 4, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_pwrite wrote through a read-only handle.");
+
+	err = dfs_fwritev(pt, fd, &iov, 1, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_fwritev wrote through a read-only handle.");
+
+	err = dfs_ftruncate(pt, fd, 0);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_ftruncate truncated through a read-only handle.");
+
+	dfs_fclose(pt, fd);
+}
+
+TEST(file_err, remove_files_errors)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	int fd;
+
+	dfs_fcreate(pt, "open.file");
+	dfs_dcreate(pt, "dir");
+
+	err = dfs_frm(NULL, "open.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_frm accepted a NULL partition.");
+
+	err = dfs_frm(pt, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_frm accepted a NULL path.");
+
+	err = dfs_frm(pt, "");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_PATH, err, "dfs_frm accepted an empty path.");
+
+	err = dfs_frm(pt, "missing.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_PATH_NOT_FOUND, err, "dfs_frm removed a non-existing file.");
+
+	err = dfs_frm(pt, "dir");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_PATH, err, "dfs_frm removed a directory.");
+
+	err = dfs_frm_at(pt, 5, "open.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_DESCRIPTOR, err, "dfs_frm_at accepted an invalid directory descriptor.");
+
+	dfs_fopen(pt, "open.file", DFS_FILEM_READ | DFS_FILEM_SHARE_RDWR, &fd);
+	err = dfs_frm(pt, "open.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_frm removed an open file.");
+	dfs_fclose(pt, fd);
+
+	err = dfs_fopen(pt, "open.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_SUCCESS, err, "Refused dfs_frm still removed the file.");
+	dfs_fclose(pt, fd);
+}
+
+TEST(file_err, rename_files_errors)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	int fd;
+
+	dfs_fcreate(pt, "a.file");
+	dfs_fcreate(pt, "open.file");
+	dfs_dcreate(pt, "dir");
+
+	err = dfs_rename(NULL, "a.file", "b.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_rename accepted a NULL partition.");
+
+	err = dfs_rename(pt, NULL, "b.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_rename accepted a NULL source path.");
+
+	err = dfs_rename(pt, "a.file", NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_rename accepted a NULL destination path.");
+
+	err = dfs_rename(pt, "a.file", "");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_PATH, err, "dfs_rename accepted an empty path.");
+
+	err = dfs_rename(pt, "missing.file", "b.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_PATH_NOT_FOUND, err, "dfs_rename moved a non-existing file.");
+
+	err = dfs_rename(pt, "a.file", "missing/b.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_PATH_NOT_FOUND, err, "dfs_rename moved a file into a non-existing directory.");
+
+	err = dfs_rename(pt, "a.file", "open.file/b.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_PATH, err, "dfs_rename moved a file inside a file.");
+
+	err = dfs_rename(pt, "a.file", "dir");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_ALREADY_EXISTS, err, "dfs_rename replaced a directory.");
+
+	err = dfs_rename_at(pt, 5, "a.file", "b.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_DESCRIPTOR, err, "dfs_rename_at accepted an invalid directory descriptor.");
+
+	dfs_fopen(pt, "open.file", DFS_FILEM_READ | DFS_FILEM_SHARE_RDWR, &fd);
+	err = dfs_rename(pt, "a.file", "open.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_rename replaced an open file.");
+	dfs_fclose(pt, fd);
+
+	err = dfs_fopen(pt, "a.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_SUCCESS, err, "Refused dfs_rename still moved the file.");
+	dfs_fclose(pt, fd);
+}
+
+static atomic_int rename_copy_state; //0 idle, 1 armed, 2 done
+
+static void rename_copy_midway(void)
+{
+	//Once the copy moves data without meta_lock, moves it away, puts another file at its path and fails its next write
+	int armed = 1;
+	if (pthread_rwlock_trywrlock(&pt->meta_lock))
+		return;
+	pthread_rwlock_unlock(&pt->meta_lock);
+	if (!atomic_compare_exchange_strong(&rename_copy_state, &armed, 2))
+		return;
+
+	dfs_rename(pt, "c.file", "d.file");
+	dfs_fcreate(pt, "c.file");
+	device_write_fail_at = 1;
+}
+
+TEST(file_err, copy_files_errors)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	int fd;
+
+	dfs_fcreate(pt, "a.file");
+	dfs_fcreate(pt, "b.file");
+	dfs_dcreate(pt, "dir");
+
+	err = dfs_fcopy(NULL, "a.file", "c.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fcopy accepted a NULL partition.");
+
+	err = dfs_fcopy(pt, NULL, "c.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fcopy accepted a NULL source path.");
+
+	err = dfs_fcopy(pt, "a.file", NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fcopy accepted a NULL destination path.");
+
+	err = dfs_fcopy(pt, "missing.file", "c.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_PATH_NOT_FOUND, err, "dfs_fcopy copied a non-existing file.");
+
+	err = dfs_fcopy(pt, "dir", "c.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_fcopy copied a directory.");
+
+	err = dfs_fcopy(pt, "a.file", "b.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_ALREADY_EXISTS, err, "dfs_fcopy replaced an existing file.");
+
+	err = dfs_fcopy(pt, "a.file", "missing/c.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_PATH_NOT_FOUND, err, "dfs_fcopy copied into a non-existing directory.");
+
+	err = dfs_fcopy_at(pt, 5, "a.file", "c.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_DESCRIPTOR, err, "dfs_fcopy_at accepted an invalid directory descriptor.");
+
+	//Sources open without shared reads cannot be copied
+	dfs_fopen(pt, "a.file", DFS_FILEM_WRITE, &fd);
+	err = dfs_fcopy(pt, "a.file", "c.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_fcopy copied a file locked for reading.");
+	dfs_fclose(pt, fd);
+
+	//Neither can sources already open for writing, even when they share everything
+	dfs_fopen(pt, "a.file", DFS_FILEM_WRITE | DFS_FILEM_SHARE_RDWR, &fd);
+	err = dfs_fcopy(pt, "a.file", "c.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_fcopy copied a file open for writing.");
+	dfs_fclose(pt, fd);
+
+	err = dfs_fopen(pt, "c.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_PATH_NOT_FOUND, err, "Refused dfs_fcopy still created the destination.");
+
+	//Copies failing midway are removed, also after being renamed and replaced by another file
+	char *data = calloc(1, 3 * BLOCK_DATA_SIZE);
+	dfs_fopen(pt, "a.file", DFS_FILEM_WRITE, &fd);
+	dfs_fwrite(pt, fd, data, 3 * BLOCK_DATA_SIZE, NULL);
+	dfs_fclose(pt, fd);
+	free(data);
+	size_t used_before = count_used_blks();
+
+	rename_copy_state = 1;
+	device_read_hook = rename_copy_midway;
+	err = dfs_fcopy(pt, "a.file", "c.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_FAILED_DEVICE_WRITE, err, "dfs_fcopy ignored a failed device write.");
+	device_read_hook = NULL;
+	TEST_ASSERT_EQUAL_INT(2, rename_copy_state);
+
+	err = dfs_fopen(pt, "d.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_PATH_NOT_FOUND, err, "Failed dfs_fcopy left the renamed destination behind.");
+	err = dfs_fopen(pt, "c.file", DFS_FILEM_READ, &fd);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_SUCCESS, err, "Failed dfs_fcopy removed the file now at its destination path.");
+	dfs_fclose(pt, fd);
+
+	//Closing waits for the reclaimer, only the block of the new file remains
+	dfs_pclose(pt);
+	dfs_popen("./test_files_errors.hex", &pt);
+	TEST_ASSERT_EQUAL_INT(used_before + 1, count_used_blks());
+}
+
+TEST(file_err, failed_flush_errors)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	char *data = calloc(HANDLE_WBUF_SIZE, 1);
+	char buffer[16];
+	size_t io, pos;
+	int fd;
+
+	dfs_fcreate(pt, "buffered.file");
+	dfs_fopen(pt, "buffered.file", DFS_FILEM_RDWR | DFS_FILEM_BUFFERED, &fd);
+
+	//Buffered bytes survive a failed flush and go out with the next one
+	dfs_fwrite(pt, fd, "ABCDEF", 6, NULL);
+	device_write_errno = EIO;
+	err = dfs_fflush(pt, fd);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_FAILED_DEVICE_WRITE, err, "dfs_fflush ignored a failed device write.");
+	device_write_errno = 0;
+
+	err = dfs_fflush(pt, fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_pread(pt, fd, 0, buffer, sizeof(buffer), &io);
+	TEST_ASSERT_EQUAL_INT(6, io);
+	TEST_ASSERT_EQUAL_MEMORY("ABCDEF", buffer, 6);
+
+	//Same for bytes that were to go out together with an unbuffered write
+	dfs_fwrite(pt, fd, "GHI", 3, NULL);
+	device_write_errno = EIO;
+	err = dfs_fwrite(pt, fd, data, HANDLE_WBUF_SIZE, &io);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_FAILED_DEVICE_WRITE, err, "dfs_fwrite ignored a failed device write.");
+	TEST_ASSERT_EQUAL_INT(0, io);
+	device_write_errno = 0;
+
+	dfs_fget_pos(pt, fd, &pos);
+	TEST_ASSERT_EQUAL_INT(9, pos);
+	err = dfs_fflush(pt, fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_pread(pt, fd, 0, buffer, sizeof(buffer), &io);
+	TEST_ASSERT_EQUAL_INT(9, io);
+	TEST_ASSERT_EQUAL_MEMORY("ABCDEFGHI", buffer, 9);
+
+	dfs_fclose(pt, fd);
+	free(data);
+}
+
+TEST(file_err, failed_write_errors)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const size_t data_len = 3 * BLOCK_DATA_SIZE;
+	char *data = malloc(data_len);
+	char *buffer = malloc(data_len);
+	size_t io, used_before;
+	dfs_obj_id id;
+	dfs_entry entry;
+	int fd;
+
+	for (size_t i = 0; i < data_len; i++)
+		data[i] = 'a' + i % 26;
+
+	dfs_ocreate_at(pt, DFS_DIR_ROOT, "failed.file", DFS_FILEC_FILE, &id);
+	dfs_fopen(pt, "failed.file", DFS_FILEM_RDWR, &fd);
+	dfs_fwrite(pt, fd, data, 100, NULL);
+	used_before = count_used_blks();
+
+	//Blocks reserved for a write that never started are given back
+	device_write_errno = EIO;
+	err = dfs_pwrite(pt, fd, 100, data, data_len, &io);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_FAILED_DEVICE_WRITE, err, "dfs_pwrite ignored a failed device write.");
+	device_write_errno = 0;
+
+	TEST_ASSERT_EQUAL_INT(used_before, count_used_blks());
+	dfs_stat_by_id(pt, id, &entry);
+	TEST_ASSERT_EQUAL_INT(100, entry.length);
+
+	//Failing on the third block keeps what landed, headers never counted the rest
+	//Reserving takes a map flush and five header and entry writes, each block then its data and used space
+	device_write_fail_at = 11;
+	err = dfs_pwrite(pt, fd, 100, data, data_len, &io);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_FAILED_DEVICE_WRITE, err, "dfs_pwrite ignored a failed device write.");
+
+	TEST_ASSERT_EQUAL_INT(used_before + 1, count_used_blks());
+	dfs_stat_by_id(pt, id, &entry);
+	TEST_ASSERT_EQUAL_INT(2 * BLOCK_DATA_SIZE, entry.length);
+	err = dfs_pread(pt, fd, 100, buffer, data_len, &io);
+	TEST_ASSERT_EQUAL_INT(2 * BLOCK_DATA_SIZE - 100, io);
+	TEST_ASSERT_EQUAL_MEMORY(data, buffer, io);
+
+	//Running out of blocks partway keeps the blocks that got data, the appended ones are all used
+	size_t free_blks = pt->blk_count - count_used_blks();
+	size_t big_len = (free_blks + 1) * BLOCK_DATA_SIZE;
+	char *big = malloc(big_len);
+	memset(big, 'z', big_len);
+
+	err = dfs_pwrite(pt, fd, 2 * BLOCK_DATA_SIZE, big, big_len, &io);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NO_SPACE, err, "dfs_pwrite ignored running out of blocks.");
+
+	TEST_ASSERT_EQUAL_INT(pt->blk_count, count_used_blks());
+	dfs_stat_by_id(pt, id, &entry);
+	TEST_ASSERT_EQUAL_INT((free_blks + 2) * BLOCK_DATA_SIZE, entry.length);
+
+	//Nothing was held back past the size
+	err = dfs_ftruncate(pt, fd, 100);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(used_before, count_used_blks());
+
+	//A block that could not be linked to the file is given back
+	//Growing a full block takes a map flush, then the entry, the new header and the old last header
+	dfs_ftruncate(pt, fd, BLOCK_DATA_SIZE);
+	used_before = count_used_blks();
+	for (int fail_at = 1; fail_at <= 4; fail_at++)
+	{
+		device_write_fail_at = fail_at;
+		err = dfs_ftruncate(pt, fd, 3 * BLOCK_DATA_SIZE);
+		TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_FAILED_DEVICE_WRITE, err, "dfs_ftruncate ignored a failed device write.");
+		device_write_fail_at = 0;
+
+		TEST_ASSERT_EQUAL_INT(used_before, count_used_blks());
+		dfs_stat_by_id(pt, id, &entry);
+		TEST_ASSERT_EQUAL_INT(BLOCK_DATA_SIZE, entry.length);
+	}
+
+	dfs_fclose(pt, fd);
+	free(data);
+	free(buffer);
+	free(big);
+}
+
+TEST(file_err, oversized_files_errors)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	const size_t max_size = (size_t)pt->blk_count * BLOCK_DATA_SIZE;
+	size_t used_before, io;
+	int fd;
+
+	dfs_fcreate(pt, "huge.file");
+	dfs_fopen(pt, "huge.file", DFS_FILEM_RDWR, &fd);
+	used_before = count_used_blks();
+
+	//Files cannot index more blocks than the partition has, holes included
+	err = dfs_ftruncate(pt, fd, max_size + 1);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_ftruncate grew a file past the partition's blocks.");
+	err = dfs_ftruncate(pt, fd, (size_t)UINT32_MAX * BLOCK_DATA_SIZE * 2);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_ftruncate accepted a hole the block headers cannot hold.");
+	err = dfs_pwrite(pt, fd, max_size, "x", 1, &io);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_pwrite wrote past the partition's blocks.");
+	err = dfs_pwrite(pt, fd, SIZE_MAX, "x", 1, &io);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_pwrite accepted a write wrapping around.");
+
+	dfs_fseek(pt, fd, SIZE_MAX / 2, DFS_SEEK_SET);
+	err = dfs_fwrite(pt, fd, "x", 1, &io);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fwrite wrote after a far seek.");
+
+	TEST_ASSERT_EQUAL_INT(used_before, count_used_blks());
+	err = dfs_ftruncate(pt, fd, max_size);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	dfs_fclose(pt, fd);
+}
+
 TEST(file_err, duplicated_files_errors)
 {
 	fprintf(stderr, "\nEntering %s\n\n", __func__);
@@ -402,6 +2119,13 @@ TEST_GROUP_RUNNER(file_err)
 {
 	RUN_TEST_CASE(file_err, null_args_files_errors);
 	RUN_TEST_CASE(file_err, duplicated_files_errors);
+	RUN_TEST_CASE(file_err, access_mode_errors);
+	RUN_TEST_CASE(file_err, remove_files_errors);
+	RUN_TEST_CASE(file_err, rename_files_errors);
+	RUN_TEST_CASE(file_err, copy_files_errors);
+	RUN_TEST_CASE(file_err, failed_flush_errors);
+	RUN_TEST_CASE(file_err, failed_write_errors);
+	RUN_TEST_CASE(file_err, oversized_files_errors);
 	RUN_TEST_CASE(file_err, empty_name_files_errors);
 	RUN_TEST_CASE(file_err, invalid_dir_files_errors);
 }
@@ -9,6 +9,7 @@
 #include "mocks_interface.h"
 
 #include "../src/dfs.h"
+#include "../src/dfs_structures.h"
 
 
 static dfs_err err;
@@ -75,9 +76,113 @@ TEST(management_good, list_entries)
 	TEST_ASSERT_EQUAL_INT(0, count);
 }
 
+TEST(management_good, object_ids)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	size_t count;
+	int fd;
+	dfs_obj_id file_id, dir_id;
+	dfs_entry entries[16] = { 0 };
+	dfs_entry entry;
+
+	err = dfs_ocreate_at(pt, DFS_DIR_ROOT, "file1.test", DFS_FILEC_FILE, &file_id);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_ocreate_at(pt, DFS_DIR_ROOT, "dir1", DFS_FILEC_DIR, &dir_id);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_TRUE(file_id != dir_id);
+
+	err = dfs_dlist_entries(pt, "", 16, entries, &count);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(2, count);
+	TEST_ASSERT_TRUE(entries[0].id == file_id);
+	TEST_ASSERT_TRUE(entries[1].id == dir_id);
+
+	err = dfs_fopen_by_id(pt, file_id, DFS_FILEM_WRITE, &fd);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_fwrite(pt, fd, "data", 4, NULL);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	dfs_fclose(pt, fd);
+
+	err = dfs_stat_by_id(pt, file_id, &entry);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(false, entry.dir);
+	TEST_ASSERT_EQUAL_INT(4, entry.length);
+	TEST_ASSERT_EQUAL_STRING("file1.test", entry.name);
+
+	err = dfs_stat_by_id(pt, dir_id, &entry);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(true, entry.dir);
+	TEST_ASSERT_EQUAL_STRING("dir1", entry.name);
+
+	err = dfs_stat_by_id(pt, DFS_OBJ_ID_ROOT, &entry);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(true, entry.dir);
+}
+
+TEST(management_good, object_ids_after_removal)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	size_t count;
+	dfs_obj_id first_id, second_id, third_id, new_id;
+	dfs_entry entries[16] = { 0 };
+	dfs_entry entry;
+
+	dfs_ocreate_at(pt, DFS_DIR_ROOT, "first.file", DFS_FILEC_FILE, &first_id);
+	dfs_ocreate_at(pt, DFS_DIR_ROOT, "second.file", DFS_FILEC_FILE, &second_id);
+	dfs_ocreate_at(pt, DFS_DIR_ROOT, "third.file", DFS_FILEC_FILE, &third_id);
+
+	//Removing a sibling leaves the other ids alone
+	err = dfs_frm(pt, "first.file");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	err = dfs_stat_by_id(pt, first_id, &entry);
+	TEST_ASSERT_EQUAL_INT(DFS_FAILED_ENTRY_LOOKUP, err);
+	err = dfs_stat_by_id(pt, second_id, &entry);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_STRING("second.file", entry.name);
+	err = dfs_stat_by_id(pt, third_id, &entry);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_STRING("third.file", entry.name);
+
+	err = dfs_dlist_entries(pt, "", 16, entries, &count);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_INT(2, count);
+	TEST_ASSERT_TRUE(entries[0].id == second_id);
+	TEST_ASSERT_TRUE(entries[1].id == third_id);
+
+	//A new object takes the freed slot under another id, the old one stays stale
+	err = dfs_ocreate_at(pt, DFS_DIR_ROOT, "first.file", DFS_FILEC_FILE, &new_id);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_TRUE(new_id != first_id);
+	TEST_ASSERT_TRUE(new_id >> 32 == first_id >> 32);
+
+	err = dfs_stat_by_id(pt, first_id, &entry);
+	TEST_ASSERT_EQUAL_INT(DFS_FAILED_ENTRY_LOOKUP, err);
+	err = dfs_stat_by_id(pt, new_id, &entry);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	TEST_ASSERT_EQUAL_STRING("first.file", entry.name);
+
+	err = dfs_dlist_entries(pt, "", 16, entries, &count);
+	TEST_ASSERT_EQUAL_INT(3, count);
+
+	//Removed slots don't count as directory contents
+	dfs_dcreate(pt, "dir1");
+	dfs_fcreate(pt, "dir1/file1.test");
+	dfs_frm(pt, "dir1/file1.test");
+
+	err = dfs_dlist_entries(pt, "dir1", 16, entries, &count);
+	TEST_ASSERT_EQUAL_INT(0, count);
+	err = dfs_drm(pt, "dir1");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+}
+
 TEST_GROUP_RUNNER(management_good)
 {
 	RUN_TEST_CASE(management_good, list_entries);
+	RUN_TEST_CASE(management_good, object_ids);
+	RUN_TEST_CASE(management_good, object_ids_after_removal);
 }
 
 
@@ -123,7 +228,93 @@ TEST(mamagement_err, list_entries_errors)
 	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_dlist_entries accepted a NULL entries pointer with a non zero capacity.");
 }
 
+TEST(mamagement_err, object_ids_errors)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	int fd;
+	dfs_obj_id file_id, dir_id;
+	dfs_entry entry;
+
+	err = dfs_ocreate_at(pt, DFS_DIR_ROOT, "file1.test", 0x80, &file_id);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_FLAGS, err, "dfs_ocreate_at accepted invalid creation flags.");
+
+	dfs_ocreate_at(pt, DFS_DIR_ROOT, "file1.test", DFS_FILEC_FILE, &file_id);
+	dfs_ocreate_at(pt, DFS_DIR_ROOT, "dir1", DFS_FILEC_DIR, &dir_id);
+
+	err = dfs_stat_by_id(NULL, file_id, &entry);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_stat_by_id accepted a NULL partition.");
+
+	err = dfs_stat_by_id(pt, file_id, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_stat_by_id accepted a NULL entry.");
+
+	err = dfs_stat_by_id(pt, file_id + 5, &entry);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_FAILED_ENTRY_LOOKUP, err, "dfs_stat_by_id accepted an id past the block's entries.");
+
+	err = dfs_stat_by_id(pt, file_id ^ (1 << 12), &entry);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_FAILED_ENTRY_LOOKUP, err, "dfs_stat_by_id accepted an id with a wrong check value.");
+
+	err = dfs_stat_by_id(pt, file_id ^ ((dfs_obj_id)OBJ_ID_CHECK_MASK << OBJ_ID_ENTRY_BITS), &entry);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_FAILED_ENTRY_LOOKUP, err, "dfs_stat_by_id accepted an id with all check bits flipped.");
+
+	err = dfs_stat_by_id(pt, file_id | ((1 << OBJ_ID_ENTRY_BITS) - 1), &entry);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ID, err, "dfs_stat_by_id accepted an entry index past the block.");
+
+	err = dfs_stat_by_id(pt, (dfs_obj_id)0x7FFF << 32, &entry);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ID, err, "dfs_stat_by_id accepted an out of range id.");
+
+	err = dfs_stat_by_id(pt, (dfs_obj_id)8 << 32, &entry);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_FAILED_ENTRY_LOOKUP, err, "dfs_stat_by_id accepted an id in a free block.");
+
+	err = dfs_fopen_by_id(pt, file_id, DFS_FILEM_RDWR, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_fopen_by_id accepted a NULL descriptor.");
+
+	err = dfs_fopen_by_id(pt, dir_id, DFS_FILEM_RDWR, &fd);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_fopen_by_id opened a directory.");
+
+	err = dfs_fopen_by_id(pt, file_id + 5, DFS_FILEM_RDWR, &fd);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_FAILED_ENTRY_LOOKUP, err, "dfs_fopen_by_id accepted an invalid id.");
+}
+
+TEST(mamagement_err, stale_object_ids)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	int fd;
+	size_t io;
+	dfs_obj_id file_id;
+	dfs_entry entry;
+	static char data[BLOCK_DATA_SIZE];
+
+	dfs_dcreate(pt, "dir1");
+	err = dfs_ocreate_at(pt, DFS_DIR_ROOT, "dir1/file1.test", DFS_FILEC_FILE, &file_id);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+	err = dfs_rmtree(pt, "dir1");
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	err = dfs_stat_by_id(pt, file_id, &entry);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_FAILED_ENTRY_LOOKUP, err, "dfs_stat_by_id accepted the id of a removed object.");
+
+	//Fill every free block, including the old directory block, with data that parses as entries
+	entry_pointer fake = { .first_blk = (blk_idx_t)(file_id >> 32), .last_blk = (blk_idx_t)(file_id >> 32), .name = "file1.test" };
+	for (size_t off = 0; off + sizeof(fake) <= BLOCK_DATA_SIZE; off += sizeof(fake))
+		memcpy(data + off, &fake, sizeof(fake));
+
+	dfs_fcreate(pt, "filler");
+	dfs_fopen(pt, "filler", DFS_FILEM_WRITE, &fd);
+	for (size_t i = 0; !dfs_pwrite(pt, fd, i * BLOCK_DATA_SIZE, data, BLOCK_DATA_SIZE, &io); i++);
+	dfs_fclose(pt, fd);
+
+	err = dfs_stat_by_id(pt, file_id, &entry);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_FAILED_ENTRY_LOOKUP, err, "dfs_stat_by_id parsed file data as an entry.");
+
+	err = dfs_fopen_by_id(pt, file_id, DFS_FILEM_WRITE, &fd);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_FAILED_ENTRY_LOOKUP, err, "dfs_fopen_by_id opened file data as an entry.");
+}
+
 TEST_GROUP_RUNNER(mamagement_err)
 {
 	RUN_TEST_CASE(mamagement_err, list_entries_errors);
+	RUN_TEST_CASE(mamagement_err, object_ids_errors);
+	RUN_TEST_CASE(mamagement_err, stale_object_ids);
 }
@@ -54,10 +54,57 @@ TEST(partition_good, open_close_partition)
 	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
 }
 
+TEST(partition_good, read_only_partition)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	size_t avail_size = 1 << 20; //1M
+	char *device = "./test_read_only_partition.hex";
+	char buffer[16];
+	size_t readc, writes;
+	int fd;
+
+	dfs_pcreate(device, avail_size);
+	dfs_popen(device, &pt);
+	dfs_fcreate(pt, "ro.file");
+	dfs_fopen(pt, "ro.file", DFS_FILEM_WRITE, &fd);
+	dfs_fwrite(pt, fd, "data", 4, NULL);
+	dfs_fclose(pt, fd);
+	dfs_pclose(pt);
+
+	//Read workloads never write, neither on normal nor on read-only partitions
+	for (int read_only = 0; read_only < 2; read_only++)
+	{
+		writes = device_write_count;
+
+		err = read_only ? dfs_popen_readonly(device, &pt) : dfs_popen(device, &pt);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+		err = dfs_fopen(pt, "ro.file", DFS_FILEM_READ | DFS_FILEM_BUFFERED, &fd);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		err = dfs_fread(pt, fd, buffer, sizeof(buffer), &readc);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		TEST_ASSERT_EQUAL_INT(4, readc);
+		TEST_ASSERT_EQUAL_MEMORY("data", buffer, 4);
+
+		err = dfs_fseek(pt, fd, 1 << 16, DFS_SEEK_SET);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+		err = dfs_fread(pt, fd, buffer, sizeof(buffer), &readc);
+		TEST_ASSERT_EQUAL_INT(0, readc);
+
+		dfs_fclose(pt, fd);
+		err = dfs_pclose(pt);
+		TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+		TEST_ASSERT_EQUAL_INT(writes, device_write_count);
+	}
+}
+
 TEST_GROUP_RUNNER(partition_good)
 {
 	RUN_TEST_CASE(partition_good, create_partition);
 	RUN_TEST_CASE(partition_good, open_close_partition);
+	RUN_TEST_CASE(partition_good, read_only_partition);
 }
 
 
@@ -136,9 +183,45 @@ TEST(partition_err, open_corrupt_partition_errors)
 	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_CORRUPTED_PARTITION, err, "dfs_popen accepted a corrupted partition.");
 }
 
+TEST(partition_err, read_only_partition_errors)
+{
+	fprintf(stderr, "\nEntering %s\n\n", __func__);
+
+	size_t avail_size = 1 << 20; //1M
+	char *device = "./test_read_only_partition_errors.hex";
+	const char *paths[] = { "many.file" };
+	int fd;
+
+	dfs_pcreate(device, avail_size);
+	dfs_popen(device, &pt);
+	dfs_fcreate(pt, "ro.file");
+	dfs_pclose(pt);
+
+	err = dfs_popen_readonly(NULL, &pt);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_NVAL_ARGS, err, "dfs_popen_readonly accepted a NULL device.");
+
+	err = dfs_popen_readonly(device, &pt);
+	TEST_ASSERT_EQUAL_INT(DFS_SUCCESS, err);
+
+	err = dfs_fcreate(pt, "new.file");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_fcreate succeeded on a read-only partition.");
+
+	err = dfs_dcreate(pt, "new_dir");
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_dcreate succeeded on a read-only partition.");
+
+	err = dfs_create_many(pt, paths, DFS_FILEC_FILE, 1, NULL);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_create_many succeeded on a read-only partition.");
+
+	err = dfs_fopen(pt, "ro.file", DFS_FILEM_RDWR, &fd);
+	TEST_ASSERT_EQUAL_INT_MESSAGE(DFS_UNAUTHORIZED_ACCESS, err, "dfs_fopen opened a file for writing on a read-only partition.");
+
+	dfs_pclose(pt);
+}
+
 TEST_GROUP_RUNNER(partition_err)
 {
 	RUN_TEST_CASE(partition_err, create_partition_errors);
 	RUN_TEST_CASE(partition_err, open_close_partition_errors);
 	RUN_TEST_CASE(partition_err, open_corrupt_partition_errors);
+	RUN_TEST_CASE(partition_err, read_only_partition_errors);
 }